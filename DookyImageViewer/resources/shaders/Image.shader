@@ -8,15 +8,19 @@ uniform mat4 projection;
 uniform vec2 size;
 uniform vec2 scale;
 uniform bool flipVertically;
+uniform vec4 tileRect; // Part of the image this quad covers, normalised x, y, width and height with rows going the same way as the pixel data
+uniform vec4 tileTextureRect; // Part of the texture drawn there
 
 void main() {
-	gl_Position = projection * vec4(vertex.x * size.x * scale.x, vertex.y * size.y * scale.y, 0.0f, 1.0f);
+	vec2 tile = vec2(vertex.z, flipVertically ? 1.0f - vertex.w : vertex.w);
+	vec2 corner = tileRect.xy + tile * tileRect.zw;
 
 	if (flipVertically) {
-		texCoords = vec2(vertex.z, -vertex.w);
-	} else {
-		texCoords = vec2(vertex.z, vertex.w);
+		corner.y = 1.0f - corner.y;
 	}
+
+	gl_Position = projection * vec4(corner.x * size.x * scale.x, corner.y * size.y * scale.y, 0.0f, 1.0f);
+	texCoords = tileTextureRect.xy + tile * tileTextureRect.zw;
 }
 
 #shader fragment
@@ -26,6 +30,9 @@ in vec2 texCoords;
 out vec4 fragColor;
 
 uniform sampler2D image;
+uniform sampler2D palette; // 256x1, only used when the image holds palette indices
+uniform bool useIndexedColor;
+uniform bool useLinearInterpolation;
 
 uniform float time;
 uniform vec2 position;
@@ -63,8 +70,38 @@ const mat3 HighlightFixMat = mat3( // Prevents bright blues going to purple
 	0.0005471261, 0.0008833746, 1.0003362486
 );
 
+vec4 LookupIndexedColor(ivec2 texel) {
+	texel = clamp(texel, ivec2(0), textureSize(image, 0) - 1);
+	int index = int(texelFetch(image, texel, 0).r * 255.0f + 0.5f);
+
+	return texelFetch(palette, ivec2(index, 0), 0);
+}
+
+// Indices can't be filtered by the texture unit, so look up the four nearest colours and filter those instead
+vec4 SampleIndexedColor(vec2 coords) {
+	vec2 texel = coords * vec2(textureSize(image, 0)) - 0.5f;
+
+	if (!useLinearInterpolation) {
+		return LookupIndexedColor(ivec2(floor(texel + 0.5f)));
+	}
+
+	ivec2 base = ivec2(floor(texel));
+	vec2 f = fract(texel);
+
+	vec4 top = mix(LookupIndexedColor(base), LookupIndexedColor(base + ivec2(1, 0)), f.x);
+	vec4 bottom = mix(LookupIndexedColor(base + ivec2(0, 1)), LookupIndexedColor(base + ivec2(1, 1)), f.x);
+
+	return mix(top, bottom, f.y);
+}
+
 void main() {
-	vec4 sampled = texture(image, texCoords).rgba;
+	vec4 sampled;
+
+	if (useIndexedColor) {
+		sampled = SampleIndexedColor(texCoords);
+	} else {
+		sampled = texture(image, texCoords).rgba;
+	}
 
 	vec2 fragCoord = gl_FragCoord.xy;
 	vec2 pos = floor((fragCoord + vec2(-position.x, position.y)) / checkerboardSize);
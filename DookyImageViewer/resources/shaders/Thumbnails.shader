@@ -0,0 +1,37 @@
+#shader vertex
+#version 330 core
+
+// One instance per quad, the corners come from gl_VertexID so there's no vertex buffer
+layout(location = 0) in vec4 rect; // x, y, width and height in window pixels, y going down
+layout(location = 1) in vec4 textureRect; // Part of the atlas, starting from the bottom row
+layout(location = 2) in vec4 color;
+layout(location = 3) in float textured;
+
+out vec2 texCoords;
+out vec4 quadColor;
+out float useTexture;
+
+uniform mat4 projection;
+
+void main() {
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+
+	gl_Position = projection * vec4(rect.xy + corner * rect.zw, 0.0f, 1.0f);
+	texCoords = textureRect.xy + vec2(corner.x, 1.0f - corner.y) * textureRect.zw;
+	quadColor = color;
+	useTexture = textured;
+}
+
+#shader fragment
+#version 330 core
+
+in vec2 texCoords;
+in vec4 quadColor;
+in float useTexture;
+out vec4 fragColor;
+
+uniform sampler2D atlas;
+
+void main() {
+	fragColor = useTexture > 0.5f ? texture(atlas, texCoords) * quadColor : quadColor;
+}
\ No newline at end of file
@@ -0,0 +1,634 @@
+#include "AnimationDecoder.h"
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <Magick++.h>
+
+// stb_image is implemented here since decoding GIFs one frame at a time needs its internals, the public API only decodes all of them at once
+#define STB_IMAGE_IMPLEMENTATION
+#include "vendor/stb_image/stb_image.h"
+
+namespace Dooky {
+	uint32_t ReadBigEndian32(const unsigned char* p) {
+		return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+	}
+
+	uint16_t ReadBigEndian16(const unsigned char* p) {
+		return (p[0] << 8) | p[1];
+	}
+
+	uint32_t ReadLittleEndian32(const unsigned char* p) {
+		return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+
+	uint32_t ReadLittleEndian24(const unsigned char* p) {
+		return p[0] | (p[1] << 8) | (p[2] << 16);
+	}
+
+	// Skips over GIF data sub-blocks, returns the offset after the terminator or 0 if it runs off the end
+	size_t SkipGifSubBlocks(const std::vector<unsigned char>& bytes, size_t offset) {
+		while (offset < bytes.size()) {
+			int length = bytes[offset];
+			offset += 1 + length;
+
+			if (length == 0)
+				return offset;
+		}
+
+		return 0;
+	}
+
+	// Only counts up to limit, no need to go through the whole file to know it has more than one
+	int CountGifFrames(const std::vector<unsigned char>& bytes, int limit) {
+		if (bytes.size() < 13)
+			return 0;
+
+		size_t offset = 13; // Header and logical screen descriptor
+
+		if (bytes[10] & 0x80)
+			offset += 3 * (2 << (bytes[10] & 7)); // Global colour table
+
+		int count = 0;
+
+		while (offset < bytes.size() && count < limit) {
+			switch (bytes[offset]) {
+			case 0x21: // Extension
+				offset = SkipGifSubBlocks(bytes, offset + 2);
+				break;
+			case 0x2C: // Image
+				if (offset + 10 > bytes.size())
+					return count;
+
+				count++;
+
+				if (bytes[offset + 9] & 0x80)
+					offset += 3 * (2 << (bytes[offset + 9] & 7)); // Local colour table
+
+				offset = SkipGifSubBlocks(bytes, offset + 11); // Skip the LZW minimum code size too
+				break;
+			default: // Trailer or garbage
+				return count;
+			}
+
+			if (offset == 0)
+				return count;
+		}
+
+		return count;
+	}
+
+	// Frame count from the acTL chunk, it has to come before the first IDAT
+	int CountAPNGFrames(const std::vector<unsigned char>& bytes) {
+		size_t offset = 8;
+
+		while (offset + 12 <= bytes.size()) {
+			uint32_t length = ReadBigEndian32(&bytes[offset]);
+			const unsigned char* type = &bytes[offset + 4];
+
+			if (memcmp(type, "acTL", 4) == 0 && length >= 8 && offset + 16 <= bytes.size())
+				return ReadBigEndian32(&bytes[offset + 8]);
+
+			if (memcmp(type, "IDAT", 4) == 0)
+				return 0;
+
+			offset += 12 + (size_t)length;
+		}
+
+		return 0;
+	}
+
+	AnimationFormat DetectAnimationFormat(const std::vector<unsigned char>& bytes) {
+		if (bytes.size() < 21)
+			return AnimationFormat::None;
+
+		if (memcmp(bytes.data(), "GIF87a", 6) == 0 || memcmp(bytes.data(), "GIF89a", 6) == 0)
+			return CountGifFrames(bytes, 2) > 1 ? AnimationFormat::GIF : AnimationFormat::None;
+
+		if (memcmp(bytes.data(), "\x89PNG\r\n\x1A\n", 8) == 0)
+			return CountAPNGFrames(bytes) > 1 ? AnimationFormat::APNG : AnimationFormat::None;
+
+		// Animated WebPs are the extended format with the animation flag set
+		if (memcmp(bytes.data(), "RIFF", 4) == 0 && memcmp(&bytes[8], "WEBPVP8X", 8) == 0)
+			return (bytes[20] & 0x02) ? AnimationFormat::WebP : AnimationFormat::None;
+
+		return AnimationFormat::None;
+	}
+
+	////////////////////////////////////////
+	///// ANIMATION CANVAS
+	////////////////////////////////////////
+
+	enum class FrameDispose {
+		None, // Leave the frame there for the next one to draw over
+		Background, // Clear its area to transparent
+		Previous // Put back what was there before it was drawn
+	};
+
+	// What frames get composited onto, shared by the formats that don't hand over finished frames
+	struct AnimationCanvas {
+		int width = 0;
+		int height = 0;
+		std::vector<unsigned char> pixels;
+		std::vector<unsigned char> saved; // Canvas before the previous frame was drawn, only kept when it disposes to previous
+
+		int disposeX = 0; // Area of the previous frame
+		int disposeY = 0;
+		int disposeWidth = 0;
+		int disposeHeight = 0;
+		FrameDispose dispose = FrameDispose::None;
+
+		void Reset(int w, int h) {
+			width = w;
+			height = h;
+			pixels.assign((size_t)w * h * 4, 0);
+			saved.clear();
+			dispose = FrameDispose::None;
+		}
+
+		// Disposes of the previous frame and remembers how to dispose of this one
+		void BeginFrame(int x, int y, int w, int h, FrameDispose frameDispose) {
+			int x0 = std::clamp(disposeX, 0, width);
+			int y0 = std::clamp(disposeY, 0, height);
+			int x1 = std::clamp(disposeX + disposeWidth, 0, width);
+			int y1 = std::clamp(disposeY + disposeHeight, 0, height);
+
+			for (int row = y0; row < y1; row++) {
+				size_t start = ((size_t)row * width + x0) * 4;
+				size_t length = (size_t)(x1 - x0) * 4;
+
+				if (dispose == FrameDispose::Background) {
+					memset(&pixels[start], 0, length);
+				} else if (dispose == FrameDispose::Previous && !saved.empty()) {
+					memcpy(&pixels[start], &saved[start], length);
+				}
+			}
+
+			if (frameDispose == FrameDispose::Previous)
+				saved = pixels;
+
+			disposeX = x;
+			disposeY = y;
+			disposeWidth = w;
+			disposeHeight = h;
+			dispose = frameDispose;
+		}
+
+		// Draws straight RGBA over the canvas, either replacing what's there or alpha blending over it
+		void Draw(const unsigned char* frame, int x, int y, int w, int h, bool blend) {
+			for (int row = std::max(0, -y); row < h && y + row < height; row++) {
+				for (int column = std::max(0, -x); column < w && x + column < width; column++) {
+					const unsigned char* source = &frame[((size_t)row * w + column) * 4];
+					unsigned char* destination = &pixels[((size_t)(y + row) * width + x + column) * 4];
+
+					if (!blend || source[3] == 255) {
+						memcpy(destination, source, 4);
+					} else if (source[3] > 0) {
+						// Non premultiplied over operator
+						float sourceAlpha = source[3] / 255.0f;
+						float destinationAlpha = destination[3] / 255.0f * (1.0f - sourceAlpha);
+						float alpha = sourceAlpha + destinationAlpha;
+
+						for (int i = 0; i < 3; i++) {
+							destination[i] = (unsigned char)((source[i] * sourceAlpha + destination[i] * destinationAlpha) / alpha + 0.5f);
+						}
+
+						destination[3] = (unsigned char)(alpha * 255.0f + 0.5f);
+					}
+				}
+			}
+		}
+	};
+
+	////////////////////////////////////////
+	///// FRAME SOURCES
+	////////////////////////////////////////
+
+	struct AnimationFrameSource {
+		int width = 0;
+		int height = 0;
+
+		virtual ~AnimationFrameSource() {}
+		virtual bool Begin() = 0; // Also used to go back to the start
+		virtual bool Next(DecodedImageFrame& frame) = 0;
+	};
+
+	// stb_image already composites GIF frames, it only needs the frame from two frames back for the ones that dispose to previous
+	struct GifFrameSource : AnimationFrameSource {
+		const std::vector<unsigned char>& bytes;
+		stbi__context context;
+		stbi__gif gif;
+		std::vector<unsigned char> previous;
+		std::vector<unsigned char> twoBack;
+		int frameIndex;
+
+		GifFrameSource(const std::vector<unsigned char>& bytes) : bytes(bytes) {
+			memset(&gif, 0, sizeof(gif));
+			frameIndex = 0;
+		}
+
+		~GifFrameSource() {
+			Free();
+		}
+
+		void Free() {
+			STBI_FREE(gif.out);
+			STBI_FREE(gif.background);
+			STBI_FREE(gif.history);
+			memset(&gif, 0, sizeof(gif));
+		}
+
+		bool Begin() override {
+			Free();
+			stbi__start_mem(&context, bytes.data(), (int)bytes.size());
+
+			previous.clear();
+			twoBack.clear();
+			frameIndex = 0;
+
+			return stbi_info_from_memory(bytes.data(), (int)bytes.size(), &width, &height, nullptr) != 0;
+		}
+
+		bool Next(DecodedImageFrame& frame) override {
+			int components = 0;
+			stbi_uc* pixels = stbi__gif_load_next(&context, &gif, &components, 4, frameIndex >= 2 ? twoBack.data() : nullptr);
+
+			if (pixels == nullptr || pixels == (stbi_uc*)&context) // The context is returned at the end of the file
+				return false;
+
+			size_t size = (size_t)gif.w * gif.h * 4;
+
+			frame.data.assign(pixels, pixels + size);
+			frame.delay = gif.delay / 10; // Milliseconds
+
+			twoBack.swap(previous);
+			previous = frame.data;
+			frameIndex++;
+
+			return true;
+		}
+	};
+
+	// stb_image can't decode APNG frames by itself, but each frame is just a normal PNG stream with the size changed
+	// so every frame gets put back together into a standalone PNG and decoded as that
+	struct APNGFrameSource : AnimationFrameSource {
+		struct Frame {
+			int x;
+			int y;
+			int width;
+			int height;
+			int delay; // In centiseconds
+			FrameDispose dispose;
+			bool blend;
+			std::vector<std::pair<size_t, size_t>> data; // Offset and length of each piece of compressed data
+		};
+
+		const std::vector<unsigned char>& bytes;
+		std::vector<unsigned char> header; // IHDR data
+		std::vector<unsigned char> sharedChunks; // PLTE, tRNS and the like, needed by every frame
+		std::vector<Frame> frames;
+		AnimationCanvas canvas;
+		size_t frameIndex;
+
+		APNGFrameSource(const std::vector<unsigned char>& bytes) : bytes(bytes) {
+			frameIndex = 0;
+		}
+
+		bool Parse() {
+			size_t offset = 8;
+			bool seenImageData = false;
+
+			while (offset + 12 <= bytes.size()) {
+				size_t length = ReadBigEndian32(&bytes[offset]);
+				const unsigned char* type = &bytes[offset + 4];
+				const unsigned char* data = &bytes[offset + 8];
+
+				if (offset + 12 + length > bytes.size())
+					break;
+
+				if (memcmp(type, "IHDR", 4) == 0 && length == 13) {
+					header.assign(data, data + length);
+					width = ReadBigEndian32(data);
+					height = ReadBigEndian32(data + 4);
+				} else if (memcmp(type, "fcTL", 4) == 0 && length >= 26) {
+					Frame frame;
+					frame.width = ReadBigEndian32(data + 4);
+					frame.height = ReadBigEndian32(data + 8);
+					frame.x = ReadBigEndian32(data + 12);
+					frame.y = ReadBigEndian32(data + 16);
+
+					int numerator = ReadBigEndian16(data + 20);
+					int denominator = ReadBigEndian16(data + 22);
+					frame.delay = numerator * 100 / (denominator == 0 ? 100 : denominator);
+
+					frame.dispose = data[24] == 1 ? FrameDispose::Background : (data[24] == 2 ? FrameDispose::Previous : FrameDispose::None);
+					frame.blend = data[25] == 1;
+
+					frames.push_back(frame);
+				} else if (memcmp(type, "IDAT", 4) == 0) {
+					seenImageData = true;
+
+					// The default image is only part of the animation if it has a fcTL before it
+					if (!frames.empty())
+						frames.back().data.push_back({ offset + 8, length });
+				} else if (memcmp(type, "fdAT", 4) == 0 && length > 4) {
+					if (!frames.empty())
+						frames.back().data.push_back({ offset + 12, length - 4 }); // Skip the sequence number
+				} else if (memcmp(type, "IEND", 4) == 0) {
+					break;
+				} else if (!seenImageData && memcmp(type, "acTL", 4) != 0) {
+					sharedChunks.insert(sharedChunks.end(), bytes.begin() + offset, bytes.begin() + offset + 12 + length);
+				}
+
+				offset += 12 + length;
+			}
+
+			// Frames without any data can't be decoded
+			frames.erase(std::remove_if(frames.begin(), frames.end(), [](const Frame& frame) { return frame.data.empty(); }), frames.end());
+
+			return header.size() == 13 && !frames.empty() && width > 0 && height > 0;
+		}
+
+		// stb_image doesn't check the CRCs so they're left at 0
+		void AppendChunk(std::vector<unsigned char>& png, const char* type, const unsigned char* data, size_t length) {
+			unsigned char lengthBytes[4] = { (unsigned char)(length >> 24), (unsigned char)(length >> 16), (unsigned char)(length >> 8), (unsigned char)length };
+			unsigned char crc[4] = { 0, 0, 0, 0 };
+
+			png.insert(png.end(), lengthBytes, lengthBytes + 4);
+			png.insert(png.end(), type, type + 4);
+			png.insert(png.end(), data, data + length);
+			png.insert(png.end(), crc, crc + 4);
+		}
+
+		bool Begin() override {
+			if (header.empty() && !Parse())
+				return false;
+
+			canvas.Reset(width, height);
+			frameIndex = 0;
+
+			return true;
+		}
+
+		bool Next(DecodedImageFrame& frame) override {
+			if (frameIndex >= frames.size())
+				return false;
+
+			const Frame& current = frames[frameIndex];
+			std::vector<unsigned char> png(bytes.begin(), bytes.begin() + 8); // Signature
+
+			std::vector<unsigned char> frameHeader = header;
+			unsigned char size[8] = {
+				(unsigned char)(current.width >> 24), (unsigned char)(current.width >> 16), (unsigned char)(current.width >> 8), (unsigned char)current.width,
+				(unsigned char)(current.height >> 24), (unsigned char)(current.height >> 16), (unsigned char)(current.height >> 8), (unsigned char)current.height
+			};
+			memcpy(frameHeader.data(), size, 8);
+
+			AppendChunk(png, "IHDR", frameHeader.data(), frameHeader.size());
+			png.insert(png.end(), sharedChunks.begin(), sharedChunks.end());
+
+			for (const std::pair<size_t, size_t>& data : current.data) {
+				AppendChunk(png, "IDAT", &bytes[data.first], data.second);
+			}
+
+			AppendChunk(png, "IEND", nullptr, 0);
+
+			int w = 0;
+			int h = 0;
+			int components = 0;
+			unsigned char* pixels = stbi_load_from_memory(png.data(), (int)png.size(), &w, &h, &components, 4);
+
+			if (pixels == nullptr)
+				return false;
+
+			// The first frame has nothing to go back to
+			FrameDispose dispose = frameIndex == 0 && current.dispose == FrameDispose::Previous ? FrameDispose::Background : current.dispose;
+
+			canvas.BeginFrame(current.x, current.y, w, h, dispose);
+			canvas.Draw(pixels, current.x, current.y, w, h, current.blend);
+			stbi_image_free(pixels);
+
+			frame.data = canvas.pixels;
+			frame.delay = current.delay;
+			frameIndex++;
+
+			return true;
+		}
+	};
+
+	// Asking ImageMagick for one frame of an animated WebP decodes every frame before it too, so each frame's bitstream gets put back
+	// together into a standalone still WebP and only that is decoded. The offsets, blending and disposal come from the ANMF chunks
+	struct WebPFrameSource : AnimationFrameSource {
+		struct Frame {
+			int x;
+			int y;
+			int width;
+			int height;
+			int delay; // In centiseconds
+			FrameDispose dispose;
+			bool blend;
+			bool hasAlphaChunk; // Lossy with an ALPH chunk, only allowed in the extended format
+			size_t offset; // The frame's own chunks, everything in the ANMF after its header
+			size_t length;
+		};
+
+		const std::vector<unsigned char>& bytes;
+		std::vector<Frame> frames;
+		AnimationCanvas canvas;
+		size_t frameIndex;
+
+		WebPFrameSource(const std::vector<unsigned char>& bytes) : bytes(bytes) {
+			frameIndex = 0;
+		}
+
+		bool Parse() {
+			size_t offset = 12; // RIFF header
+
+			while (offset + 8 <= bytes.size()) {
+				const unsigned char* type = &bytes[offset];
+				size_t length = ReadLittleEndian32(&bytes[offset + 4]);
+				const unsigned char* data = &bytes[offset + 8];
+
+				if (length > bytes.size() - offset - 8)
+					break;
+
+				if (memcmp(type, "VP8X", 4) == 0 && length >= 10) {
+					width = ReadLittleEndian24(data + 4) + 1;
+					height = ReadLittleEndian24(data + 7) + 1;
+				} else if (memcmp(type, "ANMF", 4) == 0 && length >= 24) {
+					Frame frame;
+					frame.x = ReadLittleEndian24(data) * 2;
+					frame.y = ReadLittleEndian24(data + 3) * 2;
+					frame.width = ReadLittleEndian24(data + 6) + 1;
+					frame.height = ReadLittleEndian24(data + 9) + 1;
+					frame.delay = ReadLittleEndian24(data + 12) / 10; // Milliseconds
+					frame.dispose = (data[15] & 0x01) ? FrameDispose::Background : FrameDispose::None;
+					frame.blend = (data[15] & 0x02) == 0;
+					frame.hasAlphaChunk = memcmp(data + 16, "ALPH", 4) == 0;
+					frame.offset = offset + 8 + 16;
+					frame.length = length - 16;
+
+					frames.push_back(frame);
+				}
+
+				offset += 8 + length + (length & 1); // Chunks are padded to an even length
+			}
+
+			return !frames.empty() && width > 0 && height > 0;
+		}
+
+		bool Begin() override {
+			if (frames.empty() && !Parse())
+				return false;
+
+			canvas.Reset(width, height);
+			frameIndex = 0;
+
+			return true;
+		}
+
+		bool Next(DecodedImageFrame& frame) override {
+			if (frameIndex >= frames.size())
+				return false;
+
+			const Frame& current = frames[frameIndex];
+			std::vector<unsigned char> webp = { 'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'E', 'B', 'P' };
+
+			if (current.hasAlphaChunk) {
+				int w = current.width - 1;
+				int h = current.height - 1;
+				unsigned char header[18] = {
+					'V', 'P', '8', 'X', 10, 0, 0, 0,
+					0x10, 0, 0, 0, // Has alpha
+					(unsigned char)w, (unsigned char)(w >> 8), (unsigned char)(w >> 16),
+					(unsigned char)h, (unsigned char)(h >> 8), (unsigned char)(h >> 16)
+				};
+
+				webp.insert(webp.end(), header, header + sizeof(header));
+			}
+
+			webp.insert(webp.end(), bytes.begin() + current.offset, bytes.begin() + current.offset + current.length);
+
+			uint32_t riffSize = (uint32_t)webp.size() - 8;
+			memcpy(&webp[4], &riffSize, 4);
+
+			try {
+				Magick::Image image;
+				image.read(Magick::Blob(webp.data(), webp.size()));
+
+				std::vector<unsigned char> pixels;
+				ExportMagickPixels(image, PixelFormat::RGBA8, pixels);
+
+				int w = image.columns();
+				int h = image.rows();
+
+				canvas.BeginFrame(current.x, current.y, w, h, current.dispose);
+				canvas.Draw(pixels.data(), current.x, current.y, w, h, current.blend);
+
+				frame.data = canvas.pixels;
+				frame.delay = current.delay;
+				frameIndex++;
+
+				return true;
+			} catch (std::exception& exception) {
+				std::cout << "FAILED TO DECODE ANIMATION FRAME: " << exception.what() << std::endl;
+				return false;
+			}
+		}
+	};
+
+	////////////////////////////////////////
+	///// CLASS: ANIMATION DECODER
+	////////////////////////////////////////
+
+	AnimationDecoder::AnimationDecoder() {
+		format = AnimationFormat::None;
+		width = 0;
+		height = 0;
+	}
+
+	AnimationDecoder::~AnimationDecoder() {
+		source.reset(); // Frame sources hold on to the bytes
+	}
+
+	////////////////////////////////////////
+	///// PUBLIC
+	////////////////////////////////////////
+
+	bool AnimationDecoder::Open(const std::filesystem::path& path) {
+		std::vector<unsigned char> fileBytes;
+
+		if (!ReadFileBytes(path, fileBytes))
+			return false;
+
+		return Open(path, std::move(fileBytes));
+	}
+
+	bool AnimationDecoder::Open(const std::filesystem::path& path, std::vector<unsigned char> fileBytes) {
+		source.reset();
+
+		this->path = path;
+		bytes = std::move(fileBytes);
+		format = DetectAnimationFormat(bytes);
+
+		switch (format) {
+		case AnimationFormat::GIF:  source = std::make_unique<GifFrameSource>(bytes); break;
+		case AnimationFormat::APNG: source = std::make_unique<APNGFrameSource>(bytes); break;
+		case AnimationFormat::WebP: source = std::make_unique<WebPFrameSource>(bytes); break;
+		default: return false;
+		}
+
+		if (!source->Begin()) {
+			source.reset();
+			return false;
+		}
+
+		width = source->width;
+		height = source->height;
+
+		return true;
+	}
+
+	bool AnimationDecoder::ReadFrame(DecodedImageFrame& frame) {
+		if (source == nullptr || !source->Next(frame))
+			return false;
+
+		// Every frame is the size of the canvas, anything else means the decoder got confused
+		return frame.data.size() == (size_t)width * height * 4;
+	}
+
+	bool AnimationDecoder::Rewind() {
+		return source != nullptr && source->Begin();
+	}
+
+	int AnimationDecoder::GetWidth() {
+		return width;
+	}
+
+	int AnimationDecoder::GetHeight() {
+		return height;
+	}
+
+	AnimationFormat AnimationDecoder::GetFormat() {
+		return format;
+	}
+
+	bool DecodeAnimationFirstFrame(const std::filesystem::path& path, std::vector<unsigned char> bytes, DecodedImage& decoded) {
+		AnimationDecoder decoder;
+		DecodedImageFrame frame;
+
+		if (!decoder.Open(path, std::move(bytes)) || !decoder.ReadFrame(frame))
+			return false;
+
+		decoded.width = decoder.GetWidth();
+		decoded.height = decoder.GetHeight();
+		decoded.fullWidth = decoded.width;
+		decoded.fullHeight = decoded.height;
+		decoded.useTonemapping = false;
+		decoded.isAnimated = true;
+		decoded.format = PixelFormat::RGBA8;
+		decoded.data = std::move(frame.data);
+
+		return true;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#ifndef ANIMATIONDECODER_H
+#define ANIMATIONDECODER_H
+
+#include <vector>
+#include <memory>
+#include <filesystem>
+
+#include "ImageDecoder.h"
+
+namespace Dooky {
+	enum class AnimationFormat {
+		None,
+		GIF,
+		APNG,
+		WebP
+	};
+
+	// Returns None if the file isn't an animation this can decode, or only has one frame
+	AnimationFormat DetectAnimationFormat(const std::vector<unsigned char>& bytes);
+
+	struct AnimationFrameSource; // One for each format, defined in the .cpp
+
+	// Decodes an animation one composited frame at a time so only the canvas has to be kept in memory, not every frame
+	// Frames always come out as RGBA8 at the size of the canvas
+	class AnimationDecoder {
+	private:
+		std::filesystem::path path;
+		std::vector<unsigned char> bytes; // The whole file, still compressed
+		std::unique_ptr<AnimationFrameSource> source;
+		AnimationFormat format;
+
+		int width;
+		int height;
+	public:
+		AnimationDecoder();
+		~AnimationDecoder();
+
+		bool Open(const std::filesystem::path& path); // Returns false if it isn't an animation, see DetectAnimationFormat
+		bool Open(const std::filesystem::path& path, std::vector<unsigned char> fileBytes); // For when the file was already read
+		bool ReadFrame(DecodedImageFrame& frame); // Returns false after the last frame or if decoding failed
+		bool Rewind(); // Back to the first frame
+
+		int GetWidth();
+		int GetHeight();
+		AnimationFormat GetFormat();
+	};
+
+	// Only decodes the first frame into decoded.data and sets isAnimated, Image streams the rest while it plays (see AnimationStream)
+	bool DecodeAnimationFirstFrame(const std::filesystem::path& path, std::vector<unsigned char> bytes, DecodedImage& decoded);
+}
+
+#endif
\ No newline at end of file
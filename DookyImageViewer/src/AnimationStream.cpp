@@ -0,0 +1,124 @@
+#include "AnimationStream.h"
+
+#include <algorithm>
+
+#include "PixelConversion.h"
+
+namespace Dooky {
+	////////////////////////////////////////
+	///// CLASS: ANIMATION STREAM
+	////////////////////////////////////////
+
+	AnimationStream::AnimationStream(const std::filesystem::path& path, size_t bufferBytes) {
+		this->path = path;
+		this->bufferBytes = bufferBytes;
+		bufferedBytes = 0;
+
+		shouldStop = false;
+		failed = false;
+		frameCount = -1;
+
+		worker = std::thread(&AnimationStream::WorkerLoop, this);
+	}
+
+	AnimationStream::~AnimationStream() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			shouldStop = true;
+		}
+
+		condition.notify_all();
+		worker.join();
+	}
+
+	////////////////////////////////////////
+	///// PRIVATE
+	////////////////////////////////////////
+
+	void AnimationStream::WorkerLoop() {
+		AnimationDecoder decoder;
+
+		if (!decoder.Open(path)) {
+			std::lock_guard<std::mutex> lock(mutex);
+			failed = true;
+			return;
+		}
+
+		size_t pixelCount = (size_t)decoder.GetWidth() * decoder.GetHeight();
+		std::vector<unsigned char> indices(pixelCount);
+		std::vector<unsigned char> palette(256 * 4);
+
+		int index = 0;
+
+		while (true) {
+			StreamedFrame streamed;
+
+			if (!decoder.ReadFrame(streamed.frame)) {
+				std::lock_guard<std::mutex> lock(mutex);
+
+				// Either the end, so go round again, or something is broken
+				if (index == 0 || !decoder.Rewind()) {
+					failed = true;
+					return;
+				}
+
+				if (frameCount < 0)
+					frameCount = index;
+
+				index = 0;
+				continue;
+			}
+
+			streamed.index = index++;
+
+			if (ConvertPixelsToIndexed(streamed.frame.data.data(), indices.data(), palette.data(), pixelCount) > 0) {
+				streamed.frame.data = std::vector<unsigned char>(indices.begin(), indices.end()); // A fresh vector so the RGBA memory actually gets freed
+				streamed.frame.palette = palette;
+			}
+
+			size_t frameBytes = streamed.frame.data.size() + streamed.frame.palette.size();
+
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [&]() { return shouldStop || bufferedFrames.size() < 2 || bufferedBytes + frameBytes <= bufferBytes; });
+
+			if (shouldStop)
+				return;
+
+			bufferedFrames.push_back(std::move(streamed));
+			bufferedBytes += frameBytes;
+		}
+	}
+
+	////////////////////////////////////////
+	///// PUBLIC
+	////////////////////////////////////////
+
+	bool AnimationStream::PopFrame(DecodedImageFrame& frame, int& index) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (bufferedFrames.empty())
+				return false;
+
+			frame = std::move(bufferedFrames.front().frame);
+			index = bufferedFrames.front().index;
+			bufferedFrames.pop_front();
+
+			bufferedBytes -= frame.data.size() + frame.palette.size();
+		}
+
+		condition.notify_one();
+
+		return true;
+	}
+
+	int AnimationStream::GetFrameCount() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return frameCount;
+	}
+
+	bool AnimationStream::HasFailed() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return failed;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef ANIMATIONSTREAM_H
+#define ANIMATIONSTREAM_H
+
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <filesystem>
+
+#include "AnimationDecoder.h"
+
+namespace Dooky {
+	// Decodes an animation on its own thread a few frames ahead of playback, looping back to the start forever
+	// Only as many frames as fit in the buffer are ever held, no matter how long the animation is
+	// Frames with 256 colours or less (all of them for most GIFs) get turned into palette indices, a quarter of the size
+	class AnimationStream {
+	private:
+		struct StreamedFrame {
+			int index;
+			DecodedImageFrame frame;
+		};
+
+		std::filesystem::path path;
+		std::thread worker;
+		std::deque<StreamedFrame> bufferedFrames;
+		size_t bufferBytes;
+		size_t bufferedBytes;
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool shouldStop;
+		bool failed;
+		int frameCount; // -1 until it has been all the way through once
+
+		void WorkerLoop();
+	public:
+		AnimationStream(const std::filesystem::path& path, size_t bufferBytes); // Always keeps at least 2 frames buffered, even if they don't fit
+		~AnimationStream();
+
+		bool PopFrame(DecodedImageFrame& frame, int& index); // Doesn't wait, returns false if the next frame hasn't been decoded yet, see DecodedImageFrame::palette
+		int GetFrameCount(); // -1 if not known yet
+		bool HasFailed();
+	};
+}
+
+#endif
\ No newline at end of file
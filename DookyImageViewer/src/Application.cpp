@@ -1,6 +1,10 @@
 #include "Application.h"
 #include "Window.h"
 #include "Image.h"
+#include "ImageLoader.h"
+#include "ImageCache.h"
+#include "ImagePrefetcher.h"
+#include "TextureCache.h"
 #include "Text.h"
 #include "ImageUtils.h"
 #include "ImageInfo.h"
@@ -65,6 +69,7 @@ int INFORMATION_BAR_HEIGHT = 19;
 int THUMBNAIL_PREVIEW_WITH_MENU_BAR_HEIGHT = 91;
 int MENU_BAR_HEIGHT = 19;
 glm::ivec2 ZOOM_TEXT_OFFSET = { 4, -5 };
+int TEXTURE_CACHE_NEIGHBOURS = 2; // Images either side of the current one that get uploaded ahead of time
 
 // VARIABLES
 
@@ -92,6 +97,14 @@ std::filesystem::path mainImageCurrentFilePath;
 std::stringstream fileSizeStr;
 
 Dooky::Text* errorMessageText;
+Dooky::ImageLoader* imageLoader;
+Dooky::ImageCache* imageCache;
+Dooky::ImagePrefetcher* imagePrefetcher;
+Dooky::TextureCache* textureCache;
+
+bool mainImageWaitingForLoad = false;
+bool mainImageWantsFullQuality = false; // Asked for the full quality version of a preview
+bool textureCacheNeighboursChanged = false; // Moved or something finished decoding, so the texture cache might have more to upload
 
 size_t GetFileSize(const std::filesystem::path& path) {
     std::ifstream input(path, std::ifstream::ate | std::ifstream::binary);
@@ -239,18 +252,95 @@ namespace Dooky {
         }
     }
 
-    // Only changes the image by itself
-    bool ChangeImage(Window& window, Image& mainImage, GUI& gui, const std::filesystem::path& imagePath) {
-        if (mainImage.LoadImageFile(imagePath)) {
-            HandlePostImageLoad(window, mainImage, gui, imagePath);
-            return true;
+    // Picks up images that finished decoding in the background
+    void HandleImageLoading(Window& window, Image& mainImage, GUI& gui) {
+        for (ImageLoadResult& result : imageLoader->PollFinished()) {
+            imagePrefetcher->HandleFinished(result);
+            textureCacheNeighboursChanged = true;
+        }
+
+        if (!mainImageWaitingForLoad)
+            return;
+
+        std::shared_ptr<DecodedImage> decoded;
+
+        if (!imagePrefetcher->GetFinished(mainImageCurrentFilePath, decoded))
+            return;
+
+        mainImageWaitingForLoad = false;
+
+        if (decoded != nullptr) {
+            mainImage.LoadDecodedImage(decoded);
+            HandlePostImageLoad(window, mainImage, gui, mainImageCurrentFilePath);
         } else {
-            //std::cout << "ERROR: Failed to change image: " << imagePath.string() << std::endl;
+            std::cout << "ERROR: Failed to load image: " << mainImageCurrentFilePath.string() << std::endl;
             HandleImageOpenFail(mainImage, gui);
-            return false;
         }
     }
 
+    // Swaps a preview (reduced resolution JPEG or the JPEG embedded in a RAW file) for the real thing without moving anything
+    // Happens once zoomed in past what the preview can show, or when asked for with F
+    void HandleFullResolutionLoading(Window& window, Image& mainImage, GUI& gui) {
+        if ((window.WasKeyFired(GLFW_KEY_F) && !gui.imguiCaptureKeyboard) || gui.wantsToLoadFullQuality)
+            mainImageWantsFullQuality = true;
+
+        if (mainImageWaitingForLoad || mainImageFailedToLoad || (!mainImage.IsReducedResolution() && !mainImage.IsEmbeddedPreview()))
+            return;
+
+        float resolutionScale = (float)mainImage.GetTextureSize().x / mainImage.GetSize().x;
+        bool zoomedIn = mainImageZoom > resolutionScale || (mainImage.IsEmbeddedPreview() && !mainImageEngaged);
+
+        if (!zoomedIn && !mainImageWantsFullQuality)
+            return;
+
+        std::shared_ptr<DecodedImage> decoded;
+
+        if (imagePrefetcher->GetFullResolution(mainImageCurrentFilePath, decoded) && decoded != nullptr) {
+            glm::ivec2 previousSize = mainImage.GetSize();
+            mainImage.RefineDecodedImage(decoded);
+
+            // Keep it the same size on screen
+            if (mainImage.GetSize().x > 0 && !mainImageEngaged)
+                mainImageZoom *= (float)previousSize.x / mainImage.GetSize().x;
+        }
+    }
+
+    // Only changes the image by itself, the previous image stays on screen until the new one has been decoded
+    // Step is how far and in which direction the browsing list index moved, used to guess which images to prefetch
+    void ChangeImage(Window& window, Image& mainImage, GUI& gui, const std::filesystem::path& imagePath, int step) {
+        std::shared_ptr<DecodedImage> cached = imageCache->Find(imagePath);
+
+        mainImageWantsFullQuality = false;
+
+        // JPEGs get decoded at a reduced resolution that still fills the window, HandleFullResolutionLoading takes care of zooming in
+        imagePrefetcher->SetTargetSize(window.GetSize().x, window.GetSize().y);
+        imagePrefetcher->Navigate(browsingListIndex, step);
+        textureCacheNeighboursChanged = true;
+
+        if (cached != nullptr) {
+            mainImageWaitingForLoad = false;
+            mainImage.LoadDecodedImage(cached);
+            HandlePostImageLoad(window, mainImage, gui, imagePath);
+
+            return;
+        }
+
+        mainImageWaitingForLoad = true;
+
+        std::string fileNameStr = "CAN'T DISPLAY FILE NAME!";
+        std::string browsingIndex = std::to_string(browsingListIndex + 1) + "/" + std::to_string(browsingList.size());
+
+        try {
+            fileNameStr = imagePath.filename().string();
+        } catch (std::system_error& exception) {}
+
+        gui.menuBarText = "| " + browsingIndex + " | " + fileNameStr + " | Loading...";
+        gui.menuBarExtraTextColor = MENU_BAR_EXTRA_TEXT_COLOR_NORMAL;
+
+        // Shows up straight away if it was already prefetched
+        HandleImageLoading(window, mainImage, gui);
+    }
+
     // Opens either an image or directory and also searches the directory/subdirectories
     bool OpenNewPath(Window& window, Image& mainImage, GUI& gui, const std::filesystem::path& openPath, bool supportedExtensionsOnly, bool openSubdirectories) {
         if (!std::filesystem::exists(openPath)) {
@@ -288,19 +378,14 @@ namespace Dooky {
             if (!newBrowsingList.empty()) {
                 browsingList = newBrowsingList;
                 SortBrowsingList(browsingListSortMode);
+                imagePrefetcher->SetBrowsingList(browsingList);
 
                 // Try opening the first file in the directory
                 std::filesystem::path front = browsingList.front();
                 mainImageCurrentFilePath = front;
                 browsingListIndex = 0;
 
-
-                if (mainImage.LoadImageFile(front)) {
-                    HandlePostImageLoad(window, mainImage, gui, front);
-                } else {
-                    HandleImageOpenFail(mainImage, gui);
-                    std::cout << "ERROR: Failed to load first image in newBrowsingList: " << openPath.string() << std::endl;
-                }
+                ChangeImage(window, mainImage, gui, front, 1);
 
                 return true;
             } else {
@@ -317,6 +402,7 @@ namespace Dooky {
 
             browsingList = newBrowsingList; // Has to be at least one path inside
             SortBrowsingList(browsingListSortMode);
+            imagePrefetcher->SetBrowsingList(browsingList);
 
             // Find index
             int newBrowsingListIndex = 0;
@@ -332,23 +418,15 @@ namespace Dooky {
 
             std::filesystem::path openPath2 = browsingList[newBrowsingListIndex];
             mainImageCurrentFilePath = openPath2;
+            browsingListIndex = newBrowsingListIndex;
 
-            // Load the image
-            if (mainImage.LoadImageFile(openPath2)) {
-                browsingListIndex = newBrowsingListIndex;
-
-                // Reset image stuff
-                HandlePostImageLoad(window, mainImage, gui, openPath2);
-                FitImageOnScreen(window, mainImage);
+            // Load the image, HandleImageLoading takes over once it has been decoded
+            ChangeImage(window, mainImage, gui, openPath2, 1);
 
-                return true;
-            } else {
-                HandleImageOpenFail(mainImage, gui);
-                std::cout << "ERROR: Failed to load image: " << openPath2.string() << std::endl;
-
-                return false;
-            }
+            return true;
         }
+
+        return false;
     }
 
     void UpdateMainImage(Window& window, Image& mainImage) {
@@ -374,6 +452,7 @@ namespace Dooky {
         mainImage.SetScale(mainImageZoom, mainImageZoom);
         mainImage.SetPosition(mainImagePosition.x, mainImagePosition.y);
         mainImage.SetRotation(mainImageRotation);
+        mainImage.UpdateVisibleRegion(window);
     }
     
     void HandleImageInteraction(Window& window, Image& mainImage, ThumbnailPreview& thumbnails, GUI& gui) {
@@ -510,6 +589,7 @@ namespace Dooky {
         if (window.WasKeyFired(GLFW_KEY_RIGHT) || window.WasKeyFired(GLFW_KEY_LEFT) || window.WasKeyFired(GLFW_KEY_COMMA) || window.WasKeyFired(GLFW_KEY_PERIOD) || mouseDeltaX != 0) {
             int prevIndex = browsingListIndex;
             int increment = 1;
+            int step = 0;
 
             if (leftControlDown) increment = 10;
 
@@ -517,6 +597,7 @@ namespace Dooky {
 
             if (window.WasKeyFired(GLFW_KEY_RIGHT) || mouseDeltaX < 0) {
                 browsingListIndex += increment;
+                step = increment;
 
                 if (browsingListIndex >= browsingList.size()) {
                     browsingListIndex = 0;
@@ -525,14 +606,16 @@ namespace Dooky {
 
             if (window.WasKeyFired(GLFW_KEY_LEFT) || mouseDeltaX > 0) {
                 browsingListIndex -= increment;
+                step = -increment;
 
                 if (browsingListIndex < 0) {
                     browsingListIndex = browsingList.size() - 1;
                 }
             }
 
-            if (window.WasKeyFired(GLFW_KEY_COMMA)) browsingListIndex = 0;
-            if (window.WasKeyFired(GLFW_KEY_PERIOD)) browsingListIndex = browsingList.size() - 1;
+            // After jumping to either end the only way to go is back towards the middle
+            if (window.WasKeyFired(GLFW_KEY_COMMA)) { browsingListIndex = 0; step = 1; }
+            if (window.WasKeyFired(GLFW_KEY_PERIOD)) { browsingListIndex = browsingList.size() - 1; step = -1; }
 
             if (prevIndex == browsingListIndex) return;
 
@@ -542,7 +625,7 @@ namespace Dooky {
             browsed = true;
 
             mainImageCurrentFilePath = browsingList[browsingListIndex];
-            ChangeImage(window, mainImage, gui, mainImageCurrentFilePath);
+            ChangeImage(window, mainImage, gui, mainImageCurrentFilePath, step);
         }
     }
 
@@ -648,6 +731,57 @@ namespace Dooky {
         mainImage.adjustment_ChannelMultiplier = gui.adjustment_rgbaChannelMultiplier;
     }
 
+    // Keeps the images either side of the current one uploaded so going back and forth doesn't have to upload anything
+    // Only the ones already decoded into the image cache can be uploaded, and only while the main image isn't uploading
+    void HandleTextureCaching(Image& mainImage) {
+        if (textureCacheNeighboursChanged && !browsingList.empty()) {
+            textureCacheNeighboursChanged = false;
+
+            std::vector<std::shared_ptr<const DecodedImage>> wanted;
+            int count = (int)browsingList.size();
+
+            for (int distance = 1; distance <= TEXTURE_CACHE_NEIGHBOURS; distance++) {
+                for (int direction : { 1, -1 }) {
+                    int index = ((browsingListIndex + distance * direction) % count + count) % count;
+
+                    if (index == browsingListIndex)
+                        continue;
+
+                    std::shared_ptr<DecodedImage> decoded = imageCache->Peek(browsingList[index]);
+
+                    if (decoded != nullptr && mainImage.CanCacheTexture(*decoded))
+                        wanted.push_back(decoded);
+                }
+            }
+
+            textureCache->SetWanted(wanted, mainImage.useMipmaps);
+        }
+
+        textureCache->Update(!mainImage.IsUploading(), mainImage.mipmapFilter);
+    }
+
+    void HandleCacheStatistics(GUI& gui) {
+        if (!gui.showCacheStatisticsWindow)
+            return;
+
+        size_t hits = imageCache->GetHitCount();
+        size_t misses = imageCache->GetMissCount();
+        float hitRate = hits + misses > 0 ? (float)hits / (hits + misses) * 100.0f : 0.0f;
+
+        std::stringstream text;
+        text << "Images: " << imageCache->GetEntryCount() << "\n";
+        text << "Memory: " << imageCache->GetUsedBytes() / (1024 * 1024) << "/" << imageCache->GetBudget() / (1024 * 1024) << " MB\n";
+        text << "Hits: " << hits << "\n";
+        text << "Misses: " << misses << "\n";
+        text << "Hit Rate: " << std::fixed << std::setprecision(1) << hitRate << "%\n";
+        text << "Evictions: " << imageCache->GetEvictionCount() << "\n";
+        text << "Prefetching: " << imagePrefetcher->GetAheadDepth() << " ahead, " << imagePrefetcher->GetBehindDepth() << " behind\n";
+        text << "Textures: " << textureCache->GetEntryCount() << " (" << textureCache->GetCompressedEntryCount() << " compressed), " << textureCache->GetUsedBytes() / (1024 * 1024) << "/" << textureCache->GetBudget() / (1024 * 1024) << " MB, ";
+        text << textureCache->GetHitCount() << " hits, " << textureCache->GetMissCount() << " misses";
+
+        gui.cacheStatisticsText = text.str();
+    }
+
     void HandleWindowInteraction(Window& window, Image& mainImage) {
         // Fullscreen
         if (window.WasKeyFired(GLFW_KEY_F11)) {
@@ -681,12 +815,20 @@ namespace Dooky {
         mainImage.SetAnchorPoint(0.5f, 0.5f);
         mainImage.FlipVertically(true);
         mainImage.useMipmaps = config.useMipmaps;
+        mainImage.mipmapFilter = config.useLanczosMipmaps ? DownsampleFilter::Lanczos : DownsampleFilter::Box;
+
+        imageLoader = new ImageLoader(std::clamp((int)std::thread::hardware_concurrency() / 2, 2, 4));
+        imageCache = new ImageCache((size_t)std::max(config.imageCacheSize, 0) * 1024 * 1024);
+        imagePrefetcher = new ImagePrefetcher(*imageLoader, *imageCache);
+        textureCache = new TextureCache((size_t)std::max(config.textureCacheSize, 0) * 1024 * 1024);
+        mainImage.textureCache = textureCache;
 
         errorMessageText = new Text;
         errorMessageText->LoadFontFromPath("resources/fonts/Consolas.ttf", 16);
         errorMessageText->SetAnchorPoint(0.5f, 0.5f);
 
         ThumbnailPreview thumbnails;
+        thumbnails.SetUseThumbnailPacks(config.useThumbnailPacks);
 
         GUI gui;
         gui.Initialise(window.GetWindowPointer());
@@ -757,10 +899,14 @@ namespace Dooky {
             
             // Update
             HandleImageBrowsing(window, mainImage, gui);
+            HandleImageLoading(window, mainImage, gui);
             HandleImageInteraction(window, mainImage, thumbnails, gui);
+            HandleFullResolutionLoading(window, mainImage, gui);
             HandleGuiInteraction(window, mainImage, thumbnails, gui);
             HandleImageShader(window, mainImage, gui);
             HandleWindowInteraction(window, mainImage);
+            HandleTextureCaching(mainImage);
+            HandleCacheStatistics(gui);
 
             UpdateMainImage(window, mainImage);
 
@@ -778,9 +924,11 @@ namespace Dooky {
             int thumbnailClickedIndex = thumbnails.GetClickedIndex();
 
             if (thumbnailClickedIndex >= 0 && thumbnailClickedIndex != browsingListIndex) {
+                int step = thumbnailClickedIndex > browsingListIndex ? 1 : -1;
+
                 browsingListIndex = thumbnailClickedIndex;
                 mainImageCurrentFilePath = browsingList[thumbnailClickedIndex];
-                ChangeImage(window, mainImage, gui, mainImageCurrentFilePath);
+                ChangeImage(window, mainImage, gui, mainImageCurrentFilePath, step);
                 thumbnails.ChangeIndex(thumbnailClickedIndex);
             }
             
@@ -841,6 +989,16 @@ namespace Dooky {
                 // Image rotation
                 zoomTextStr << " | Rot:" << -mainImageRotation;
 
+                // Whether a preview or the real thing is on screen
+                if (mainImage.IsEmbeddedPreview() || mainImage.IsReducedResolution()) {
+                    zoomTextStr << (mainImage.IsEmbeddedPreview() ? " | Embedded preview" : " | Reduced");
+
+                    if (imagePrefetcher->IsDecodingFullResolution())
+                        zoomTextStr << " (decoding full)";
+                } else if (IsRawImageFile(mainImageCurrentFilePath) && !mainImageFailedToLoad) {
+                    zoomTextStr << " | Full RAW";
+                }
+
                 // Selected pixel (takes into account rotation of the image)
                 glm::ivec2 tempImageSize = mainImage.GetSize();
                 glm::ivec2 tempMousePosition = mousePosition;
@@ -939,10 +1097,12 @@ namespace Dooky {
                 ).result();
 
                 if (!saveFileLocation.empty()) {
-                    bool successful = mainImage.WriteToFile(saveFileLocation);
+                    ImageWriteResult result = mainImage.WriteToFile(saveFileLocation);
 
-                    if (!successful) {
+                    if (result == ImageWriteResult::SavedAsJPEG) {
                         pfd::message("Saved file as a JPEG", "File type is not supported. Saved as a JPEG instead.", pfd::choice::ok, pfd::icon::warning);
+                    } else if (result == ImageWriteResult::Failed) {
+                        pfd::message("Failed to save file", "The image couldn't be saved. The original file may have been moved or deleted since it was opened.", pfd::choice::ok, pfd::icon::error);
                     }
                 }
             }
@@ -970,5 +1130,11 @@ namespace Dooky {
             hotkeyShouldOpenDirectory = false;
             hotkeyShouldOpenSubdirectories = false;
 		}
+
+        mainImage.textureCache = nullptr;
+        delete textureCache;
+        delete imagePrefetcher;
+        delete imageCache;
+        delete imageLoader;
 	}
 }
\ No newline at end of file
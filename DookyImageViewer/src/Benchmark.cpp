@@ -0,0 +1,278 @@
+#include "Benchmark.h"
+
+#include <vector>
+#include <chrono>
+#include <stdio.h>
+#include <map>
+#include <algorithm>
+#include <functional>
+
+#include <Magick++.h>
+
+#include "ImageDecoder.h"
+#include "PixelConversion.h"
+#include "TiffTileSource.h"
+#include "ThreadPool.h"
+
+int BENCHMARK_RUNS = 3; // Best of
+int BENCHMARK_TARGET_WIDTH = 1920; // What the reduced resolution decode has to fill
+int BENCHMARK_TARGET_HEIGHT = 1080;
+int BENCHMARK_CONVERSION_WIDTH = 6000; // 24 megapixels, like a camera JPEG
+int BENCHMARK_CONVERSION_HEIGHT = 4000;
+
+// Returns the fastest time in milliseconds, or a negative number if it failed
+double TimeDecode(const std::filesystem::path& path, std::function<bool(const std::filesystem::path&, Dooky::DecodedImage&)> decode) {
+	double best = -1.0;
+
+	for (int i = 0; i < BENCHMARK_RUNS; i++) {
+		Dooky::DecodedImage decoded;
+
+		auto start = std::chrono::steady_clock::now();
+		bool success = decode(path, decoded);
+		double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		if (!success)
+			return -1.0;
+
+		if (best < 0.0 || elapsed < best)
+			best = elapsed;
+	}
+
+	return best;
+}
+
+namespace Dooky {
+	void RunDecoderBenchmark(const std::filesystem::path& corpus) {
+		std::vector<std::filesystem::path> paths;
+		std::error_code error;
+
+		for (const auto& entry : std::filesystem::directory_iterator(corpus, error)) {
+			if (entry.is_regular_file())
+				paths.push_back(entry.path());
+		}
+
+		if (error) {
+			printf("ERROR: Could not read benchmark folder: %s\n", error.message().c_str());
+			return;
+		}
+
+		std::sort(paths.begin(), paths.end());
+
+		auto DecodeNative = [](const std::filesystem::path& path, DecodedImage& decoded) {
+			return DecodeImageFileNative(path, decoded);
+		};
+
+		auto DecodeNativeReduced = [](const std::filesystem::path& path, DecodedImage& decoded) {
+			DecodeOptions options;
+			options.targetWidth = BENCHMARK_TARGET_WIDTH;
+			options.targetHeight = BENCHMARK_TARGET_HEIGHT;
+			options.allowEmbeddedPreview = true;
+
+			return DecodeImageFileNative(path, decoded, nullptr, options);
+		};
+
+		auto DecodeMagick = [](const std::filesystem::path& path, DecodedImage& decoded) {
+			return DecodeImageFileMagick(path, decoded);
+		};
+
+		double nativeTotal = 0.0;
+		double reducedTotal = 0.0;
+		double magickTotal = 0.0;
+		int compared = 0;
+
+		printf("%-40s %12s %12s %12s %8s\n", "File", "Native (ms)", "Reduced (ms)", "Magick (ms)", "Speedup");
+
+		for (const std::filesystem::path& path : paths) {
+			double nativeTime = TimeDecode(path, DecodeNative);
+			double reducedTime = TimeDecode(path, DecodeNativeReduced);
+			double magickTime = TimeDecode(path, DecodeMagick);
+
+			std::string name = path.filename().string();
+
+			if (magickTime < 0.0) // Not an image at all
+				continue;
+
+			if (nativeTime < 0.0) {
+				printf("%-40s %12s %12s %12.2f %8s\n", name.c_str(), "-", "-", magickTime, "-");
+				continue;
+			}
+
+			printf("%-40s %12.2f %12.2f %12.2f %7.2fx\n", name.c_str(), nativeTime, reducedTime, magickTime, magickTime / nativeTime);
+
+			nativeTotal += nativeTime;
+			reducedTotal += reducedTime;
+			magickTotal += magickTime;
+			compared++;
+		}
+
+		if (compared > 0)
+			printf("\nTotal over %d images both paths can decode: native %.2f ms, reduced to %dx%d %.2f ms, magick %.2f ms (%.2fx)\n", compared, nativeTotal, BENCHMARK_TARGET_WIDTH, BENCHMARK_TARGET_HEIGHT, reducedTotal, magickTotal, magickTotal / nativeTotal);
+	}
+
+	void RunConversionBenchmark() {
+		size_t width = BENCHMARK_CONVERSION_WIDTH;
+		size_t height = BENCHMARK_CONVERSION_HEIGHT;
+		size_t pixelCount = width * height;
+
+		// Noise so nothing can take shortcuts
+		std::vector<unsigned char> source(pixelCount * 3);
+		unsigned int seed = 12345;
+
+		for (unsigned char& value : source) {
+			seed = seed * 1103515245 + 12345;
+			value = (seed >> 16) & 0xFF;
+		}
+
+		auto Time = [](std::function<void()> function) {
+			double best = -1.0;
+
+			for (int i = 0; i < BENCHMARK_RUNS; i++) {
+				auto start = std::chrono::steady_clock::now();
+				function();
+				double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+				if (best < 0.0 || elapsed < best)
+					best = elapsed;
+			}
+
+			return best;
+		};
+
+		std::vector<float> result;
+
+		// 8 bit RGB to float RGBA, what stb_image hands over for most JPEGs
+		double scalarTime = Time([&]() {
+			result.resize(pixelCount * 4);
+
+			for (size_t i = 0; i < pixelCount; i++) {
+				result[i * 4 + 0] = source[i * 3 + 0] / 255.0f;
+				result[i * 4 + 1] = source[i * 3 + 1] / 255.0f;
+				result[i * 4 + 2] = source[i * 3 + 2] / 255.0f;
+				result[i * 4 + 3] = 1.0f;
+			}
+		});
+
+		double kernelTime = Time([&]() {
+			result.resize(pixelCount * 4);
+			ConvertPixels(source.data(), PixelLayout::RGB, (unsigned char*)result.data(), PixelFormat::RGBA32F, pixelCount);
+		});
+
+		// What actually gets kept now, a quarter of the memory and upload bandwidth
+		std::vector<unsigned char> native;
+
+		double nativeTime = Time([&]() {
+			native.resize(pixelCount * 4);
+			ConvertPixels(source.data(), PixelLayout::RGB, native.data(), PixelFormat::RGBA8, pixelCount);
+		});
+
+		printf("%zux%zu RGB8 to RGBA32F\n", width, height);
+		printf("  Scalar loop:        %10.2f ms\n", scalarTime);
+		printf("  Conversion kernels: %10.2f ms (%.2fx)\n", kernelTime, scalarTime / kernelTime);
+		printf("  Kernels to RGBA8:   %10.2f ms (%.2fx)\n\n", nativeTime, scalarTime / nativeTime);
+
+		// The same pixels coming out of ImageMagick
+		try {
+			Magick::Image image;
+			image.read(width, height, "RGB", Magick::CharPixel, source.data());
+
+			double oldTime = Time([&]() {
+				Magick::Image copy = image; // type() would change the image for the next run otherwise
+				copy.type(Magick::TrueColorAlphaType);
+
+				float* data = copy.getPixels(0, 0, width, height);
+				result.assign(data, data + pixelCount * 4);
+
+				for (float& f : result) f /= 65535;
+			});
+
+			std::vector<unsigned char> exported;
+
+			double newTime = Time([&]() {
+				ExportMagickPixels(image, PixelFormat::RGBA32F, exported);
+			});
+
+			printf("%zux%zu ImageMagick image to RGBA32F\n", width, height);
+			printf("  type() + getPixels() + assign + divide: %10.2f ms\n", oldTime);
+			printf("  ExportMagickPixels:                     %10.2f ms (%.2fx)\n", newTime, oldTime / newTime);
+		} catch (std::exception& exception) {
+			printf("ERROR: ImageMagick part of the benchmark failed: %s\n", exception.what());
+		}
+	}
+
+	void RunChunkedDecodeBenchmark(const std::filesystem::path& corpus) {
+		std::vector<std::filesystem::path> paths;
+		std::error_code error;
+
+		for (const auto& entry : std::filesystem::directory_iterator(corpus, error)) {
+			if (entry.is_regular_file())
+				paths.push_back(entry.path());
+		}
+
+		if (error) {
+			printf("ERROR: Could not read benchmark folder: %s\n", error.message().c_str());
+			return;
+		}
+
+		std::sort(paths.begin(), paths.end());
+
+		auto GetCompressionName = [](int compression) -> std::string {
+			switch (compression) {
+			case 1: return "None";
+			case 5: return "LZW";
+			case 7: return "JPEG";
+			case 8: case 32946: return "Deflate";
+			case 32773: return "PackBits";
+			}
+
+			return "Unknown";
+		};
+
+		struct Totals {
+			double singleTime = 0.0;
+			double multiTime = 0.0;
+			int count = 0;
+		};
+
+		std::map<std::string, Totals> totals;
+
+		printf("Using %d threads\n", GetSharedThreadPool().GetThreadCount() + 1);
+		printf("%-40s %-10s %8s %14s %14s %8s\n", "File", "Format", "Chunks", "1 core (ms)", "All (ms)", "Speedup");
+
+		for (const std::filesystem::path& path : paths) {
+			TiffTileSource source;
+
+			if (!source.Open(path))
+				continue;
+
+			auto DecodeWith = [&](bool multithreaded) {
+				return [&source, multithreaded](const std::filesystem::path&, DecodedImage& decoded) {
+					return source.ReadImage(decoded.data, nullptr, multithreaded);
+				};
+			};
+
+			double singleTime = TimeDecode(path, DecodeWith(false));
+			double multiTime = TimeDecode(path, DecodeWith(true));
+
+			std::string name = path.filename().string();
+			std::string format = GetCompressionName(source.GetCompression());
+
+			if (singleTime < 0.0 || multiTime < 0.0) {
+				printf("%-40s %-10s %8d %14s %14s %8s\n", name.c_str(), format.c_str(), source.GetChunkCount(), "-", "-", "-");
+				continue;
+			}
+
+			printf("%-40s %-10s %8d %14.2f %14.2f %7.2fx\n", name.c_str(), format.c_str(), source.GetChunkCount(), singleTime, multiTime, singleTime / multiTime);
+
+			Totals& total = totals[format];
+			total.singleTime += singleTime;
+			total.multiTime += multiTime;
+			total.count++;
+		}
+
+		printf("\n");
+
+		for (const auto& [format, total] : totals) {
+			printf("%-10s over %3d images: 1 core %.2f ms, all cores %.2f ms (%.2fx)\n", format.c_str(), total.count, total.singleTime, total.multiTime, total.singleTime / total.multiTime);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <filesystem>
+
+namespace Dooky {
+	// Run with: DookyImageViewer.exe --benchmark-decoders <folder>
+	// Decodes every image in the folder with both decoder paths and prints how long each took
+	void RunDecoderBenchmark(const std::filesystem::path& corpus);
+
+	// Run with: DookyImageViewer.exe --benchmark-conversion
+	// Compares the old way of getting pixels out of ImageMagick (convert to RGBA, copy, divide) against ExportMagickPixels on a synthetic image
+	void RunConversionBenchmark();
+
+	// Run with: DookyImageViewer.exe --benchmark-chunked <folder>
+	// Decodes every TIFF in the folder a tile or strip at a time on one core and then on all of them, grouped by compression
+	void RunChunkedDecodeBenchmark(const std::filesystem::path& corpus);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,400 @@
+#include "BlockCompression.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "ThreadPool.h"
+
+size_t BLOCK_COMPRESSION_CHUNK_SIZE = 1024; // Blocks, anything smaller isn't worth sending to another thread
+
+namespace Dooky {
+	// BC7 interpolation weights for 4 bit indices, out of 64
+	const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// Writes bits from the lowest one up, the way BC7 blocks are laid out
+	struct BitWriter {
+		unsigned char* data;
+		int position;
+
+		void Write(uint32_t value, int bits) {
+			for (int i = 0; i < bits; i++) {
+				if ((value >> i) & 1)
+					data[position / 8] |= 1 << (position % 8);
+
+				position++;
+			}
+		}
+	};
+
+	// The two ends of the line through the block's colours that they're spread out along the most, alpha is left out with 3 channels
+	void FindEndpoints(const unsigned char* block, int channels, float* low, float* high) {
+		float mean[4] = {};
+
+		for (int i = 0; i < 16; i++) {
+			for (int c = 0; c < channels; c++) {
+				mean[c] += block[i * 4 + c] / 16.0f;
+			}
+		}
+
+		float covariance[4][4] = {};
+
+		for (int i = 0; i < 16; i++) {
+			float d[4] = {};
+
+			for (int c = 0; c < channels; c++) {
+				d[c] = block[i * 4 + c] - mean[c];
+			}
+
+			for (int a = 0; a < channels; a++) {
+				for (int b = 0; b < channels; b++) {
+					covariance[a][b] += d[a] * d[b];
+				}
+			}
+		}
+
+		// Power iteration for the principal axis, a handful of steps is plenty for 16 pixels
+		float axis[4] = { 1.0f, 1.0f, 1.0f, channels == 4 ? 1.0f : 0.0f };
+
+		for (int iteration = 0; iteration < 8; iteration++) {
+			float next[4] = {};
+			float largest = 0.0f;
+
+			for (int a = 0; a < channels; a++) {
+				for (int b = 0; b < channels; b++) {
+					next[a] += covariance[a][b] * axis[b];
+				}
+
+				largest = std::max(largest, std::fabs(next[a]));
+			}
+
+			if (largest == 0.0f)
+				break;
+
+			for (int c = 0; c < channels; c++) {
+				axis[c] = next[c] / largest;
+			}
+		}
+
+		float lengthSquared = 0.0f;
+
+		for (int c = 0; c < channels; c++) {
+			lengthSquared += axis[c] * axis[c];
+		}
+
+		float minimum = 0.0f;
+		float maximum = 0.0f;
+
+		for (int i = 0; i < 16 && lengthSquared > 0.0f; i++) {
+			float t = 0.0f;
+
+			for (int c = 0; c < channels; c++) {
+				t += (block[i * 4 + c] - mean[c]) * axis[c];
+			}
+
+			minimum = std::min(minimum, t);
+			maximum = std::max(maximum, t);
+		}
+
+		for (int c = 0; c < 4; c++) {
+			float direction = lengthSquared > 0.0f ? axis[c] / lengthSquared : 0.0f;
+
+			low[c] = std::clamp(mean[c] + direction * minimum, 0.0f, 255.0f);
+			high[c] = std::clamp(mean[c] + direction * maximum, 0.0f, 255.0f);
+		}
+	}
+
+	// Index of whichever palette colour is closest
+	int FindClosest(const unsigned char* pixel, const int (*palette)[4], int paletteSize, int channels) {
+		int best = 0;
+		int bestError = INT32_MAX;
+
+		for (int i = 0; i < paletteSize; i++) {
+			int error = 0;
+
+			for (int c = 0; c < channels; c++) {
+				int d = pixel[c] - palette[i][c];
+				error += d * d;
+			}
+
+			if (error < bestError) {
+				best = i;
+				bestError = error;
+			}
+		}
+
+		return best;
+	}
+
+	uint16_t ToRGB565(const float* colour) {
+		int r = (int)std::lround(colour[0] * 31.0f / 255.0f);
+		int g = (int)std::lround(colour[1] * 63.0f / 255.0f);
+		int b = (int)std::lround(colour[2] * 31.0f / 255.0f);
+
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	void FromRGB565(uint16_t value, int* colour) {
+		int r = value >> 11;
+		int g = (value >> 5) & 63;
+		int b = value & 31;
+
+		colour[0] = (r << 3) | (r >> 2);
+		colour[1] = (g << 2) | (g >> 4);
+		colour[2] = (b << 3) | (b >> 2);
+		colour[3] = 255;
+	}
+
+	void CompressBC1Block(const unsigned char* block, unsigned char* destination) {
+		float low[4];
+		float high[4];
+		FindEndpoints(block, 3, low, high);
+
+		// The first endpoint has to be the bigger one for four colours, otherwise the last one is transparent black
+		uint16_t colour0 = ToRGB565(high);
+		uint16_t colour1 = ToRGB565(low);
+
+		if (colour0 < colour1)
+			std::swap(colour0, colour1);
+
+		int palette[4][4];
+		FromRGB565(colour0, palette[0]);
+		FromRGB565(colour1, palette[1]);
+
+		for (int c = 0; c < 4; c++) {
+			palette[2][c] = (palette[0][c] * 2 + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + palette[1][c] * 2) / 3;
+		}
+
+		uint32_t indices = 0;
+
+		if (colour0 != colour1) {
+			for (int i = 0; i < 16; i++) {
+				indices |= (uint32_t)FindClosest(block + i * 4, palette, 4, 3) << (i * 2);
+			}
+		}
+
+		destination[0] = colour0 & 0xFF;
+		destination[1] = colour0 >> 8;
+		destination[2] = colour1 & 0xFF;
+		destination[3] = colour1 >> 8;
+		memcpy(destination + 4, &indices, 4); // Little endian, same as every GPU
+	}
+
+	// Mode 6 only, one pair of 7 bit RGBA endpoints with a p-bit each and 4 bit indices. Good for smooth photos and alpha, which is most
+	// of what gets looked at, without having to search the partitions the other modes need
+	void CompressBC7Block(const unsigned char* block, unsigned char* destination) {
+		float endpoints[2][4];
+		FindEndpoints(block, 4, endpoints[0], endpoints[1]);
+
+		// The p-bit becomes the lowest bit of every channel, whichever one gets closer is used
+		int quantised[2][4];
+		int pBits[2];
+
+		for (int e = 0; e < 2; e++) {
+			float bestError = 0.0f;
+
+			for (int p = 0; p < 2; p++) {
+				int q[4];
+				float error = 0.0f;
+
+				for (int c = 0; c < 4; c++) {
+					q[c] = std::clamp((int)std::lround((endpoints[e][c] - p) / 2.0f), 0, 127);
+
+					float d = (q[c] * 2 + p) - endpoints[e][c];
+					error += d * d;
+				}
+
+				if (p == 0 || error < bestError) {
+					bestError = error;
+					pBits[e] = p;
+					memcpy(quantised[e], q, sizeof(q));
+				}
+			}
+		}
+
+		int palette[16][4];
+
+		for (int i = 0; i < 16; i++) {
+			for (int c = 0; c < 4; c++) {
+				int colour0 = quantised[0][c] * 2 + pBits[0];
+				int colour1 = quantised[1][c] * 2 + pBits[1];
+
+				palette[i][c] = ((64 - BC7_WEIGHTS[i]) * colour0 + BC7_WEIGHTS[i] * colour1 + 32) >> 6;
+			}
+		}
+
+		int indices[16];
+
+		for (int i = 0; i < 16; i++) {
+			indices[i] = FindClosest(block + i * 4, palette, 16, 4);
+		}
+
+		// The first index only gets 3 bits, so its top bit has to be 0. Swapping the endpoints flips every index
+		if (indices[0] & 8) {
+			std::swap(quantised[0], quantised[1]);
+			std::swap(pBits[0], pBits[1]);
+
+			for (int& index : indices) {
+				index = 15 - index;
+			}
+		}
+
+		memset(destination, 0, 16);
+		BitWriter writer = { destination, 0 };
+
+		writer.Write(1 << 6, 7); // Mode 6 is six 0 bits and a 1
+
+		for (int c = 0; c < 4; c++) {
+			writer.Write(quantised[0][c], 7);
+			writer.Write(quantised[1][c], 7);
+		}
+
+		writer.Write(pBits[0], 1);
+		writer.Write(pBits[1], 1);
+		writer.Write(indices[0], 3);
+
+		for (int i = 1; i < 16; i++) {
+			writer.Write(indices[i], 4);
+		}
+	}
+
+	size_t GetBlockCompressedSize(BlockFormat format, int width, int height) {
+		size_t blockSize = format == BlockFormat::BC1 ? 8 : 16;
+
+		return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+	}
+
+	void CompressBlocks(const unsigned char* pixels, int width, int height, BlockFormat format, unsigned char* blocks) {
+		int blocksWide = (width + 3) / 4;
+		int blocksHigh = (height + 3) / 4;
+		size_t blockSize = format == BlockFormat::BC1 ? 8 : 16;
+		size_t chunkRows = std::max(BLOCK_COMPRESSION_CHUNK_SIZE / blocksWide, (size_t)1);
+
+		GetSharedThreadPool().ParallelFor(blocksHigh, chunkRows, [&](size_t begin, size_t end) {
+			unsigned char block[16 * 4];
+
+			for (size_t by = begin; by < end; by++) {
+				for (int bx = 0; bx < blocksWide; bx++) {
+					for (int y = 0; y < 4; y++) {
+						int sourceY = std::min((int)by * 4 + y, height - 1);
+
+						for (int x = 0; x < 4; x++) {
+							int sourceX = std::min(bx * 4 + x, width - 1);
+							memcpy(block + (y * 4 + x) * 4, pixels + ((size_t)sourceY * width + sourceX) * 4, 4);
+						}
+					}
+
+					unsigned char* destination = blocks + (by * blocksWide + bx) * blockSize;
+
+					if (format == BlockFormat::BC1) {
+						CompressBC1Block(block, destination);
+					} else {
+						CompressBC7Block(block, destination);
+					}
+				}
+			}
+		});
+	}
+
+	void DecompressBC1Block(const unsigned char* source, unsigned char* block) {
+		uint16_t colour0 = source[0] | (source[1] << 8);
+		uint16_t colour1 = source[2] | (source[3] << 8);
+		uint32_t indices;
+		memcpy(&indices, source + 4, 4);
+
+		int palette[4][4];
+		FromRGB565(colour0, palette[0]);
+		FromRGB565(colour1, palette[1]);
+
+		// Three colours and transparent black when the first endpoint isn't the bigger one
+		for (int c = 0; c < 4; c++) {
+			if (colour0 > colour1) {
+				palette[2][c] = (palette[0][c] * 2 + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + palette[1][c] * 2) / 3;
+			} else {
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+
+		for (int i = 0; i < 16; i++) {
+			int index = (indices >> (i * 2)) & 3;
+
+			for (int c = 0; c < 4; c++) {
+				block[i * 4 + c] = (unsigned char)palette[index][c];
+			}
+		}
+	}
+
+	bool DecompressBC7Block(const unsigned char* source, unsigned char* block) {
+		if ((source[0] & 0x7F) != 1 << 6)
+			return false;
+
+		int position = 7;
+
+		auto read = [&](int bits) {
+			int value = 0;
+
+			for (int i = 0; i < bits; i++, position++) {
+				value |= ((source[position / 8] >> (position % 8)) & 1) << i;
+			}
+
+			return value;
+		};
+
+		int endpoints[2][4];
+
+		for (int c = 0; c < 4; c++) {
+			endpoints[0][c] = read(7) << 1;
+			endpoints[1][c] = read(7) << 1;
+		}
+
+		for (int e = 0; e < 2; e++) {
+			int pBit = read(1);
+
+			for (int c = 0; c < 4; c++) {
+				endpoints[e][c] |= pBit;
+			}
+		}
+
+		for (int i = 0; i < 16; i++) {
+			int weight = BC7_WEIGHTS[read(i == 0 ? 3 : 4)];
+
+			for (int c = 0; c < 4; c++) {
+				block[i * 4 + c] = (unsigned char)(((64 - weight) * endpoints[0][c] + weight * endpoints[1][c] + 32) >> 6);
+			}
+		}
+
+		return true;
+	}
+
+	bool DecompressBlocks(const unsigned char* blocks, int width, int height, BlockFormat format, unsigned char* pixels) {
+		int blocksWide = (width + 3) / 4;
+		int blocksHigh = (height + 3) / 4;
+		size_t blockSize = format == BlockFormat::BC1 ? 8 : 16;
+		unsigned char block[16 * 4];
+
+		for (int by = 0; by < blocksHigh; by++) {
+			for (int bx = 0; bx < blocksWide; bx++) {
+				const unsigned char* source = blocks + ((size_t)by * blocksWide + bx) * blockSize;
+
+				if (format == BlockFormat::BC1) {
+					DecompressBC1Block(source, block);
+				} else if (!DecompressBC7Block(source, block)) {
+					return false;
+				}
+
+				// Partial blocks at the edges only write what's inside the image
+				for (int y = 0; y < 4 && by * 4 + y < height; y++) {
+					for (int x = 0; x < 4 && bx * 4 + x < width; x++) {
+						memcpy(pixels + ((size_t)(by * 4 + y) * width + bx * 4 + x) * 4, block + (y * 4 + x) * 4, 4);
+					}
+				}
+			}
+		}
+
+		return true;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#ifndef BLOCKCOMPRESSION_H
+#define BLOCKCOMPRESSION_H
+
+#include <cstddef>
+
+namespace Dooky {
+	// Block compressed texture formats the GPU can sample from directly, every 4x4 block of pixels is stored in a fixed number of bytes
+	enum class BlockFormat {
+		BC1, // RGB in 8 bytes, no alpha (EXT_texture_compression_s3tc)
+		BC7 // RGBA in 16 bytes (ARB_texture_compression_bptc)
+	};
+
+	size_t GetBlockCompressedSize(BlockFormat format, int width, int height); // In bytes, partial blocks at the edges count as whole ones
+
+	// Compresses tightly packed RGBA8 rows, the last row and column get repeated to fill partial blocks
+	// Blocks are written a row at a time from the first row of pixels, big images get split up across the shared thread pool
+	void CompressBlocks(const unsigned char* pixels, int width, int height, BlockFormat format, unsigned char* blocks);
+
+	// The other way, back to RGBA8. Only the BC7 mode CompressBlocks writes (6) can be read, blocks in other modes make it fail
+	bool DecompressBlocks(const unsigned char* blocks, int width, int height, BlockFormat format, unsigned char* pixels);
+}
+
+#endif
\ No newline at end of file
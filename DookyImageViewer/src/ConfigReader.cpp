@@ -10,12 +10,18 @@ Config ReadConfigFile(const std::string& path) {
     // Defaults
     config.hideConsole = false;
     config.useMipmaps = false;
+    config.useLanczosMipmaps = false;
+    config.useThumbnailPacks = false;
+    config.imageCacheSize = 2048;
+    config.textureCacheSize = 512;
 
     // Create new default config if the file doesn't already exist
     if (!std::filesystem::exists(path)) {
         std::ofstream newConfig(path);
         newConfig << "hideconsole" << std::endl;
         newConfig << "usemipmaps" << std::endl;
+        newConfig << "imagecachesize " << config.imageCacheSize << std::endl;
+        newConfig << "texturecachesize " << config.textureCacheSize << std::endl;
         newConfig.close();
     }
 
@@ -29,6 +35,22 @@ Config ReadConfigFile(const std::string& path) {
                 config.hideConsole = true;
             } else if (line == "usemipmaps") {
                 config.useMipmaps = true;
+            } else if (line == "lanczosmipmaps") {
+                config.useLanczosMipmaps = true;
+            } else if (line == "thumbnailpacks") {
+                config.useThumbnailPacks = true;
+            } else if (line.rfind("imagecachesize ", 0) == 0) {
+                try {
+                    config.imageCacheSize = std::stoi(line.substr(15));
+                } catch (std::exception& exception) {
+                    printf("Invalid imagecachesize in 'imageviewerconfig.ini'\n");
+                }
+            } else if (line.rfind("texturecachesize ", 0) == 0) {
+                try {
+                    config.textureCacheSize = std::stoi(line.substr(17));
+                } catch (std::exception& exception) {
+                    printf("Invalid texturecachesize in 'imageviewerconfig.ini'\n");
+                }
             }
         }
     } else {
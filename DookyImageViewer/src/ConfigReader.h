@@ -7,6 +7,10 @@
 struct Config {
 	bool hideConsole;
 	bool useMipmaps;
+	bool useLanczosMipmaps; // Sharper mip levels, slower to build
+	bool useThumbnailPacks; // One file of thumbnails per directory, quicker than a file each for big directories
+	int imageCacheSize; // In megabytes
+	int textureCacheSize; // In megabytes, less if the GPU says it doesn't have that much free
 } typedef Config;
 
 Config ReadConfigFile(const std::string& path);
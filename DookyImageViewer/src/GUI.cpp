@@ -22,6 +22,7 @@ namespace Dooky {
 		wantsToSaveImageToFile = false;
 		wantsToOpenFileLocationInExplorer = false;
 		wantsToRefreshDirectory = false;
+		wantsToLoadFullQuality = false;
 
 		showThumbnails = true;
 		showInformationBar = true;
@@ -38,6 +39,7 @@ namespace Dooky {
 		showChannelsWindow = false;
 		showZebraPatternWindow = false;
 		showAdjustmentsWindow = false;
+		showCacheStatisticsWindow = false;
 
 		// Zebra pattern
 
@@ -108,6 +110,7 @@ namespace Dooky {
 		wantsToOpenSubdirectories = false;
 		wantsToOpenFileLocationInExplorer = false;
 		wantsToRefreshDirectory = false;
+		wantsToLoadFullQuality = false;
 
 		// GUI
 
@@ -147,6 +150,8 @@ namespace Dooky {
 					ImGui::Checkbox("Show Checkerboard", &adjustment_ShowAlphaCheckerboard);
 
 					if (ImGui::MenuItem("Image Information")) showImageInformationWindow = true;
+					if (ImGui::MenuItem("Cache Statistics")) showCacheStatisticsWindow = true;
+					if (ImGui::MenuItem("Load Full Quality", "F")) wantsToLoadFullQuality = true;
 
 					ImGui::EndMenu();
 				}
@@ -207,6 +212,17 @@ namespace Dooky {
 				}
 			}
 
+			// Cache Statistics
+			{
+				if (showCacheStatisticsWindow) {
+					ImGui::Begin("Cache Statistics", &showCacheStatisticsWindow);
+
+					ImGui::TextUnformatted(cacheStatisticsText.c_str()); // Not a format string, the hit rate ends in a %
+
+					ImGui::End();
+				}
+			}
+
 			// Tools
 			{
 				// Zebra pattern window
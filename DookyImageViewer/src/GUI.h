@@ -26,12 +26,14 @@ namespace Dooky {
 		bool showChannelsWindow;
 		bool showZebraPatternWindow;
 		bool showAdjustmentsWindow;
+		bool showCacheStatisticsWindow;
 	public:
 		ImVec4 menuBarExtraTextColor;
 
 		std::string menuBarText;
 		std::string imageInformationText;
 		std::string imageInformationExifText;
+		std::string cacheStatisticsText;
 
 		bool imguiCaptureMouse;
 		bool imguiCaptureKeyboard;
@@ -42,6 +44,7 @@ namespace Dooky {
 		bool wantsToSaveImageToFile;
 		bool wantsToOpenFileLocationInExplorer;
 		bool wantsToRefreshDirectory;
+		bool wantsToLoadFullQuality;
 
 		bool showThumbnails;
 		bool showInformationBar; // Bottom bar with zoom
@@ -2,26 +2,50 @@
 
 #include <iterator>
 #include <fstream>
-#include <unordered_set>
-#include <Windows.h>
 #include <chrono>
+#include <cstring>
+#include <algorithm>
 #include <Magick++.h>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "vendor/stb_image/stb_image.h"
-
 #include "StringUtils.h"
+#include "PixelConversion.h"
 
-std::unordered_set<std::string> TONEMAPPED_IMAGE_EXTENSIONS = {
-	".hdr", ".exr", ".cr2", ".crw", ".dcr",
-	".mrw", ".arw", ".nef", ".orf", ".raf",
-	".x3f"
-};
-
-Magick::Image* loadedMagickImage;
-bool loadedFirstMagickImage = false;
+int ANIMATION_BUFFER_SCREENS = 4; // How much a streamed animation decodes ahead, in window sized RGBA8 frames
+int ANIMATION_RESIDENT_SCREENS = 32; // Animations that fit in this many stay on the GPU after the first time through instead of being streamed forever
+int TILED_IMAGE_MIN_SIZE = 8192; // Images wider or taller than this (or the GPU's max texture size) get drawn in tiles, see TiledImage
+size_t IMAGE_MAX_DIRTY_RECTS = 64; // Separate changed areas uploaded on their own before it just uploads the whole image
 
 namespace Dooky {
+	void GetPixelFormatGL(PixelFormat format, GLint& internalFormat, GLenum& pixelDataFormat, GLenum& pixelDataType, GLint* swizzle) {
+		internalFormat = GL_RGBA8;
+		pixelDataFormat = GL_RGBA;
+		pixelDataType = GL_UNSIGNED_BYTE;
+
+		switch (format) {
+		case PixelFormat::R8:      internalFormat = GL_R8;      pixelDataFormat = GL_RED;  pixelDataType = GL_UNSIGNED_BYTE;  break;
+		case PixelFormat::RG8:     internalFormat = GL_RG8;     pixelDataFormat = GL_RG;   pixelDataType = GL_UNSIGNED_BYTE;  break;
+		case PixelFormat::RGBA8:   internalFormat = GL_RGBA8;   pixelDataFormat = GL_RGBA; pixelDataType = GL_UNSIGNED_BYTE;  break;
+		case PixelFormat::R16:     internalFormat = GL_R16;     pixelDataFormat = GL_RED;  pixelDataType = GL_UNSIGNED_SHORT; break;
+		case PixelFormat::RG16:    internalFormat = GL_RG16;    pixelDataFormat = GL_RG;   pixelDataType = GL_UNSIGNED_SHORT; break;
+		case PixelFormat::RGBA16:  internalFormat = GL_RGBA16;  pixelDataFormat = GL_RGBA; pixelDataType = GL_UNSIGNED_SHORT; break;
+		case PixelFormat::RGBA16F: internalFormat = GL_RGBA16F; pixelDataFormat = GL_RGBA; pixelDataType = GL_HALF_FLOAT;     break;
+		case PixelFormat::RGBA32F: internalFormat = GL_RGBA32F; pixelDataFormat = GL_RGBA; pixelDataType = GL_FLOAT;          break;
+		}
+
+		// Gray textures get expanded back out to RGBA when sampled so the shader doesn't have to know about them
+		GLint rgba[4] = { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA };
+		GLint gray[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+		GLint grayAlpha[4] = { GL_RED, GL_RED, GL_RED, GL_GREEN };
+
+		if (GetPixelFormatChannels(format) == 1) {
+			std::copy(gray, gray + 4, swizzle);
+		} else if (GetPixelFormatChannels(format) == 2) {
+			std::copy(grayAlpha, grayAlpha + 4, swizzle);
+		} else {
+			std::copy(rgba, rgba + 4, swizzle);
+		}
+	}
+
 	////////////////////////////////////////
 	///// CLASS: IMAGE
 	////////////////////////////////////////
@@ -33,8 +57,14 @@ namespace Dooky {
 		animatedImageHasPlayedYet = false;
 		animatedImageStartPlayTime = 0;
 		animatedImageIndex = 0;
+		animationStreamStarted = false;
+		animationStreamResident = false;
+		animationResidentBytes = 0;
+		animatedImageFrameEndTime = 0.0f;
 
+		pixelFormat = PixelFormat::RGBA8;
 		size = { 0, 0 };
+		textureSize = { 0, 0 };
 		position = { 0, 0 };
 		anchorPoint = { 0.0f, 0.0f };
 		scale = { 1.0f, 1.0f };
@@ -42,6 +72,8 @@ namespace Dooky {
 
 		useLinearInterpolation = true;
 		useMipmaps = true;
+		mipmapFilter = DownsampleFilter::Box;
+		textureCache = nullptr;
 		flipVertically = false;
 		flag_ImageWasChanged = false;
 
@@ -70,6 +102,7 @@ namespace Dooky {
 
 		// Generate texture in advance
 		glGenTextures(1, &textureId);
+		paletteTextureId = 0;
 
 		// Generate buffers in advance (it is static so no need to change ever again)
 		glGenVertexArrays(1, &vao);
@@ -89,6 +122,9 @@ namespace Dooky {
 
 	Image::~Image() {
 		glDeleteTextures(1, &textureId);
+		glDeleteTextures(1, &paletteTextureId);
+		glDeleteTextures(animatedImageTextures.size(), animatedImageTextures.data());
+		glDeleteTextures(animatedImagePaletteTextures.size(), animatedImagePaletteTextures.data());
 		glDeleteVertexArrays(1, &vao);
 		glDeleteBuffers(1, &vbo);
 	}
@@ -97,9 +133,21 @@ namespace Dooky {
 	///// PRIVATE
 	////////////////////////////////////////
 
-	void Image::Update(float* data, int w, int h) {
-		glBindTexture(GL_TEXTURE_2D, textureId);
+	glm::mat4 Image::GetProjection(Window& window) {
+		glm::ivec2 winSize = window.GetSize();
+		float winWidth = winSize.x;
+		float winHeight = winSize.y;
 
+		glm::mat4 projection = glm::ortho(0.0f, winWidth, 0.0f, winHeight);
+		projection = glm::translate(projection, { position.x, winHeight - position.y, 0.0f }); // Move to position
+		projection = glm::rotate(projection, glm::radians(rotation), { 0.0f, 0.0f, 1.0f }); // Rotate
+		projection = glm::translate(projection, { floorf(-size.x * scale.x * anchorPoint.x), floorf(size.y * scale.y * anchorPoint.y), 0.0f }); // Move down to correct pivot point
+		projection = glm::translate(projection, { 0.0f, -size.y * scale.y, 0.0f }); // Move down one last time
+
+		return projection;
+	}
+
+	void Image::SetTextureFilter() {
 		if (useLinearInterpolation) {
 			if (useMipmaps) {
 				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -112,46 +160,555 @@ namespace Dooky {
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 		}
+	}
+
+	void Image::ResetMainTexture() {
+		DiscardMainTexture();
+		glGenTextures(1, &textureId);
+	}
+
+	void Image::DiscardMainTexture() {
+		if (textureCache != nullptr && textureSource != nullptr) {
+			textureCache->Insert(textureSource, textureId, useMipmaps);
+		} else {
+			glDeleteTextures(1, &textureId);
+		}
+
+		textureId = 0;
+		textureSource.reset();
+	}
+
+	void Image::ContinueTextureUpload() {
+		bool finished = textureUpload->Continue();
+
+		if (!textureUpload->IsTextureTaken() && textureUpload->IsBaseLevelDone())
+			ShowUploadedTexture();
+
+		if (finished) {
+			textureUpload.reset();
+			textureSource = decodedImage; // All of it is in there now
+		}
+	}
+
+	void Image::ShowUploadedTexture() {
+		DiscardMainTexture();
+		textureId = textureUpload->TakeTexture();
+
+		glBindTexture(GL_TEXTURE_2D, textureId);
+		SetTextureFilter();
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		// Only now that the old image is gone, it might have been palette indices
+		glDeleteTextures(1, &paletteTextureId);
+		paletteTextureId = 0;
+	}
+
+	bool Image::TakeCachedTexture(std::shared_ptr<const DecodedImage> decoded) {
+		unsigned int texture;
+		bool compressed;
+
+		if (!textureCache->Take(decoded.get(), useMipmaps, texture, compressed))
+			return false;
+
+		DiscardMainTexture();
+		textureId = texture;
+		textureSource = compressed ? nullptr : decoded; // Compressed ones only get shown until the proper upload is done
+
+		glBindTexture(GL_TEXTURE_2D, textureId);
+		SetTextureFilter();
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glDeleteTextures(1, &paletteTextureId);
+		paletteTextureId = 0;
+
+		return true;
+	}
+
+	bool Image::FitsInTexture(const DecodedImage& decoded) {
+		GLint maxTextureSize = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+
+		return std::max(decoded.width, decoded.height) <= std::min(TILED_IMAGE_MIN_SIZE, (int)maxTextureSize);
+	}
+
+	void Image::UploadTexture(unsigned int texture, const unsigned char* data, PixelFormat format, int w, int h) {
+		glBindTexture(GL_TEXTURE_2D, texture);
+		SetTextureFilter();
+
+		// Upload the pixels as they are instead of making the driver convert them, the shader sees normalised floats either way
+		GLint internalFormat;
+		GLenum pixelDataFormat;
+		GLenum pixelDataType;
+		GLint swizzle[4];
+		GetPixelFormatGL(format, internalFormat, pixelDataFormat, pixelDataType, swizzle);
+
+		glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // Rows of 1 and 2 byte pixels aren't necessarily a multiple of 4 bytes long
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, pixelDataFormat, pixelDataType, data);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		// Nothing samples the other levels without mipmaps, so there's no point making the driver build them
+		if (useMipmaps)
+			glGenerateMipmap(GL_TEXTURE_2D);
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	void Image::UploadFrame(unsigned int texture, unsigned int& paletteTexture, const DecodedImageFrame& frame) {
+		if (frame.palette.empty()) {
+			UploadTexture(texture, frame.data.data(), PixelFormat::RGBA8, textureSize.x, textureSize.y);
+
+			glDeleteTextures(1, &paletteTexture);
+			paletteTexture = 0;
+
+			return;
+		}
+
+		// Indices can't be filtered or mipmapped, the shader looks up the colours and does its own filtering
+		GLint swizzle[4] = { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA };
+
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, textureSize.x, textureSize.y, 0, GL_RED, GL_UNSIGNED_BYTE, frame.data.data());
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, w, h, 0, GL_RGBA, GL_FLOAT, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		if (paletteTexture == 0)
+			glGenTextures(1, &paletteTexture);
+
+		glBindTexture(GL_TEXTURE_2D, paletteTexture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 256, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, frame.palette.data());
 
 		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	void Image::Update(const unsigned char* data, PixelFormat format, int w, int h) {
+		textureUpload.reset();
+		dirtyRects.clear();
+		mipLevels.clear();
+		ResetMainTexture();
+		UploadTexture(textureId, data, format, w, h);
+
+		glDeleteTextures(1, &paletteTextureId);
+		paletteTextureId = 0;
 
 		// Set stuff
-		size = { w, h };
+		pixelFormat = format;
+		textureSize = { w, h };
+	}
+
+	void Image::UploadAnimatedImageFrames(const DecodedImage& decoded) {
+		if (animatedImageTextures.size() != decoded.frames.size()) {
+			glDeleteTextures(animatedImageTextures.size(), animatedImageTextures.data());
+
+			animatedImageTextures.resize(decoded.frames.size());
+			glGenTextures(animatedImageTextures.size(), animatedImageTextures.data());
+		}
+
+		for (size_t i = 0; i < decoded.frames.size(); i++) {
+			UploadTexture(animatedImageTextures[i], decoded.frames[i].data.data(), decoded.format, decoded.width, decoded.height);
+		}
+
+		glDeleteTextures(animatedImagePaletteTextures.size(), animatedImagePaletteTextures.data());
+		animatedImagePaletteTextures.assign(decoded.frames.size(), 0);
+
+		// The main texture isn't drawn while animating, no point holding on to whatever was in it
+		ResetMainTexture();
+
+		pixelFormat = decoded.format;
+		textureSize = { decoded.width, decoded.height };
+	}
+
+	void Image::UploadDecodedImage(std::shared_ptr<const DecodedImage> decoded) {
+		tiledImage.reset();
+		textureUpload.reset();
+
+		if (!decoded->frames.empty()) {
+			UploadAnimatedImageFrames(*decoded);
+			return;
+		}
+
+		bool fitsInTexture = FitsInTexture(*decoded);
+
+		if (decoded->tileSource == nullptr && decoded->isAnimated) {
+			Update(decoded->data.data(), decoded->format, decoded->width, decoded->height);
+			return;
+		}
+
+		// Nothing to upload if the texture is already around, e.g when going back to the previous image
+		// A compressed texture from the cache is shown straight away and then replaced with the full precision one uploaded below
+		if (textureCache != nullptr && decoded != textureSource && CanCacheTexture(*decoded))
+			TakeCachedTexture(decoded);
+
+		if (decoded == textureSource) {
+			pixelFormat = decoded->format;
+			textureSize = { decoded->width, decoded->height };
+
+			return;
+		}
+
+		// Streamed in over the next few frames if it's too big to upload in one
+		if (decoded->tileSource == nullptr && fitsInTexture) {
+			textureUpload = std::make_unique<TextureUpload>(decoded, useMipmaps, mipmapFilter);
+
+			pixelFormat = decoded->format;
+			textureSize = { decoded->width, decoded->height };
+
+			ContinueTextureUpload();
+
+			return;
+		}
+
+		// Too big to upload in one go, only the tiles on screen get uploaded as they're needed
+		if (decoded->tileSource != nullptr) {
+			tiledImage = std::make_unique<TiledImage>(decoded->tileSource);
+		} else {
+			tiledImage = std::make_unique<TiledImage>(std::make_shared<DecodedTileSource>(decoded));
+		}
+
+		tiledImage->EnableLinearInterpolation(useLinearInterpolation);
+
+		ResetMainTexture();
+
+		glDeleteTextures(1, &paletteTextureId);
+		paletteTextureId = 0;
+
+		pixelFormat = decoded->format;
+		textureSize = { decoded->width, decoded->height };
+	}
+
+	void Image::ClearAnimatedImage() {
+		glDeleteTextures(animatedImageTextures.size(), animatedImageTextures.data());
+		glDeleteTextures(animatedImagePaletteTextures.size(), animatedImagePaletteTextures.data());
+
+		animationStream.reset();
+		animationStreamStarted = false;
+		animationStreamResident = false;
+		animationResidentBytes = 0;
+		streamedFrames.clear();
+
+		animatedImageTextures.clear();
+		animatedImagePaletteTextures.clear();
+		animatedImageFrameStarts.clear();
+		animatedImagesDelaysTotal = 0;
+		animatedImageHasPlayedYet = false;
+		animatedImageIndex = 0;
 	}
 
 	void Image::GenericCreate(int w, int h, glm::vec4 c) {
-		floatImageData.clear();
-		floatImageData.resize(w * h * 4, 0);
+		decodedImage.reset();
+		tiledImage.reset();
+		ClearAnimatedImage();
 
-		for (int x = 0; x < w; x++) {
-			for (int y = 0; y < h; y++) {
-				int i = y * w + x;
+		// Images made in memory are only ever plain colours so 8 bits is plenty
+		unsigned char pixel[4];
+		WritePixel(pixel, PixelFormat::RGBA8, &c[0]);
 
-				floatImageData[i * 4 + 0] = c.r;
-				floatImageData[i * 4 + 1] = c.g;
-				floatImageData[i * 4 + 2] = c.b;
-				floatImageData[i * 4 + 3] = c.a;
-			}
+		imageData.clear();
+		imageData.resize(w * h * 4, 0);
+
+		for (int i = 0; i < w * h; i++) {
+			memcpy(&imageData[i * 4], pixel, 4);
 		}
 
-		Update(floatImageData.data(), w, h);
+		size = { w, h };
+		Update(imageData.data(), PixelFormat::RGBA8, w, h);
 	}
 
 	void Image::GenericSetPixel(int x, int y, glm::vec4 c) {
-		int index = ((size.y - 1) - y) * size.x + x;
+		if (!PrepareForWriting())
+			return;
+
+		// Coordinates are in the full resolution of the image
+		x = x * textureSize.x / std::max(size.x, 1);
+		y = y * textureSize.y / std::max(size.y, 1);
+
+		int row = (textureSize.y - 1) - y;
+		int index = row * textureSize.x + x;
+		size_t pixelSize = GetPixelFormatSize(pixelFormat);
 		
-		if (index < 0 || index >= floatImageData.size() / 4)
+		if (x < 0 || x >= textureSize.x || index < 0 || index >= imageData.size() / pixelSize)
 			return;
 
-		floatImageData[index * 4 + 0] = c.r;
-		floatImageData[index * 4 + 1] = c.g;
-		floatImageData[index * 4 + 2] = c.b;
-		floatImageData[index * 4 + 3] = c.a;
+		WritePixel(&imageData[index * pixelSize], pixelFormat, &c[0]);
+		MarkDirty(x, row, 1, 1);
+	}
+
+	bool Image::PrepareForWriting() {
+		// Take our own copy of the pixels before writing to them as the decoded image is shared
+		if (decodedImage != nullptr && animatedImageFrameStarts.empty() && decodedImage->tileSource == nullptr) {
+			// The texture only already has these pixels in it if they were uploaded as one texture and that has finished
+			if (tiledImage != nullptr || textureUpload != nullptr)
+				flag_ImageWasChanged = true;
+
+			imageData = decodedImage->data;
+			decodedImage.reset();
+			textureSource.reset(); // The texture is about to stop matching it
+			tiledImage.reset();
+			textureUpload.reset();
+			mipLevels.clear();
+		}
+
+		return decodedImage == nullptr && imageData.size() == (size_t)textureSize.x * textureSize.y * GetPixelFormatSize(pixelFormat);
+	}
+
+	void Image::MarkDirty(int x, int row, int w, int h) {
+		if (flag_ImageWasChanged)
+			return; // All of it is getting uploaded anyway
+
+		glm::ivec4 rect = { x, row, w, h };
 
-		flag_ImageWasChanged = true; // Only update texture when drawn
+		// Merge with anything it touches, writing a pixel at a time then only grows one rect
+		for (size_t i = 0; i < dirtyRects.size(); i++) {
+			glm::ivec4 other = dirtyRects[i];
+
+			if (rect.x <= other.x + other.z && other.x <= rect.x + rect.z && rect.y <= other.y + other.w && other.y <= rect.y + rect.w) {
+				int x0 = std::min(rect.x, other.x);
+				int y0 = std::min(rect.y, other.y);
+				int x1 = std::max(rect.x + rect.z, other.x + other.z);
+				int y1 = std::max(rect.y + rect.w, other.y + other.w);
+
+				rect = { x0, y0, x1 - x0, y1 - y0 };
+				dirtyRects.erase(dirtyRects.begin() + i);
+				i = -1; // The bigger rect might touch ones it didn't before
+			}
+		}
+
+		dirtyRects.push_back(rect);
+
+		// Lots of small writes all over the place, not worth uploading separately
+		if (dirtyRects.size() > IMAGE_MAX_DIRTY_RECTS) {
+			dirtyRects.clear();
+			flag_ImageWasChanged = true;
+		}
+	}
+
+	void Image::UploadDirtyRects() {
+		size_t dirtyArea = 0;
+
+		for (const glm::ivec4& rect : dirtyRects) {
+			dirtyArea += (size_t)rect.z * rect.w;
+		}
+
+		// Most of the image changed, cheaper to upload all of it and let the driver make the mipmaps
+		if (dirtyArea * 2 > (size_t)textureSize.x * textureSize.y) {
+			Update(imageData.data(), pixelFormat, textureSize.x, textureSize.y);
+			return;
+		}
+
+		GLint internalFormat;
+		GLenum pixelDataFormat;
+		GLenum pixelDataType;
+		GLint swizzle[4];
+		GetPixelFormatGL(pixelFormat, internalFormat, pixelDataFormat, pixelDataType, swizzle);
+
+		size_t pixelSize = GetPixelFormatSize(pixelFormat);
+		int levelCount = 1;
+
+		while (useMipmaps && (textureSize.x >> levelCount) + (textureSize.y >> levelCount) > 0) {
+			levelCount++;
+		}
+
+		auto GetLevelSize = [&](int level) {
+			return glm::ivec2(std::max(textureSize.x >> level, 1), std::max(textureSize.y >> level, 1));
+		};
+
+		auto GetLevelPixels = [&](int level) {
+			return level == 0 ? imageData.data() : mipLevels[level - 1].data();
+		};
+
+		// Filters part of a level from the one above it, sizes round down like OpenGL's do
+		auto FilterRegion = [&](int level, int x0, int y0, int x1, int y1) {
+			glm::ivec2 levelSize = GetLevelSize(level);
+			glm::ivec2 previousSize = GetLevelSize(level - 1);
+			const unsigned char* previous = GetLevelPixels(level - 1);
+			unsigned char* destination = mipLevels[level - 1].data();
+
+			// Lanczos reaches 6 pixels past the box filter's 2, kept even so the pixels still line up
+			int margin = mipmapFilter == DownsampleFilter::Lanczos ? 6 : 0;
+			int sourceX0 = std::max(x0 * 2 - margin, 0);
+			int sourceY0 = std::max(y0 * 2 - margin, 0);
+			int sourceWidth = std::min(x1 * 2 + margin, previousSize.x) - sourceX0;
+			int sourceHeight = std::min(y1 * 2 + margin, previousSize.y) - sourceY0;
+			int filteredWidth = (sourceWidth + 1) / 2;
+			int filteredX0 = x0 - sourceX0 / 2;
+			int filteredY0 = y0 - sourceY0 / 2;
+
+			std::vector<unsigned char> source((size_t)sourceWidth * sourceHeight * pixelSize);
+			std::vector<unsigned char> filtered((size_t)filteredWidth * ((sourceHeight + 1) / 2) * pixelSize);
+
+			for (int row = 0; row < sourceHeight; row++) {
+				memcpy(&source[(size_t)row * sourceWidth * pixelSize], previous + ((size_t)(sourceY0 + row) * previousSize.x + sourceX0) * pixelSize, sourceWidth * pixelSize);
+			}
+
+			DownsamplePixels(source.data(), sourceWidth, sourceHeight, pixelFormat, filtered.data(), mipmapFilter);
+
+			for (int row = y0; row < y1; row++) {
+				memcpy(destination + ((size_t)row * levelSize.x + x0) * pixelSize, &filtered[((size_t)(row - y0 + filteredY0) * filteredWidth + filteredX0) * pixelSize], (x1 - x0) * pixelSize);
+			}
+		};
+
+		// The first time, every level gets built so that from then on only the changed parts need filtering
+		if (mipLevels.size() != levelCount - 1) {
+			mipLevels.resize(levelCount - 1);
+
+			for (int level = 1; level < levelCount; level++) {
+				glm::ivec2 levelSize = GetLevelSize(level);
+				mipLevels[level - 1].resize((size_t)levelSize.x * levelSize.y * pixelSize);
+			}
+
+			for (int level = 1; level < levelCount; level++) {
+				FilterRegion(level, 0, 0, GetLevelSize(level).x, GetLevelSize(level).y);
+			}
+		}
+
+		glBindTexture(GL_TEXTURE_2D, textureId);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		int reach = mipmapFilter == DownsampleFilter::Lanczos ? 3 : 0; // Extra pixels each level a change spreads to
+
+		for (const glm::ivec4& rect : dirtyRects) {
+			int x0 = rect.x;
+			int y0 = rect.y;
+			int x1 = rect.x + rect.z;
+			int y1 = rect.y + rect.w;
+
+			for (int level = 0; level < levelCount; level++) {
+				glm::ivec2 levelSize = GetLevelSize(level);
+
+				if (level > 0) {
+					x0 = std::max(x0 / 2 - reach, 0);
+					y0 = std::max(y0 / 2 - reach, 0);
+					x1 = std::min((x1 + 1) / 2 + reach, levelSize.x);
+					y1 = std::min((y1 + 1) / 2 + reach, levelSize.y);
+
+					if (x0 >= x1 || y0 >= y1)
+						break; // Only in the odd column or row that got rounded off
+
+					FilterRegion(level, x0, y0, x1, y1);
+				}
+
+				glPixelStorei(GL_UNPACK_ROW_LENGTH, levelSize.x);
+				glPixelStorei(GL_UNPACK_SKIP_PIXELS, x0);
+				glPixelStorei(GL_UNPACK_SKIP_ROWS, y0);
+				glTexSubImage2D(GL_TEXTURE_2D, level, x0, y0, x1 - x0, y1 - y0, pixelDataFormat, pixelDataType, GetLevelPixels(level));
+			}
+		}
+
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		dirtyRects.clear();
+	}
+
+	void Image::UpdateAnimationStream(Window& window) {
+		glm::ivec2 windowSize = window.GetSize();
+		size_t screenBytes = (size_t)std::max(windowSize.x, 1) * std::max(windowSize.y, 1) * 4;
+		float time = window.GetTime();
+
+		if (!animationStreamStarted) {
+			animationStream = std::make_unique<AnimationStream>(decodedImage->path, screenBytes * ANIMATION_BUFFER_SCREENS);
+			animationStreamStarted = true;
+			animationStreamResident = true;
+			animatedImageFrameEndTime = time;
+		}
+
+		if (time < animatedImageFrameEndTime)
+			return;
+
+		DecodedImageFrame frame;
+		int index = 0;
+
+		if (!animationStream->PopFrame(frame, index)) {
+			if (animationStream->HasFailed()) { // Leave whatever was shown last on screen
+				std::cout << "ERROR: Failed to decode animation: " << decodedImage->path.string() << std::endl;
+				animationStream.reset();
+			}
+
+			return; // Otherwise decoding is behind, the current frame stays up a bit longer
+		}
+
+		// Don't rush through frames to catch up if decoding fell behind
+		if (time - animatedImageFrameEndTime > 0.25f)
+			animatedImageFrameEndTime = time;
+
+		animatedImageFrameEndTime += frame.delay / 100.0f;
+		animatedImageIndex = index;
+
+		if (index == animatedImageFrameStarts.size()) { // First time through
+			animatedImageFrameStarts.push_back(animatedImagesDelaysTotal);
+			animatedImagesDelaysTotal += std::max(frame.delay, 0);
+			animatedImageFPS = animatedImagesDelaysTotal > 0 ? (float)(animatedImageFrameStarts.size() * 100) / animatedImagesDelaysTotal : 0.0f;
+		}
+
+		// Palette indexed frames are a quarter of the size so four times as many fit
+		size_t frameBytes = frame.data.size() + frame.palette.size();
+
+		if (animationStreamResident && index == animatedImageTextures.size() && animationResidentBytes + frameBytes > screenBytes * ANIMATION_RESIDENT_SCREENS) {
+			// Too long to keep around, only the current frame is from now on
+			glDeleteTextures(animatedImageTextures.size(), animatedImageTextures.data());
+			glDeleteTextures(animatedImagePaletteTextures.size(), animatedImagePaletteTextures.data());
+			animatedImageTextures.clear();
+			animatedImagePaletteTextures.clear();
+			streamedFrames.clear();
+			animationStreamResident = false;
+		}
+
+		if (animationStreamResident) {
+			if (index == animatedImageTextures.size()) { // Otherwise it's already there from the first time through
+				unsigned int texture = 0;
+				unsigned int paletteTexture = 0;
+				glGenTextures(1, &texture);
+
+				UploadFrame(texture, paletteTexture, frame);
+
+				animatedImageTextures.push_back(texture);
+				animatedImagePaletteTextures.push_back(paletteTexture);
+				animationResidentBytes += frameBytes;
+				streamedFrames.push_back(std::move(frame));
+			}
+		} else {
+			UploadFrame(textureId, paletteTextureId, frame);
+
+			streamedFrames.clear();
+			streamedFrames.push_back(std::move(frame));
+		}
+
+		// Everything fit, play it from the GPU from now on like any other animation
+		if (animationStreamResident && animationStream->GetFrameCount() == animatedImageTextures.size()) {
+			animationStream.reset();
+			animatedImageHasPlayedYet = true;
+			animatedImageStartPlayTime = time - animatedImageFrameStarts[animatedImageIndex] / 100.0f;
+		}
+	}
+
+	const std::vector<unsigned char>& Image::GetCurrentPixelData() {
+		if (const DecodedImageFrame* frame = GetCurrentStreamedFrame())
+			return frame->data;
+
+		if (decodedImage == nullptr)
+			return imageData;
+
+		if (!decodedImage->frames.empty())
+			return decodedImage->frames[animatedImageIndex].data;
+
+		return decodedImage->data;
+	}
+
+	const DecodedImageFrame* Image::GetCurrentStreamedFrame() {
+		if (streamedFrames.empty())
+			return nullptr;
+
+		return &streamedFrames[animationStreamResident ? animatedImageIndex : 0];
 	}
 
 	////////////////////////////////////////
@@ -178,17 +735,25 @@ namespace Dooky {
 		if (enabled != useLinearInterpolation) { // Only update if we have to
 			useLinearInterpolation = enabled;
 
-			glBindTexture(GL_TEXTURE_2D, textureId);
+			std::vector<unsigned int> textures = animatedImageTextures;
+			textures.push_back(textureId);
 
-			if (enabled) {
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			} else {
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			for (unsigned int texture : textures) {
+				glBindTexture(GL_TEXTURE_2D, texture);
+
+				if (enabled) {
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				} else {
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+				}
 			}
 
 			glBindTexture(GL_TEXTURE_2D, 0);
+
+			if (tiledImage != nullptr)
+				tiledImage->EnableLinearInterpolation(enabled);
 		}
 	}
 
@@ -212,26 +777,124 @@ namespace Dooky {
 		GenericSetPixel(x, y, { r, g, b, a });
 	}
 
+	void Image::FillRect(int x, int y, int w, int h, glm::vec4 c) {
+		if (!PrepareForWriting())
+			return;
+
+		size_t pixelSize = GetPixelFormatSize(pixelFormat);
+		unsigned char pixel[16];
+		WritePixel(pixel, pixelFormat, &c[0]);
+
+		int x0 = std::max(x, 0);
+		int y0 = std::max(y, 0);
+		int x1 = std::min(x + w, textureSize.x);
+		int y1 = std::min(y + h, textureSize.y);
+
+		if (x0 >= x1 || y0 >= y1)
+			return;
+
+		for (int row = textureSize.y - y1; row < textureSize.y - y0; row++) {
+			unsigned char* destination = &imageData[((size_t)row * textureSize.x + x0) * pixelSize];
+
+			for (int i = 0; i < x1 - x0; i++) {
+				memcpy(destination + i * pixelSize, pixel, pixelSize);
+			}
+		}
+
+		MarkDirty(x0, textureSize.y - y1, x1 - x0, y1 - y0);
+	}
+
+	void Image::WriteRect(int x, int y, int w, int h, const unsigned char* pixels) {
+		if (!PrepareForWriting())
+			return;
+
+		size_t pixelSize = GetPixelFormatSize(pixelFormat);
+
+		int x0 = std::max(x, 0);
+		int y0 = std::max(y, 0);
+		int x1 = std::min(x + w, textureSize.x);
+		int y1 = std::min(y + h, textureSize.y);
+
+		if (x0 >= x1 || y0 >= y1)
+			return;
+
+		for (int sourceY = y0; sourceY < y1; sourceY++) {
+			const unsigned char* source = pixels + ((size_t)(sourceY - y) * w + (x0 - x)) * pixelSize;
+			memcpy(&imageData[((size_t)(textureSize.y - 1 - sourceY) * textureSize.x + x0) * pixelSize], source, (x1 - x0) * pixelSize);
+		}
+
+		MarkDirty(x0, textureSize.y - y1, x1 - x0, y1 - y0);
+	}
+
 	glm::vec4 Image::GetPixel(int x, int y) {
-		size_t index = y * size.x + x;
-		
-		if (index * 4 + 3 >= 0 && index + 4 + 3 < floatImageData.size()) {
-			if (floatImageData.empty())
+		const std::vector<unsigned char>& data = GetCurrentPixelData();
+
+		// Coordinates are in the full resolution of the image
+		x = x * textureSize.x / std::max(size.x, 1);
+		y = y * textureSize.y / std::max(size.y, 1);
+
+		size_t index = y * textureSize.x + x;
+		size_t pixelSize = GetPixelFormatSize(pixelFormat);
+
+		const DecodedImageFrame* frame = GetCurrentStreamedFrame();
+
+		// Nothing in memory, the tiled image reads it from the file in the background and has the last one it read until then
+		if (data.empty() && decodedImage != nullptr && decodedImage->tileSource != nullptr && tiledImage != nullptr) {
+			std::vector<unsigned char> pixelData;
+
+			if (!tiledImage->GetPixel(x, y, pixelData))
 				return { 0, 0, 0, 0 };
-			
-			return {
-				floatImageData[index * 4 + 0],
-				floatImageData[index * 4 + 1],
-				floatImageData[index * 4 + 2],
-				floatImageData[index * 4 + 3]
-			};
+
+			glm::vec4 pixel;
+			ReadPixel(pixelData.data(), pixelFormat, &pixel[0]);
+
+			return pixel;
+		}
+
+		if (frame != nullptr && !frame->palette.empty()) {
+			if (x < 0 || y < 0 || index >= data.size())
+				return { 0, 0, 0, 0 };
+
+			glm::vec4 pixel;
+			ReadPixel(&frame->palette[data[index] * 4], PixelFormat::RGBA8, &pixel[0]);
+
+			return pixel;
+		}
+		
+		if (x >= 0 && y >= 0 && (index + 1) * pixelSize <= data.size()) {
+			glm::vec4 pixel;
+			ReadPixel(&data[index * pixelSize], pixelFormat, &pixel[0]);
+
+			return pixel;
 		}
+
+		return { 0, 0, 0, 0 };
 	}
 
 	glm::ivec2 Image::GetSize() {
 		return size;
 	}
 
+	glm::ivec2 Image::GetTextureSize() {
+		return textureSize;
+	}
+
+	bool Image::IsReducedResolution() {
+		return textureSize != size;
+	}
+
+	bool Image::IsEmbeddedPreview() {
+		return decodedImage != nullptr && decodedImage->isEmbeddedPreview;
+	}
+
+	bool Image::IsUploading() {
+		return textureUpload != nullptr;
+	}
+
+	bool Image::CanCacheTexture(const DecodedImage& decoded) {
+		return decoded.frames.empty() && !decoded.isAnimated && decoded.tileSource == nullptr && FitsInTexture(decoded);
+	}
+
 	glm::ivec2 Image::GetPosition() {
 		return position;
 	}
@@ -249,15 +912,19 @@ namespace Dooky {
 	}
 
 	int Image::GetAnimatedImageFrameCount() {
-		return animatedImages.size();
+		return animatedImageFrameStarts.size();
 	}
 	
 	float Image::GetAnimatedImageFPS() {
 		return animatedImageFPS;
 	}
 
-	float* Image::GetRawImageData() {
-		return floatImageData.data();
+	const unsigned char* Image::GetRawImageData() {
+		return GetCurrentPixelData().data();
+	}
+
+	PixelFormat Image::GetPixelFormat() {
+		return pixelFormat;
 	}
 
 	void Image::Create(int w, int h, glm::vec3 c) {
@@ -277,245 +944,165 @@ namespace Dooky {
 	}
 
 	void Image::LoadRawData(int width, int height, std::vector<unsigned char> data) {
+		decodedImage.reset();
+		tiledImage.reset();
+		ClearAnimatedImage();
+
 		size = { width, height };
-		floatImageData.resize(data.size(), 0);
-		
-		for (size_t i = 0; i < data.size(); i++) {
-			floatImageData[i] = (float)data[i] / 255;
-		}
+		imageData = std::move(data); // Already RGBA8
 
-		Update(floatImageData.data(), width, height);
+		Update(imageData.data(), PixelFormat::RGBA8, width, height);
 	}
 
-	bool Image::LoadImageFile(const std::filesystem::path& path) {
-		if (!std::filesystem::exists(path))
-			return false;
-
-		// wstring to utf8
-		char convertedPath[1024];
-		WideCharToMultiByte(65001, 0, path.wstring().c_str(), -1, convertedPath, 1024, NULL, NULL);
+	void Image::LoadDecodedImage(std::shared_ptr<const DecodedImage> decoded) {
+		decodedImage = decoded;
+		imageData.clear();
+		dirtyRects.clear();
+		mipLevels.clear();
 
-		std::string extension = path.extension().string();
+		ClearAnimatedImage();
 
-		std::transform(
-			extension.begin(),
-			extension.end(),
-			extension.begin(),
-			[](unsigned char c) {
-				return std::tolower(c);
-			}
-		);
+		useTonemapping = decoded->useTonemapping;
 
-		// Load
-		int width = 0;
-		int height = 0;
-
-		try {
-			printf("Loading.\n");
+		if (!decoded->frames.empty()) {
+			for (int i = 0; i < decoded->frames.size(); i++) {
+				int delay = decoded->frames[i].delay;
 
-			std::list<Magick::Image> imageList;
-			Magick::readImages(&imageList, convertedPath);
-
-			printf("Loaded.\n");
-
-			if (imageList.empty())
-				false;
-
-			// Clear animated images
-			animatedImages.clear();
-			animatedImagesDelays.clear();
-			animatedImagesDelaysTotal = 0;
-			animatedImageHasPlayedYet = false;
-
-			// Decide if image should be tonemapped
-			useTonemapping = TONEMAPPED_IMAGE_EXTENSIONS.contains(extension);
-
-			Magick::Image* frontImage = &imageList.front();
-			
-			if (loadedFirstMagickImage == false) {
-				loadedFirstMagickImage = true;
-				loadedMagickImage = new Magick::Image(*frontImage);
-			} else {
-				delete loadedMagickImage;
-				loadedMagickImage = new Magick::Image(*frontImage);
+				animatedImageFrameStarts.push_back(animatedImagesDelaysTotal);
+				animatedImagesDelaysTotal += std::max(delay, 0);
 			}
 
-			width = frontImage->size().width();
-			height = frontImage->size().height();
-
-			if (imageList.size() == 1) { // Single, static image
-				//auto t1 = std::chrono::high_resolution_clock::now();
-				frontImage->type(Magick::TrueColorAlphaType);
-				//auto t2 = std::chrono::high_resolution_clock::now();
-				//std::cout << "Time elapsed: " << (float)(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count()) / 1000000000.0f << std::endl;
-
-				// Append data
-				float* data = frontImage->getPixels(0, 0, width, height);
-				floatImageData.resize(width * height * 4, 0);
-				floatImageData.assign(data, data + (width * height * 4));
-
-				// Divide by 65535 to reduce intensity for shader
-				for (float& f : floatImageData) f /= 65535;
+			animatedImageFPS = (float)(animatedImageFrameStarts.size() * 100) / animatedImagesDelaysTotal;
+		}
 
-				Update(floatImageData.data(), width, height);
-			} else if (imageList.size() > 1) {
-				Magick::coalesceImages(&imageList, imageList.begin(), imageList.end()); // For when GIFs have page offsets
+		size = { decoded->fullWidth, decoded->fullHeight };
 
-				int frameIndex = 0;
+		UploadDecodedImage(decoded);
+	}
 
-				// Animated image, probably GIF
-				for (auto& image : imageList) {
-					image.type(Magick::TrueColorAlphaType);
+	void Image::RefineDecodedImage(std::shared_ptr<const DecodedImage> decoded) {
+		if (decoded->frames.size() != animatedImageFrameStarts.size())
+			return; // Not the same image
 
-					int columns = image.columns();
-					int rows = image.rows();
-					float* data = image.getPixels(0, 0, columns, rows);
+		decodedImage = decoded;
+		imageData.clear();
+		dirtyRects.clear();
+		mipLevels.clear();
 
-					AnimatedImageFrame frame;
-					frame.index = frameIndex;
-					frame.data.resize(width * height * 4, 0);
-					frame.data.assign(data, data + (columns * rows * 4));
+		useTonemapping = decoded->useTonemapping; // An embedded preview isn't tonemapped but the RAW data is
 
-					int delay = image.animationDelay();
+		size = { decoded->fullWidth, decoded->fullHeight }; // Embedded previews can be a bit smaller than the RAW image
 
-					// Divide by 65535 to reduce intensity for shader
-					for (float& f : frame.data) f /= 65535;
-					
-					animatedImages.insert(std::pair<int, AnimatedImageFrame>(animatedImagesDelaysTotal, frame));
-					animatedImagesDelays.push_back(delay);
-					animatedImagesDelaysTotal += delay;
-					frameIndex++;
-				}
+		UploadDecodedImage(decoded);
+	}
 
-				animatedImageFPS = (float)(animatedImages.size() * 100) / animatedImagesDelaysTotal;
+	bool Image::LoadImageFile(const std::filesystem::path& path) {
+		std::shared_ptr<DecodedImage> decoded = std::make_shared<DecodedImage>();
 
-				// Update with first frame
-				auto got = animatedImages.find(0);
+		if (!DecodeImageFile(path, *decoded))
+			return false;
 
-				if (got != animatedImages.end()) {
-					floatImageData = animatedImages.find(0)->second.data;
-				}
+		LoadDecodedImage(decoded);
 
-				Update(floatImageData.data(), width, height);
-			}
+		return true;
+	}
 
-			size = { width, height };
+	// SavedAsJPEG if the file was written but as a JPEG instead of the extension specified, e.g when writing as "image.cr2"
+	// Failed if nothing was written, like when the source file has been moved or deleted since it was opened
+	ImageWriteResult Image::WriteToFile(const std::string& path) {
+		if (decodedImage == nullptr) {
+			std::cout << "ERROR: Failed to save image, there's no file loaded" << std::endl;
+			return ImageWriteResult::Failed;
+		}
 
-			return true;
+		// Nothing decoded is kept around for saving, the source file is read again only when it's needed
+		try {
+			Magick::Image magickImage(PathToUTF8String(decodedImage->path));
+			magickImage.write(path);
 		} catch (std::exception& exception) {
-			std::cout << "FAILED TO LOAD IMAGE: " << exception.what() << std::endl;
-
-			/*
-			std::cout << "RESORTING TO stb_image AS MAGICK FAILED TO LOAD IMAGE: " << exception.what() << std::endl;
+			std::cout << "ERROR: Failed to save image: " << exception.what() << std::endl;
+			return ImageWriteResult::Failed;
+		}
 
-			try {
-				int x, y, n; // n = components, e.g 3 = RGB, 4 = RGBA
-				unsigned char* data = stbi_load(convertedPath, &x, &y, &n, 4); // In this case 4 is is the fifth arg to force 4 components
+		// Notify user if extension is not jpeg, but jpeg was written.
+		std::filesystem::path pathToPath(path);
 
-				if (data == nullptr) {
-					std::cout << "stb_image failed to load image." << std::endl;
-					return false;
-				}
+		if (pathToPath.has_extension()) {
+			std::string ext = pathToPath.extension().string();
+			LowerString(ext);
 
-				// Append data
-				floatImageData.resize(x * y * n, 0);
-				floatImageData.assign(data, data + (x * y * n));
+			if (ext != ".jpg" && ext != ".jpeg" && ext != ".jpe" && ext != ".jif" && ext != ".jfif") { // User did not specify jpeg as the file extension
+				std::ifstream stream(path, std::ios::in | std::ios::binary);
 
-				Update(floatImageData.data(), width, height);
+				if (stream.is_open()) {
+					unsigned char firstThreeBytes[3] = {};
+					stream.read((char*)firstThreeBytes, 3);
+					stream.close();
 
-				stbi_image_free(data);
-				return true;
-			} catch (std::exception& exception) {
-				std::cout << "stb_image FAILED TO LOAD IMAGE: " << exception.what() << std::endl;
-				return false;
+					if (firstThreeBytes[0] == 0xFF && firstThreeBytes[1] == 0xD8 && firstThreeBytes[2] == 0xFF) {
+						return ImageWriteResult::SavedAsJPEG;
+					}
+				}
 			}
-			*/
-
-			return false;
 		}
-		
-		return true;
-	}
-
-	// Returns true if successful
-	// Returns false if file was written but the image was a JPEG instead of the extension specified. e.g when writing as "image.cr2" it will write as a JPEG and this will return false
-	bool Image::WriteToFile(const std::string& path) {
-		if (loadedMagickImage != nullptr && loadedFirstMagickImage) {
-			loadedMagickImage->write(path);
 
-			// Notify user if extension is not jpeg, but jpeg was written.
-			std::filesystem::path pathToPath(path);
+		return ImageWriteResult::Saved;
+	}
 
-			if (pathToPath.has_extension()) {
-				std::string ext = pathToPath.extension().string();
-				LowerString(ext);
+	void Image::UpdateVisibleRegion(Window& window) {
+		if (tiledImage == nullptr)
+			return;
 
-				if (ext != ".jpg" && ext != ".jpeg" && ext != ".jpe" && ext != ".jif" && ext != ".jfif") { // User did not specify jpeg as the file extension
-					std::ifstream stream(path, std::ios::in | std::ios::binary);
+		// Work out which part of the image the window can see by taking its corners back through the transform
+		glm::mat4 inverse = glm::inverse(GetProjection(window));
+		glm::vec2 visibleMin = { 1.0f, 1.0f };
+		glm::vec2 visibleMax = { 0.0f, 0.0f };
 
-					if (stream.is_open()) {
-						char firstThreeBytes[3];
-						stream.read(firstThreeBytes, 3);
-						stream.close();
+		for (glm::vec2 corner : { glm::vec2(-1.0f, -1.0f), glm::vec2(1.0f, -1.0f), glm::vec2(-1.0f, 1.0f), glm::vec2(1.0f, 1.0f) }) {
+			glm::vec4 p = inverse * glm::vec4(corner, 0.0f, 1.0f);
+			glm::vec2 normalised = glm::vec2(p) / (glm::vec2(size) * scale);
 
-						int first = 256 + firstThreeBytes[0];
-						int second = 256 + firstThreeBytes[1];
-						int third = 256 + firstThreeBytes[2];
+			if (flipVertically)
+				normalised.y = 1.0f - normalised.y;
 
-						if (first == 0xFF && second == 0xD8 && third == 0xFF) {
-							return false;
-						}
-					}
-				}
-			}
+			visibleMin = glm::min(visibleMin, normalised);
+			visibleMax = glm::max(visibleMax, normalised);
 		}
 
-		return true;
+		tiledImage->Update(visibleMin, visibleMax, std::max(scale.x, scale.y) * size.x / std::max(textureSize.x, 1));
 	}
 
 	void Image::Draw(Window& window) {
 		if (flag_ImageWasChanged) {
 			flag_ImageWasChanged = false;
-			Update(floatImageData.data(), size.x, size.y);
+			Update(GetCurrentPixelData().data(), pixelFormat, textureSize.x, textureSize.y);
+		} else if (!dirtyRects.empty()) {
+			UploadDirtyRects();
 		}
 
+		if (textureUpload != nullptr)
+			ContinueTextureUpload();
+
 		// Animated image updates, e.g animated GIF
-		if (animatedImages.size() > 1 && animatedImagesDelaysTotal > 0) {
+		if (decodedImage != nullptr && decodedImage->isAnimated && (animationStream != nullptr || !animationStreamStarted)) {
+			UpdateAnimationStream(window);
+		} else if (animatedImageFrameStarts.size() > 1 && animatedImagesDelaysTotal > 0) {
 			if (animatedImageHasPlayedYet == false) {
 				animatedImageHasPlayedYet = true;
 				animatedImageStartPlayTime = window.GetTime();
 			}
 
-			int index = (int)((window.GetTime() - animatedImageStartPlayTime) * 100) % animatedImagesDelaysTotal;
-
-			auto got = animatedImages.find(index);
-
-			if (got != animatedImages.end()) {
-				auto& data = got->second.data;
-				animatedImageIndex = got->second.index;
-
-				for (int i = 0; i < data.size() / 4; i++) {
-					float a = data[i * 4 + 3];
+			int time = (int)((window.GetTime() - animatedImageStartPlayTime) * 100) % animatedImagesDelaysTotal;
 
-					floatImageData[i * 4 + 0] = data[i * 4 + 0];
-					floatImageData[i * 4 + 1] = data[i * 4 + 1];
-					floatImageData[i * 4 + 2] = data[i * 4 + 2];
-					floatImageData[i * 4 + 3] = data[i * 4 + 3];
-				}
-
-				Update(floatImageData.data(), size.x, size.y);
-			}
+			// Last frame that starts at or before the current time, frames with no delay get skipped over
+			auto next = std::upper_bound(animatedImageFrameStarts.begin(), animatedImageFrameStarts.end(), time);
+			animatedImageIndex = std::max((int)std::distance(animatedImageFrameStarts.begin(), next) - 1, 0);
 		}
 
-		glm::ivec2 winSize = window.GetSize();
-		float winWidth = winSize.x;
-		float winHeight = winSize.y;
+		unsigned int texture = animatedImageTextures.empty() ? textureId : animatedImageTextures[animatedImageIndex];
+		unsigned int paletteTexture = animatedImageTextures.empty() ? paletteTextureId : animatedImagePaletteTextures[animatedImageIndex];
 
-		glm::mat4 projection = glm::ortho(0.0f, winWidth, 0.0f, winHeight);
-		projection = glm::translate(projection, { position.x, winHeight - position.y, 0.0f }); // Move to position
-		projection = glm::rotate(projection, glm::radians(rotation), { 0.0f, 0.0f, 1.0f }); // Rotate
-		projection = glm::translate(projection, { floorf(-size.x * scale.x * anchorPoint.x), floorf(size.y * scale.y * anchorPoint.y), 0.0f }); // Move down to correct pivot point
-		projection = glm::translate(projection, { 0.0f, -size.y * scale.y, 0.0f }); // Move down one last time
+		glm::mat4 projection = GetProjection(window);
 
 		shader.Bind();
 
@@ -527,6 +1114,11 @@ namespace Dooky {
 		shader.SetUniform1f("time", window.GetTime());
 		shader.SetUniform2f("position", position.x, position.y);
 
+		shader.SetUniform1i("image", 0);
+		shader.SetUniform1i("palette", 1);
+		shader.SetUniformBool("useIndexedColor", paletteTexture != 0);
+		shader.SetUniformBool("useLinearInterpolation", useLinearInterpolation);
+
 		shader.SetUniformBool("useTonemapping"                   , useTonemapping);
 		shader.SetUniformBool("adjustment_NoTonemapping"         , adjustment_NoTonemapping);
 		shader.SetUniformBool("adjustment_UseFlatTonemapping"    , adjustment_UseFlatTonemapping);
@@ -542,8 +1134,29 @@ namespace Dooky {
 		shader.SetUniform4f("adjustment_ChannelMultiplier", m.r, m.g, m.b, m.a);
 
 		glBindVertexArray(vao);
-		glBindTexture(GL_TEXTURE_2D, textureId);
-		glDrawArrays(GL_TRIANGLES, 0, 6);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, paletteTexture);
+		glActiveTexture(GL_TEXTURE0);
+
+		if (tiledImage != nullptr) {
+			for (const TiledImage::DrawnTile& tile : tiledImage->GetDrawnTiles()) {
+				shader.SetUniform4f("tileRect", tile.rect.x, tile.rect.y, tile.rect.z, tile.rect.w);
+				shader.SetUniform4f("tileTextureRect", tile.textureRect.x, tile.textureRect.y, tile.textureRect.z, tile.textureRect.w);
+
+				glBindTexture(GL_TEXTURE_2D, tile.texture);
+				glDrawArrays(GL_TRIANGLES, 0, 6);
+			}
+		} else {
+			shader.SetUniform4f("tileRect", 0.0f, 0.0f, 1.0f, 1.0f);
+			shader.SetUniform4f("tileTextureRect", 0.0f, 0.0f, 1.0f, 1.0f);
+
+			glBindTexture(GL_TEXTURE_2D, texture);
+			glDrawArrays(GL_TRIANGLES, 0, 6);
+		}
+
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_2D, 0);
 		glBindVertexArray(0);
 
@@ -2,32 +2,56 @@
 #define IMAGE_H
 
 #include <vector>
+#include <memory>
 #include <filesystem>
-#include <unordered_map>
 #include <glm/glm.hpp>
 
 #include "Window.h"
 #include "Shader.h"
+#include "ImageDecoder.h"
+#include "AnimationStream.h"
+#include "TiledImage.h"
+#include "TextureUpload.h"
+#include "TextureCache.h"
 
 namespace Dooky {
-	struct AnimatedImageFrame {
-		std::vector<float> data;
-		int index;
+	enum class ImageWriteResult {
+		Saved,
+		SavedAsJPEG, // The extension wasn't one ImageMagick can write so it fell back to a JPEG
+		Failed
 	};
 
+	// OpenGL formats for uploading pixels as they are, gray formats need the swizzle so they get sampled as RGBA
+	void GetPixelFormatGL(PixelFormat format, GLint& internalFormat, GLenum& pixelDataFormat, GLenum& pixelDataType, GLint* swizzle);
+
 	class Image {
 	private:
-		std::unordered_map<int, AnimatedImageFrame> animatedImages;
-		std::vector<int> animatedImagesDelays;
+		std::vector<int> animatedImageFrameStarts; // Centisecond each frame starts at, sorted so the current frame can be binary searched
+		std::vector<unsigned int> animatedImageTextures; // One per frame, all uploaded up front so playing is just binding a different one
+		std::vector<unsigned int> animatedImagePaletteTextures; // Goes with animatedImageTextures, 0 for frames that aren't palette indices
 		int animatedImagesDelaysTotal;
+		std::unique_ptr<AnimationStream> animationStream; // Decodes the frames of GIFs, APNGs and WebPs while they play
+		bool animationStreamStarted;
+		bool animationStreamResident; // Every frame so far has been kept in animatedImageTextures, dropped once the animation turns out to be too long
+		std::vector<DecodedImageFrame> streamedFrames; // CPU side copies for GetPixel, every frame while resident and only the current one otherwise
+		size_t animationResidentBytes;
+		float animatedImageFrameEndTime;
 		bool animatedImageHasPlayedYet;
 		float animatedImageStartPlayTime;
 		float animatedImageFPS;
 		int animatedImageIndex;
 
 		std::vector<float> vertices;
-		std::vector<float> floatImageData;
+		std::vector<unsigned char> imageData; // Pixels of images created in memory
+		std::vector<glm::ivec4> dirtyRects; // Parts of imageData written to since the texture was last updated, x, row, width and height in the order rows are stored
+		std::vector<std::vector<unsigned char>> mipLevels; // CPU copies of the texture's mip levels (level 1 first) so only the part that changed has to be filtered again, built on first use
+		PixelFormat pixelFormat; // Format of whichever pixels are currently shown
+		std::shared_ptr<const DecodedImage> decodedImage; // Pixels of images loaded from a file, shared with whoever decoded it
+		std::unique_ptr<TiledImage> tiledImage; // Drawn instead of textureId for images too big to be one texture
+		std::shared_ptr<const DecodedImage> textureSource; // Decoded image that all of textureId was uploaded from, null if it's anything else
+		std::unique_ptr<TextureUpload> textureUpload; // Static image being streamed into a new texture, whatever is in textureId stays on screen until its base level is in
 		glm::ivec2 size; // The resolution of the image
+		glm::ivec2 textureSize; // The resolution of the texture, smaller than size when showing a reduced resolution decode
 		glm::ivec2 position;
 		glm::vec2 anchorPoint;
 		glm::vec2 scale;
@@ -41,15 +65,37 @@ namespace Dooky {
 		unsigned int vao;
 		unsigned int vbo;
 		unsigned int textureId;
+		unsigned int paletteTextureId; // 0 unless textureId holds palette indices
 
 		Shader shader;
 
-		void Update(float* data, int w, int h);
+		glm::mat4 GetProjection(Window& window);
+		void SetTextureFilter(); // On the bound texture
+		void ResetMainTexture(); // A fresh texture in place of textureId, the finished uploads are immutable
+		void DiscardMainTexture(); // Into textureCache if it holds all of a decoded image, deleted otherwise
+		bool TakeCachedTexture(std::shared_ptr<const DecodedImage> decoded); // Swaps it in for textureId if textureCache has it, compressed or not
+		bool FitsInTexture(const DecodedImage& decoded);
+		void ContinueTextureUpload();
+		void ShowUploadedTexture(); // Swaps it in for textureId once the base level is uploaded
+		void UploadTexture(unsigned int texture, const unsigned char* data, PixelFormat format, int w, int h);
+		void UploadFrame(unsigned int texture, unsigned int& paletteTexture, const DecodedImageFrame& frame); // Palette texture is created or deleted as needed
+		void Update(const unsigned char* data, PixelFormat format, int w, int h);
+		void UploadAnimatedImageFrames(const DecodedImage& decoded);
+		void UploadDecodedImage(std::shared_ptr<const DecodedImage> decoded);
+		void ClearAnimatedImage();
+		void UpdateAnimationStream(Window& window);
 		void GenericCreate(int w, int h, glm::vec4 c);
 		void GenericSetPixel(int x, int y, glm::vec4 c);
+		bool PrepareForWriting(); // False if there are no pixels in memory to write to
+		void MarkDirty(int x, int row, int w, int h);
+		void UploadDirtyRects();
+		const std::vector<unsigned char>& GetCurrentPixelData();
+		const DecodedImageFrame* GetCurrentStreamedFrame(); // Null if not playing a streamed animation
 	public:
 		bool useTonemapping;
 		bool useMipmaps;
+		DownsampleFilter mipmapFilter; // Used for the mip levels built on the CPU
+		TextureCache* textureCache; // Where textures of decoded images go when they stop being shown, null to always delete them
 
 		bool adjustment_NoTonemapping;
 		bool adjustment_UseFlatTonemapping;
@@ -78,16 +124,25 @@ namespace Dooky {
 		void SetPixel(int x, int y, glm::vec4 c);
 		void SetPixel(int x, int y, float r, float g, float b);
 		void SetPixel(int x, int y, float r, float g, float b, float a);
+		// In pixels of the texture (the same as SetPixel unless IsReducedResolution) with y going up like SetPixel, only the part written to gets uploaded
+		void FillRect(int x, int y, int w, int h, glm::vec4 c);
+		void WriteRect(int x, int y, int w, int h, const unsigned char* pixels); // Rows of GetPixelFormat(), bottom row first
 
 		glm::vec4 GetPixel(int x, int y);
 		glm::ivec2 GetSize();
+		glm::ivec2 GetTextureSize();
+		bool IsReducedResolution();
+		bool IsEmbeddedPreview();
+		bool IsUploading(); // Streaming a texture in over the next few frames
+		bool CanCacheTexture(const DecodedImage& decoded); // Whether it would be drawn from one texture that TextureCache can keep
 		glm::ivec2 GetPosition();
 		glm::vec2 GetAnchorPoint();
 		glm::vec2 GetScale();
 		int GetAnimatedImageCurrentIndex();
 		int GetAnimatedImageFrameCount();
 		float GetAnimatedImageFPS();
-		float* GetRawImageData();
+		const unsigned char* GetRawImageData(); // In the format given by GetPixelFormat
+		PixelFormat GetPixelFormat();
 
 		void Create(int w, int h, glm::vec3 c);
 		void Create(int w, int h, glm::vec4 c);
@@ -95,9 +150,12 @@ namespace Dooky {
 		void Create(int w, int h, float r, float g, float b, float a);
 
 		void LoadRawData(int width, int height, std::vector<unsigned char> data);
+		void LoadDecodedImage(std::shared_ptr<const DecodedImage> decoded); // Must be called on the thread that owns the OpenGL context
+		void RefineDecodedImage(std::shared_ptr<const DecodedImage> decoded); // Swaps in a better decode of the same image (see IsPreview) without resetting anything else
 		bool LoadImageFile(const std::filesystem::path& path);
-		bool WriteToFile(const std::string& path);
+		ImageWriteResult WriteToFile(const std::string& path);
 
+		void UpdateVisibleRegion(Window& window); // Reads in the parts of images too big to be one texture that the window can see, once a frame before Draw
 		void Draw(Window& window);
 	};
 }
@@ -0,0 +1,161 @@
+#include "ImageCache.h"
+
+namespace Dooky {
+	////////////////////////////////////////
+	///// CLASS: IMAGE CACHE
+	////////////////////////////////////////
+
+	ImageCache::ImageCache(size_t budget) {
+		this->budget = budget;
+		usedBytes = 0;
+
+		hitCount = 0;
+		missCount = 0;
+		evictionCount = 0;
+	}
+
+	////////////////////////////////////////
+	///// PRIVATE
+	////////////////////////////////////////
+
+	bool ImageCache::ReadFileStamp(const std::filesystem::path& path, long long& lastModifiedTime, uintmax_t& fileSize) {
+		std::error_code error;
+
+		auto writeTime = std::filesystem::last_write_time(path, error);
+		if (error) return false;
+
+		fileSize = std::filesystem::file_size(path, error);
+		if (error) return false;
+
+		lastModifiedTime = writeTime.time_since_epoch().count();
+
+		return true;
+	}
+
+	std::list<ImageCache::CacheEntry>::iterator ImageCache::Lookup(const std::filesystem::path& path) {
+		auto found = entryLookup.find(path.wstring());
+
+		if (found == entryLookup.end())
+			return entries.end();
+
+		auto entry = found->second;
+
+		// Throw it out if the file was changed since it was decoded
+		long long lastModifiedTime = 0;
+		uintmax_t fileSize = 0;
+
+		if (!ReadFileStamp(path, lastModifiedTime, fileSize) || lastModifiedTime != entry->lastModifiedTime || fileSize != entry->fileSize) {
+			Remove(entry);
+			return entries.end();
+		}
+
+		return entry;
+	}
+
+	void ImageCache::Remove(std::list<CacheEntry>::iterator entry) {
+		usedBytes -= entry->bytes;
+		entryLookup.erase(entry->path);
+		entries.erase(entry);
+	}
+
+	void ImageCache::EvictToBudget() {
+		while (usedBytes > budget && !entries.empty()) {
+			Remove(std::prev(entries.end()));
+			evictionCount++;
+		}
+	}
+
+	////////////////////////////////////////
+	///// PUBLIC
+	////////////////////////////////////////
+
+	std::shared_ptr<DecodedImage> ImageCache::Find(const std::filesystem::path& path) {
+		auto entry = Lookup(path);
+
+		if (entry == entries.end()) {
+			missCount++;
+			return nullptr;
+		}
+
+		hitCount++;
+		entries.splice(entries.begin(), entries, entry); // Most recently used
+
+		return entry->image;
+	}
+
+	std::shared_ptr<DecodedImage> ImageCache::Peek(const std::filesystem::path& path) {
+		auto entry = Lookup(path);
+
+		if (entry == entries.end())
+			return nullptr;
+
+		return entry->image;
+	}
+
+	bool ImageCache::Contains(const std::filesystem::path& path) {
+		return Lookup(path) != entries.end();
+	}
+
+	bool ImageCache::Insert(const std::filesystem::path& path, std::shared_ptr<DecodedImage> image) {
+		std::wstring key = path.wstring();
+
+		auto found = entryLookup.find(key);
+
+		if (found != entryLookup.end())
+			Remove(found->second);
+
+		CacheEntry entry;
+		entry.path = key;
+		entry.bytes = GetDecodedImageSize(*image);
+		entry.image = image;
+
+		if (!ReadFileStamp(path, entry.lastModifiedTime, entry.fileSize))
+			return false;
+
+		if (entry.bytes > budget) // Would just push everything else out and then itself
+			return false;
+
+		entries.push_front(entry);
+		entryLookup[key] = entries.begin();
+		usedBytes += entry.bytes;
+
+		EvictToBudget();
+
+		return true;
+	}
+
+	void ImageCache::Clear() {
+		entries.clear();
+		entryLookup.clear();
+		usedBytes = 0;
+	}
+
+	void ImageCache::SetBudget(size_t bytes) {
+		budget = bytes;
+		EvictToBudget();
+	}
+
+	size_t ImageCache::GetBudget() {
+		return budget;
+	}
+
+	size_t ImageCache::GetUsedBytes() {
+		return usedBytes;
+	}
+
+	size_t ImageCache::GetEntryCount() {
+		return entries.size();
+	}
+
+	size_t ImageCache::GetHitCount() {
+		return hitCount;
+	}
+
+	size_t ImageCache::GetMissCount() {
+		return missCount;
+	}
+
+	size_t ImageCache::GetEvictionCount() {
+		return evictionCount;
+	}
+}
\ No newline at end of file
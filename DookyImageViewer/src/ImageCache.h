@@ -0,0 +1,59 @@
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include <list>
+#include <string>
+#include <memory>
+#include <filesystem>
+#include <unordered_map>
+
+#include "ImageDecoder.h"
+
+namespace Dooky {
+	// Keeps recently decoded images around so they don't have to be decoded again, least recently used ones are thrown out first
+	// Only used from the main thread
+	class ImageCache {
+	private:
+		struct CacheEntry {
+			std::wstring path;
+			long long lastModifiedTime; // An entry is only valid while the file hasn't changed
+			uintmax_t fileSize;
+			size_t bytes;
+			std::shared_ptr<DecodedImage> image;
+		};
+
+		std::list<CacheEntry> entries; // Most recently used at the front
+		std::unordered_map<std::wstring, std::list<CacheEntry>::iterator> entryLookup;
+
+		size_t budget; // In bytes
+		size_t usedBytes;
+
+		size_t hitCount;
+		size_t missCount;
+		size_t evictionCount;
+
+		bool ReadFileStamp(const std::filesystem::path& path, long long& lastModifiedTime, uintmax_t& fileSize);
+		std::list<CacheEntry>::iterator Lookup(const std::filesystem::path& path); // Returns entries.end() if missing or stale
+		void Remove(std::list<CacheEntry>::iterator entry);
+		void EvictToBudget();
+	public:
+		ImageCache(size_t budget);
+
+		std::shared_ptr<DecodedImage> Find(const std::filesystem::path& path); // Counts as a hit or miss and marks the image as recently used
+		std::shared_ptr<DecodedImage> Peek(const std::filesystem::path& path); // Doesn't count towards the statistics
+		bool Contains(const std::filesystem::path& path); // Doesn't count towards the statistics
+		bool Insert(const std::filesystem::path& path, std::shared_ptr<DecodedImage> image); // Returns false if it doesn't fit
+		void Clear();
+
+		void SetBudget(size_t bytes);
+		size_t GetBudget();
+		size_t GetUsedBytes();
+		size_t GetEntryCount();
+
+		size_t GetHitCount();
+		size_t GetMissCount();
+		size_t GetEvictionCount();
+	};
+}
+
+#endif
\ No newline at end of file
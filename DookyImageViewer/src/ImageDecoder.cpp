@@ -0,0 +1,737 @@
+#include "ImageDecoder.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <unordered_set>
+#include <Magick++.h>
+
+#include "vendor/stb_image/stb_image.h"
+
+#include "StringUtils.h"
+#include "TiffParser.h"
+#include "AnimationDecoder.h"
+#include "PixelConversion.h"
+#include "TiffTileSource.h"
+
+std::unordered_set<std::string> TONEMAPPED_IMAGE_EXTENSIONS = {
+	".hdr", ".exr", ".cr2", ".crw", ".dcr",
+	".mrw", ".arw", ".nef", ".orf", ".raf",
+	".x3f"
+};
+
+std::unordered_set<std::string> RAW_IMAGE_EXTENSIONS = {
+	".cr2", ".crw", ".dcr", ".mrw", ".arw",
+	".nef", ".orf", ".raf", ".x3f", ".dng",
+	".rw2", ".pef", ".srw"
+};
+
+int RAW_PREVIEW_MIN_SIZE = 1280; // Embedded previews smaller than this on their longest side aren't worth showing, it gets demosaiced instead
+int TIFF_REGION_DECODE_MIN_SIZE = 8192; // TIFFs at least this big on their longest side are read a region at a time instead of all at once
+size_t EXIF_THUMBNAIL_HEAD_SIZE = 128 * 1024; // Bytes read from the start of a file to find its EXIF thumbnail, a JPEG's EXIF segment can't be over 64KB
+size_t EXIF_THUMBNAIL_MAX_LENGTH = 2 * 1024 * 1024; // Embedded JPEGs bigger than this aren't thumbnails, and might be the RAW data itself
+
+enum class NativeImageFormat {
+	None,
+	JPEG,
+	PNG,
+	BMP,
+	TGA
+};
+
+namespace Dooky {
+	size_t GetDecodedImageSize(const DecodedImage& decoded) {
+		size_t bytes = decoded.data.size();
+
+		for (const DecodedImageFrame& frame : decoded.frames) {
+			bytes += frame.data.size();
+		}
+
+		return bytes;
+	}
+
+	bool IsReducedResolution(const DecodedImage& decoded) {
+		return decoded.width < decoded.fullWidth || decoded.height < decoded.fullHeight;
+	}
+
+	bool IsPreview(const DecodedImage& decoded) {
+		return decoded.isEmbeddedPreview || IsReducedResolution(decoded);
+	}
+
+	bool IsRawImageFile(const std::filesystem::path& path) {
+		std::string extension = path.extension().string();
+		LowerString(extension);
+
+		return RAW_IMAGE_EXTENSIONS.contains(extension);
+	}
+
+	void ResetDecodedImage(const std::filesystem::path& path, DecodedImage& decoded) {
+		std::string extension = path.extension().string();
+		LowerString(extension);
+
+		decoded.path = path;
+		decoded.width = 0;
+		decoded.height = 0;
+		decoded.fullWidth = 0;
+		decoded.fullHeight = 0;
+		decoded.isEmbeddedPreview = false;
+		decoded.isAnimated = false;
+		decoded.format = PixelFormat::RGBA8;
+		decoded.data.clear();
+		decoded.frames.clear();
+		decoded.tileSource.reset();
+
+		// Decide if image should be tonemapped
+		decoded.useTonemapping = TONEMAPPED_IMAGE_EXTENSIONS.contains(extension);
+	}
+
+	bool ReadFileBytes(const std::filesystem::path& path, std::vector<unsigned char>& bytes) {
+		std::ifstream input(path, std::ios::in | std::ios::binary | std::ios::ate);
+
+		if (!input.is_open())
+			return false;
+
+		std::streamsize length = input.tellg();
+
+		if (length <= 0)
+			return false;
+
+		bytes.resize(length);
+		input.seekg(0);
+		input.read((char*)bytes.data(), length);
+
+		return input.good();
+	}
+
+	// APNGs have an acTL chunk somewhere before the first IDAT, stb_image would only ever show the default image
+	bool IsAnimatedPNG(const std::vector<unsigned char>& bytes) {
+		size_t offset = 8; // Skip signature
+
+		while (offset + 8 <= bytes.size()) {
+			size_t length = (bytes[offset] << 24) | (bytes[offset + 1] << 16) | (bytes[offset + 2] << 8) | bytes[offset + 3];
+			const unsigned char* type = &bytes[offset + 4];
+
+			if (memcmp(type, "acTL", 4) == 0) return true;
+			if (memcmp(type, "IDAT", 4) == 0) return false;
+
+			offset += 12 + length; // Length, type, data and CRC
+		}
+
+		return false;
+	}
+
+	NativeImageFormat DetectNativeImageFormat(const std::vector<unsigned char>& bytes, const std::string& extension) {
+		if (bytes.size() < 8)
+			return NativeImageFormat::None;
+
+		if (bytes[0] == 0xFF && bytes[1] == 0xD8 && bytes[2] == 0xFF)
+			return NativeImageFormat::JPEG;
+
+		if (memcmp(bytes.data(), "\x89PNG\r\n\x1A\n", 8) == 0)
+			return IsAnimatedPNG(bytes) ? NativeImageFormat::None : NativeImageFormat::PNG;
+
+		if (bytes[0] == 'B' && bytes[1] == 'M')
+			return NativeImageFormat::BMP;
+
+		// TGA has no signature so only trust the extension
+		if (extension == ".tga" || extension == ".icb" || extension == ".vda" || extension == ".vst")
+			return NativeImageFormat::TGA;
+
+		return NativeImageFormat::None;
+	}
+
+	PixelLayout GetStbPixelLayout(int components) {
+		switch (components) {
+		case 1: return PixelLayout::Gray;
+		case 2: return PixelLayout::GrayAlpha;
+		case 3: return PixelLayout::RGB;
+		}
+
+		return PixelLayout::RGBA;
+	}
+
+	// Works out how the pixel cache is laid out, only the plain layouts are read directly
+	bool GetMagickPixelLayout(Magick::Image& image, PixelLayout& layout) {
+		bool hasAlpha = image.alpha();
+
+		switch (image.colorSpace()) {
+		case Magick::sRGBColorspace:
+		case Magick::RGBColorspace:
+		case Magick::scRGBColorspace:
+			layout = hasAlpha ? PixelLayout::RGBA : PixelLayout::RGB;
+			break;
+		case Magick::GRAYColorspace:
+		case Magick::LinearGRAYColorspace:
+			layout = hasAlpha ? PixelLayout::GrayAlpha : PixelLayout::Gray;
+			break;
+		case Magick::CMYKColorspace:
+			layout = hasAlpha ? PixelLayout::CMYKA : PixelLayout::CMYK;
+			break;
+		default:
+			return false;
+		}
+
+		return image.channels() == GetPixelLayoutChannels(layout);
+	}
+
+	PixelFormat PickMagickPixelFormat(Magick::Image& image, bool useTonemapping) {
+		if (useTonemapping)
+			return PixelFormat::RGBA16F;
+
+		PixelLayout layout = PixelLayout::RGBA;
+		bool highDepth = image.depth() > 8;
+
+		if (GetMagickPixelLayout(image, layout)) {
+			if (layout == PixelLayout::Gray) return highDepth ? PixelFormat::R16 : PixelFormat::R8;
+			if (layout == PixelLayout::GrayAlpha) return highDepth ? PixelFormat::RG16 : PixelFormat::RG8;
+		}
+
+		return highDepth ? PixelFormat::RGBA16 : PixelFormat::RGBA8;
+	}
+
+	void ExportMagickPixels(Magick::Image& image, PixelFormat format, std::vector<unsigned char>& data) {
+		size_t width = image.columns();
+		size_t height = image.rows();
+
+		data.resize(width * height * GetPixelFormatSize(format));
+
+		PixelLayout layout = PixelLayout::RGBA;
+
+		if (GetMagickPixelLayout(image, layout)) {
+			const Magick::Quantum* pixels = image.getConstPixels(0, 0, width, height);
+
+			if (pixels != nullptr) {
+				ConvertPixels(pixels, layout, QuantumRange, data.data(), format, width * height);
+				return;
+			}
+		}
+
+		// Anything else (other colourspaces, extra channels) gets converted to RGBA by ImageMagick first
+		if (format == PixelFormat::RGBA32F) {
+			image.write(0, 0, width, height, "RGBA", Magick::FloatPixel, data.data());
+			return;
+		}
+
+		std::vector<float> rgba(width * height * 4);
+		image.write(0, 0, width, height, "RGBA", Magick::FloatPixel, rgba.data());
+		ConvertPixels(rgba.data(), PixelLayout::RGBA, 1.0f, data.data(), format, width * height);
+	}
+
+	// Biggest DCT scaling denominator (8, 4, 2 or 1) that still has enough pixels to fill the target without upscaling
+	int PickJPEGScaleDenominator(int width, int height, int targetWidth, int targetHeight) {
+		if (targetWidth <= 0 || targetHeight <= 0 || width <= 0 || height <= 0)
+			return 1;
+
+		// The image might get rotated by its EXIF orientation after decoding so it has to fit either way round
+		float fitScale = std::max(
+			std::min((float)targetWidth / width, (float)targetHeight / height),
+			std::min((float)targetWidth / height, (float)targetHeight / width)
+		);
+
+		for (int denominator = 8; denominator > 1; denominator /= 2) {
+			if (1.0f / denominator >= fitScale)
+				return denominator;
+		}
+
+		return 1;
+	}
+
+	// libjpeg-turbo can skip most of the IDCT work when it only has to produce a fraction of the resolution, ImageMagick uses that when given a size hint
+	bool DecodeJPEGReduced(const unsigned char* bytes, size_t length, int denominator, DecodedImage& decoded) {
+		try {
+			int width = (decoded.fullWidth + denominator - 1) / denominator;
+			int height = (decoded.fullHeight + denominator - 1) / denominator;
+
+			Magick::Blob blob(bytes, length);
+			Magick::Image image;
+			image.read(blob, Magick::Geometry(width, height));
+
+			// libjpeg only ever gives 8 bits
+			decoded.format = PickMagickPixelFormat(image, false);
+			ExportMagickPixels(image, decoded.format, decoded.data);
+
+			decoded.width = image.columns();
+			decoded.height = image.rows();
+
+			return true;
+		} catch (std::exception& exception) {
+			std::cout << "FAILED TO DECODE REDUCED JPEG: " << exception.what() << std::endl;
+			decoded.data.clear();
+			return false;
+		}
+	}
+
+	// Decodes a JPEG, PNG, BMP or TGA that is already in memory
+	bool DecodeMemoryNative(const unsigned char* bytes, size_t length, NativeImageFormat format, DecodedImage& decoded, const DecodeOptions& options) {
+		if (format == NativeImageFormat::JPEG && stbi_info_from_memory(bytes, length, &decoded.fullWidth, &decoded.fullHeight, nullptr)) {
+			int denominator = PickJPEGScaleDenominator(decoded.fullWidth, decoded.fullHeight, options.targetWidth, options.targetHeight);
+
+			if (denominator > 1 && DecodeJPEGReduced(bytes, length, denominator, decoded))
+				return true;
+		}
+
+		int width = 0;
+		int height = 0;
+		int components = 0;
+
+		// Pixels are kept in whatever channels the file has, gray stays gray and only RGB has to be padded out to RGBA since GPUs don't like 3 byte texels
+		// 16 bit PNGs keep their precision
+		auto StorePixels = [&](auto* data, PixelFormat gray, PixelFormat grayAlpha, PixelFormat rgba) {
+			PixelLayout layout = GetStbPixelLayout(components);
+			size_t pixelCount = (size_t)width * height;
+
+			decoded.format = layout == PixelLayout::Gray ? gray : (layout == PixelLayout::GrayAlpha ? grayAlpha : rgba);
+			decoded.data.resize(pixelCount * GetPixelFormatSize(decoded.format));
+
+			if (layout == PixelLayout::RGB) {
+				ConvertPixels(data, layout, decoded.data.data(), decoded.format, pixelCount);
+			} else {
+				memcpy(decoded.data.data(), data, decoded.data.size());
+			}
+
+			stbi_image_free(data);
+		};
+
+		if (stbi_is_16_bit_from_memory(bytes, length)) {
+			unsigned short* data = stbi_load_16_from_memory(bytes, length, &width, &height, &components, 0);
+
+			if (data == nullptr)
+				return false;
+
+			StorePixels(data, PixelFormat::R16, PixelFormat::RG16, PixelFormat::RGBA16);
+		} else {
+			unsigned char* data = stbi_load_from_memory(bytes, length, &width, &height, &components, 0);
+
+			if (data == nullptr)
+				return false;
+
+			StorePixels(data, PixelFormat::R8, PixelFormat::RG8, PixelFormat::RGBA8);
+		}
+
+		decoded.width = width;
+		decoded.height = height;
+		decoded.fullWidth = width;
+		decoded.fullHeight = height;
+
+		return true;
+	}
+
+	struct EmbeddedJPEG {
+		size_t offset;
+		size_t length;
+		int width;
+		int height;
+	};
+
+	void AddEmbeddedJPEG(const std::vector<unsigned char>& bytes, uint64_t offset, uint64_t length, std::vector<EmbeddedJPEG>& found) {
+		if (offset == 0 || length < 4 || offset > bytes.size() || bytes.size() - offset < length)
+			return;
+
+		const unsigned char* jpeg = bytes.data() + offset;
+
+		if (jpeg[0] != 0xFF || jpeg[1] != 0xD8)
+			return;
+
+		// Also filters out lossless JPEG, which is what the RAW data itself is stored as in e.g CR2
+		int width = 0;
+		int height = 0;
+
+		if (!stbi_info_from_memory(jpeg, length, &width, &height, nullptr))
+			return;
+
+		found.push_back({ (size_t)offset, (size_t)length, width, height });
+	}
+
+	// Previews are either pointed to by JPEGInterchangeFormat or stored as a single JPEG compressed strip, possibly in a sub IFD
+	void FindTiffEmbeddedJPEGs(TiffParser& tiff, const std::vector<unsigned char>& bytes, uint64_t offset, int depth, std::unordered_set<uint64_t>& visited, std::vector<EmbeddedJPEG>& found) {
+		while (offset != 0 && depth < 8 && visited.insert(offset).second) {
+			TiffDirectory directory;
+
+			if (!tiff.ReadDirectory(offset, directory))
+				return;
+
+			AddEmbeddedJPEG(bytes, tiff.GetValue(directory, TIFF_TAG_JPEG_INTERCHANGE_FORMAT), tiff.GetValue(directory, TIFF_TAG_JPEG_INTERCHANGE_FORMAT_LENGTH), found);
+
+			uint64_t compression = tiff.GetValue(directory, TIFF_TAG_COMPRESSION);
+			std::vector<uint64_t> stripOffsets;
+			std::vector<uint64_t> stripByteCounts;
+
+			if ((compression == 6 || compression == 7) && tiff.GetValues(directory, TIFF_TAG_STRIP_OFFSETS, stripOffsets) && tiff.GetValues(directory, TIFF_TAG_STRIP_BYTE_COUNTS, stripByteCounts)) {
+				if (stripOffsets.size() == 1 && stripByteCounts.size() == 1)
+					AddEmbeddedJPEG(bytes, stripOffsets[0], stripByteCounts[0], found);
+			}
+
+			std::vector<uint64_t> subDirectories;
+
+			if (tiff.GetValues(directory, TIFF_TAG_SUB_IFDS, subDirectories)) {
+				for (uint64_t subDirectory : subDirectories) {
+					FindTiffEmbeddedJPEGs(tiff, bytes, subDirectory, depth + 1, visited, found);
+				}
+			}
+
+			offset = directory.nextOffset;
+			depth++;
+		}
+	}
+
+	// Part of a file, fewer bytes than asked for if it ends first
+	bool ReadFileRange(const std::filesystem::path& path, uint64_t offset, size_t length, std::vector<unsigned char>& bytes) {
+		std::ifstream input(path, std::ios::in | std::ios::binary);
+
+		if (!input.is_open())
+			return false;
+
+		bytes.resize(length);
+		input.seekg(offset);
+		input.read((char*)bytes.data(), length);
+		bytes.resize((size_t)input.gcount());
+
+		return !bytes.empty();
+	}
+
+	// Thumbnails are in IFD1 of the EXIF data, RAW files can have more in sub IFDs
+	void FindExifThumbnails(TiffParser& tiff, uint64_t offset, int depth, std::unordered_set<uint64_t>& visited, std::vector<std::pair<uint64_t, uint64_t>>& found) {
+		while (offset != 0 && depth < 8 && visited.insert(offset).second) {
+			TiffDirectory directory;
+
+			if (!tiff.ReadDirectory(offset, directory))
+				return;
+
+			uint64_t jpegOffset = tiff.GetValue(directory, TIFF_TAG_JPEG_INTERCHANGE_FORMAT);
+			uint64_t jpegLength = tiff.GetValue(directory, TIFF_TAG_JPEG_INTERCHANGE_FORMAT_LENGTH);
+
+			if (jpegOffset != 0 && jpegLength >= 4 && jpegLength <= EXIF_THUMBNAIL_MAX_LENGTH)
+				found.push_back({ jpegOffset, jpegLength });
+
+			std::vector<uint64_t> subDirectories;
+
+			if (tiff.GetValues(directory, TIFF_TAG_SUB_IFDS, subDirectories)) {
+				for (uint64_t subDirectory : subDirectories) {
+					FindExifThumbnails(tiff, subDirectory, depth + 1, visited, found);
+				}
+			}
+
+			offset = directory.nextOffset;
+			depth++;
+		}
+	}
+
+	// Cameras often letterbox a 3:2 photo into a 4:3 thumbnail, cropping back to the photo's shape gets rid of the bars
+	void CropToAspectRatio(DecodedImage& decoded, int aspectWidth, int aspectHeight) {
+		if (aspectWidth <= 0 || aspectHeight <= 0)
+			return;
+
+		float aspect = (float)aspectWidth / aspectHeight;
+		int width = std::clamp((int)std::lround(decoded.height * aspect), 1, decoded.width);
+		int height = std::clamp((int)std::lround(decoded.width / aspect), 1, decoded.height);
+
+		if (width < decoded.width - 2) {
+			height = decoded.height;
+		} else if (height < decoded.height - 2) {
+			width = decoded.width;
+		} else {
+			return;
+		}
+
+		size_t pixelSize = GetPixelFormatSize(decoded.format);
+		int left = (decoded.width - width) / 2;
+		int top = (decoded.height - height) / 2;
+		std::vector<unsigned char> cropped((size_t)width * height * pixelSize);
+
+		for (int y = 0; y < height; y++) {
+			memcpy(&cropped[(size_t)y * width * pixelSize], &decoded.data[((size_t)(top + y) * decoded.width + left) * pixelSize], width * pixelSize);
+		}
+
+		decoded.data.swap(cropped);
+		decoded.width = width;
+		decoded.height = height;
+	}
+
+	// The smallest EXIF thumbnail that's at least minimumSize on its longest side, without reading the whole file
+	bool DecodeExifThumbnail(const std::filesystem::path& path, int minimumSize, DecodedImage& decoded) {
+		std::vector<unsigned char> head;
+
+		if (!ReadFileRange(path, 0, EXIF_THUMBNAIL_HEAD_SIZE, head) || head.size() < 8)
+			return false;
+
+		// JPEGs have their EXIF data in an APP1 segment before the image, TIFF based RAW files are EXIF data from the start
+		size_t tiffStart = 0;
+		size_t tiffLength = head.size();
+
+		if (head[0] == 0xFF && head[1] == 0xD8) {
+			size_t offset = 2;
+			tiffLength = 0;
+
+			while (offset + 4 <= head.size() && head[offset] == 0xFF) {
+				unsigned char marker = head[offset + 1];
+				size_t length = (head[offset + 2] << 8) | head[offset + 3];
+
+				if (marker == 0xD9 || marker == 0xDA) // Reached the image, so there's no EXIF
+					break;
+
+				if (marker == 0xE1 && length >= 8 && offset + 10 <= head.size() && memcmp(&head[offset + 4], "Exif\0\0", 6) == 0) {
+					tiffStart = offset + 10;
+					tiffLength = std::min(length - 8, head.size() - tiffStart);
+					break;
+				}
+
+				offset += 2 + length;
+			}
+
+			if (tiffLength == 0)
+				return false;
+		}
+
+		TiffParser tiff;
+
+		if (!tiff.Open(head.data() + tiffStart, tiffLength))
+			return false;
+
+		std::unordered_set<uint64_t> visited;
+		std::vector<std::pair<uint64_t, uint64_t>> found;
+		FindExifThumbnails(tiff, tiff.GetFirstDirectoryOffset(), 0, visited, found);
+
+		// Size of the photo itself, so letterboxing can be cropped off
+		int photoWidth = 0;
+		int photoHeight = 0;
+		TiffDirectory firstDirectory;
+		TiffDirectory exifDirectory;
+
+		if (tiff.ReadDirectory(tiff.GetFirstDirectoryOffset(), firstDirectory) && tiff.ReadDirectory(tiff.GetValue(firstDirectory, TIFF_TAG_EXIF_IFD), exifDirectory)) {
+			photoWidth = (int)tiff.GetValue(exifDirectory, TIFF_TAG_PIXEL_X_DIMENSION);
+			photoHeight = (int)tiff.GetValue(exifDirectory, TIFF_TAG_PIXEL_Y_DIMENSION);
+		}
+
+		// Smallest first, the first one big enough wins
+		std::sort(found.begin(), found.end(), [](const std::pair<uint64_t, uint64_t>& a, const std::pair<uint64_t, uint64_t>& b) {
+			return a.second < b.second;
+		});
+
+		for (const std::pair<uint64_t, uint64_t>& thumbnail : found) {
+			std::vector<unsigned char> outside;
+			const unsigned char* jpeg;
+			size_t length = (size_t)thumbnail.second;
+
+			// Usually already read, RAW files can keep theirs further in
+			if (thumbnail.first <= tiffLength && length <= tiffLength - thumbnail.first) {
+				jpeg = head.data() + tiffStart + thumbnail.first;
+			} else {
+				if (!ReadFileRange(path, tiffStart + thumbnail.first, length, outside) || outside.size() != length)
+					continue;
+
+				jpeg = outside.data();
+			}
+
+			int width = 0;
+			int height = 0;
+
+			if (jpeg[0] != 0xFF || jpeg[1] != 0xD8 || !stbi_info_from_memory(jpeg, (int)length, &width, &height, nullptr))
+				continue;
+
+			if (std::max(width, height) < minimumSize)
+				continue;
+
+			ResetDecodedImage(path, decoded);
+
+			if (!DecodeMemoryNative(jpeg, length, NativeImageFormat::JPEG, decoded, DecodeOptions()))
+				continue;
+
+			CropToAspectRatio(decoded, photoWidth, photoHeight);
+
+			decoded.useTonemapping = false;
+			decoded.isEmbeddedPreview = true;
+
+			if (photoWidth > 0 && photoHeight > 0) {
+				decoded.fullWidth = photoWidth;
+				decoded.fullHeight = photoHeight;
+			}
+
+			return true;
+		}
+
+		return false;
+	}
+
+	// Returns false if there isn't a preview big enough to be worth showing
+	bool FindRawEmbeddedPreview(const std::vector<unsigned char>& bytes, size_t& offset, size_t& length) {
+		std::vector<EmbeddedJPEG> found;
+
+		if (bytes.size() >= 92 && memcmp(bytes.data(), "FUJIFILMCCD-RAW ", 16) == 0) {
+			// Fujifilm RAF has its own header with the offset and length of the preview in it
+			auto ReadBigEndian = [&](size_t at) {
+				return ((uint32_t)bytes[at] << 24) | (bytes[at + 1] << 16) | (bytes[at + 2] << 8) | bytes[at + 3];
+			};
+
+			AddEmbeddedJPEG(bytes, ReadBigEndian(84), ReadBigEndian(88), found);
+		} else {
+			TiffParser tiff;
+
+			if (!tiff.Open(bytes.data(), bytes.size()))
+				return false;
+
+			std::unordered_set<uint64_t> visited;
+			FindTiffEmbeddedJPEGs(tiff, bytes, tiff.GetFirstDirectoryOffset(), 0, visited, found);
+		}
+
+		// Biggest one wins, the others are usually tiny thumbnails
+		auto best = std::max_element(found.begin(), found.end(), [](const EmbeddedJPEG& a, const EmbeddedJPEG& b) {
+			return (size_t)a.width * a.height < (size_t)b.width * b.height;
+		});
+
+		if (best == found.end() || std::max(best->width, best->height) < RAW_PREVIEW_MIN_SIZE)
+			return false;
+
+		offset = best->offset;
+		length = best->length;
+
+		return true;
+	}
+
+	bool DecodeImageFile(const std::filesystem::path& path, DecodedImage& decoded, const std::atomic<bool>* cancelled, const DecodeOptions& options) {
+		if (DecodeImageFileNative(path, decoded, cancelled, options))
+			return true;
+
+		if (cancelled != nullptr && cancelled->load())
+			return false;
+
+		return DecodeImageFileMagick(path, decoded, cancelled);
+	}
+
+	bool DecodeImageFileNative(const std::filesystem::path& path, DecodedImage& decoded, const std::atomic<bool>* cancelled, const DecodeOptions& options) {
+		std::string extension = path.extension().string();
+		LowerString(extension);
+
+		bool isRaw = RAW_IMAGE_EXTENSIONS.contains(extension);
+
+		if (isRaw && !options.allowEmbeddedPreview)
+			return false;
+
+		if (options.allowExifThumbnail && DecodeExifThumbnail(path, std::max(options.targetWidth, options.targetHeight), decoded))
+			return !(cancelled != nullptr && cancelled->load());
+
+		// Huge TIFFs only get their header read here, the pixels are read from the file while it's being looked at
+		// Any other TIFF that can be read a tile or strip at a time gets all of them decoded at once across every core
+		if (extension == ".tif" || extension == ".tiff") {
+			std::shared_ptr<TiffTileSource> source = std::make_shared<TiffTileSource>();
+
+			if (source->Open(path)) {
+				ResetDecodedImage(path, decoded);
+
+				decoded.width = source->GetWidth();
+				decoded.height = source->GetHeight();
+				decoded.fullWidth = decoded.width;
+				decoded.fullHeight = decoded.height;
+				decoded.format = source->GetFormat();
+
+				if (std::max(decoded.width, decoded.height) >= TIFF_REGION_DECODE_MIN_SIZE) {
+					decoded.tileSource = source;
+					return true;
+				}
+
+				return source->ReadImage(decoded.data, cancelled);
+			}
+		}
+
+		std::vector<unsigned char> bytes;
+
+		if (!ReadFileBytes(path, bytes))
+			return false;
+
+		if (isRaw) {
+			size_t previewOffset = 0;
+			size_t previewLength = 0;
+
+			if (!FindRawEmbeddedPreview(bytes, previewOffset, previewLength))
+				return false;
+
+			ResetDecodedImage(path, decoded);
+
+			if (!DecodeMemoryNative(bytes.data() + previewOffset, previewLength, NativeImageFormat::JPEG, decoded, options))
+				return false;
+
+			// Already developed so it shouldn't be tonemapped like the linear RAW data would be
+			decoded.useTonemapping = false;
+			decoded.isEmbeddedPreview = true;
+
+			return !(cancelled != nullptr && cancelled->load());
+		}
+
+		// GIF, APNG and animated WebP only get their first frame decoded here
+		if (DetectAnimationFormat(bytes) != AnimationFormat::None) {
+			ResetDecodedImage(path, decoded);
+
+			if (!DecodeAnimationFirstFrame(path, std::move(bytes), decoded))
+				return false;
+
+			return !(cancelled != nullptr && cancelled->load());
+		}
+
+		NativeImageFormat format = DetectNativeImageFormat(bytes, extension);
+
+		if (format == NativeImageFormat::None)
+			return false;
+
+		ResetDecodedImage(path, decoded);
+
+		if (!DecodeMemoryNative(bytes.data(), bytes.size(), format, decoded, options))
+			return false;
+
+		return !(cancelled != nullptr && cancelled->load());
+	}
+
+	bool DecodeImageFileMagick(const std::filesystem::path& path, DecodedImage& decoded, const std::atomic<bool>* cancelled) {
+		auto WasCancelled = [&]() {
+			return cancelled != nullptr && cancelled->load();
+		};
+
+		if (!std::filesystem::exists(path))
+			return false;
+
+		ResetDecodedImage(path, decoded);
+
+		try {
+			std::list<Magick::Image> imageList;
+			Magick::readImages(&imageList, PathToUTF8String(path));
+
+			if (imageList.empty() || WasCancelled())
+				return false;
+
+			Magick::Image* frontImage = &imageList.front();
+
+			int width = frontImage->size().width();
+			int height = frontImage->size().height();
+
+			// Every frame shares the format of the first one
+			decoded.format = PickMagickPixelFormat(*frontImage, decoded.useTonemapping);
+
+			if (imageList.size() == 1) { // Single, static image
+				ExportMagickPixels(*frontImage, decoded.format, decoded.data);
+			} else if (imageList.size() > 1) {
+				Magick::coalesceImages(&imageList, imageList.begin(), imageList.end()); // For when GIFs have page offsets
+
+				// Animated image, probably GIF
+				for (auto& image : imageList) {
+					if (WasCancelled())
+						return false;
+
+					DecodedImageFrame frame;
+					ExportMagickPixels(image, decoded.format, frame.data);
+					frame.delay = image.animationDelay();
+
+					decoded.frames.push_back(std::move(frame));
+				}
+			}
+
+			decoded.width = width;
+			decoded.height = height;
+			decoded.fullWidth = width;
+			decoded.fullHeight = height;
+
+			return !WasCancelled();
+		} catch (std::exception& exception) {
+			std::cout << "FAILED TO LOAD IMAGE: " << exception.what() << std::endl;
+			return false;
+		}
+	}
+}
\ No newline at end of file
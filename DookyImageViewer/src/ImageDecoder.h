@@ -0,0 +1,70 @@
+#ifndef IMAGEDECODER_H
+#define IMAGEDECODER_H
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <filesystem>
+
+#include "PixelConversion.h"
+
+namespace Magick {
+	class Image;
+}
+
+namespace Dooky {
+	class TileSource;
+
+	struct DecodedImageFrame {
+		std::vector<unsigned char> data; // Same format as the image it belongs to, or 8 bit palette indices if there is a palette
+		std::vector<unsigned char> palette; // 256 RGBA8 colours, empty unless the frame is indexed
+		int delay; // In centiseconds
+	};
+
+	// Everything needed to display an image, decoded on the CPU without touching OpenGL so that it can be done on any thread
+	struct DecodedImage {
+		std::filesystem::path path;
+		int width; // Resolution of the pixel data
+		int height;
+		int fullWidth; // Resolution of the image itself, bigger than width and height if it was decoded at a reduced resolution
+		int fullHeight;
+		bool useTonemapping;
+		bool isEmbeddedPreview; // The JPEG preview inside of a RAW file was decoded instead of the RAW data
+		bool isAnimated; // Only the first frame is in data, the rest gets decoded while it plays so long animations don't have to fit in memory
+
+		PixelFormat format; // Kept as close to the file as possible, an 8 bit grayscale JPEG has no business taking up 16 bytes per pixel
+		std::vector<unsigned char> data; // Used by static images
+		std::vector<DecodedImageFrame> frames; // Used by animated images, e.g GIF
+		std::shared_ptr<TileSource> tileSource; // Used instead of data by images too big to decode all at once, pixels get read from the file as they're looked at
+	};
+
+	// Ways DecodeImageFile is allowed to cut corners to get something on screen sooner, by default it doesn't
+	struct DecodeOptions {
+		int targetWidth = 0; // If given then JPEGs may be decoded at 1/2, 1/4 or 1/8 resolution as long as fitting the image into the target doesn't have to upscale it
+		int targetHeight = 0;
+		bool allowEmbeddedPreview = false; // RAW files can show the JPEG preview embedded in them instead of being demosaiced, which takes seconds
+		bool allowExifThumbnail = false; // The tiny JPEG thumbnail cameras put in EXIF is used if it can fill the target, only the start of the file gets read
+	};
+
+	size_t GetDecodedImageSize(const DecodedImage& decoded); // In bytes
+	bool IsReducedResolution(const DecodedImage& decoded);
+	bool IsPreview(const DecodedImage& decoded); // Either reduced resolution or an embedded preview, decoding again without any options gets the real thing
+	bool IsRawImageFile(const std::filesystem::path& path); // By extension
+	bool ReadFileBytes(const std::filesystem::path& path, std::vector<unsigned char>& bytes);
+
+	// Thread safe, if cancelled is set while decoding then it gives up as soon as it can and returns false
+	// Common formats go through stb_image and everything else (or anything stb_image can't handle) through ImageMagick
+	bool DecodeImageFile(const std::filesystem::path& path, DecodedImage& decoded, const std::atomic<bool>* cancelled = nullptr, const DecodeOptions& options = DecodeOptions());
+
+	// Picks the smallest format that doesn't lose anything the image has, tonemapped images get half floats so they can go above 1
+	PixelFormat PickMagickPixelFormat(Magick::Image& image, bool useTonemapping);
+
+	// Reads the pixels of an already decoded image straight into the given format in one pass
+	void ExportMagickPixels(Magick::Image& image, PixelFormat format, std::vector<unsigned char>& data);
+
+	// The two paths DecodeImageFile picks between, exposed for benchmarking
+	bool DecodeImageFileNative(const std::filesystem::path& path, DecodedImage& decoded, const std::atomic<bool>* cancelled = nullptr, const DecodeOptions& options = DecodeOptions()); // Returns false straight away if the format isn't supported
+	bool DecodeImageFileMagick(const std::filesystem::path& path, DecodedImage& decoded, const std::atomic<bool>* cancelled = nullptr);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include "ImageLoader.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace Dooky {
+	////////////////////////////////////////
+	///// CLASS: IMAGE LOADER
+	////////////////////////////////////////
+
+	ImageLoader::ImageLoader(int threadCount) {
+		shouldStop = false;
+		nextRequestId = 0;
+
+		if (threadCount < 1)
+			threadCount = 1;
+
+		for (int i = 0; i < threadCount; i++) {
+			workers.emplace_back(&ImageLoader::WorkerLoop, this);
+		}
+	}
+
+	ImageLoader::~ImageLoader() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			shouldStop = true;
+
+			// Whatever is still being decoded should give up as soon as possible
+			for (LoadRequest& request : activeRequests) {
+				request.cancelled->store(true);
+			}
+
+			pendingRequests.clear();
+		}
+
+		condition.notify_all();
+
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+	}
+
+	////////////////////////////////////////
+	///// PRIVATE
+	////////////////////////////////////////
+
+	void ImageLoader::WorkerLoop() {
+		while (true) {
+			LoadRequest request;
+
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [&]() { return shouldStop || !pendingRequests.empty(); });
+
+				if (shouldStop)
+					return;
+
+				// Take the most urgent request, the oldest one wins if they are equally urgent
+				auto next = std::min_element(pendingRequests.begin(), pendingRequests.end(), [](const LoadRequest& a, const LoadRequest& b) {
+					return a.priority < b.priority;
+				});
+
+				request = *next;
+				pendingRequests.erase(next);
+				activeRequests.push_back(request);
+			}
+
+			ImageLoadResult result;
+			result.requestId = request.requestId;
+			result.listIndex = request.listIndex;
+			result.path = request.path;
+			result.image = std::make_shared<DecodedImage>();
+
+			auto t1 = std::chrono::steady_clock::now();
+			result.success = DecodeImageFile(request.path, *result.image, request.cancelled.get(), request.options);
+			auto t2 = std::chrono::steady_clock::now();
+
+			result.decodeTime = std::chrono::duration<float>(t2 - t1).count();
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				activeRequests.erase(std::remove_if(activeRequests.begin(), activeRequests.end(), [&](const LoadRequest& r) {
+					return r.requestId == request.requestId;
+				}), activeRequests.end());
+
+				if (!request.cancelled->load())
+					finishedResults.push_back(std::move(result));
+			}
+		}
+	}
+
+	////////////////////////////////////////
+	///// PUBLIC
+	////////////////////////////////////////
+
+	int ImageLoader::Request(const std::filesystem::path& path, int listIndex, int priority, const DecodeOptions& options) {
+		int requestId;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			requestId = nextRequestId++;
+
+			LoadRequest request;
+			request.requestId = requestId;
+			request.listIndex = listIndex;
+			request.priority = priority;
+			request.options = options;
+			request.path = path;
+			request.cancelled = std::make_shared<std::atomic<bool>>(false);
+
+			pendingRequests.push_back(request);
+		}
+
+		condition.notify_one();
+
+		return requestId;
+	}
+
+	void ImageLoader::SetPriority(int requestId, int priority) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (LoadRequest& request : pendingRequests) {
+			if (request.requestId == requestId)
+				request.priority = priority;
+		}
+	}
+
+	void ImageLoader::Cancel(int requestId) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		pendingRequests.erase(std::remove_if(pendingRequests.begin(), pendingRequests.end(), [&](const LoadRequest& r) {
+			return r.requestId == requestId;
+		}), pendingRequests.end());
+
+		for (LoadRequest& request : activeRequests) {
+			if (request.requestId == requestId)
+				request.cancelled->store(true);
+		}
+
+		finishedResults.erase(std::remove_if(finishedResults.begin(), finishedResults.end(), [&](const ImageLoadResult& r) {
+			return r.requestId == requestId;
+		}), finishedResults.end());
+	}
+
+	std::vector<ImageLoadResult> ImageLoader::PollFinished() {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		std::vector<ImageLoadResult> results;
+		results.swap(finishedResults);
+
+		return results;
+	}
+}
\ No newline at end of file
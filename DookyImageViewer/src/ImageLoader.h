@@ -0,0 +1,60 @@
+#ifndef IMAGELOADER_H
+#define IMAGELOADER_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <filesystem>
+
+#include "ImageDecoder.h"
+
+namespace Dooky {
+	struct ImageLoadResult {
+		int requestId;
+		int listIndex; // Index into the browsing list the request was made for
+		std::filesystem::path path;
+		bool success;
+		float decodeTime; // In seconds
+		std::shared_ptr<DecodedImage> image;
+	};
+
+	// Decodes images on worker threads so the render loop never has to wait for ImageMagick
+	class ImageLoader {
+	private:
+		struct LoadRequest {
+			int requestId;
+			int listIndex;
+			int priority; // Lower gets decoded first
+			DecodeOptions options;
+			std::filesystem::path path;
+			std::shared_ptr<std::atomic<bool>> cancelled;
+		};
+
+		std::vector<std::thread> workers;
+		std::deque<LoadRequest> pendingRequests;
+		std::vector<LoadRequest> activeRequests; // Requests currently being decoded by a worker
+		std::vector<ImageLoadResult> finishedResults;
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool shouldStop;
+		int nextRequestId;
+
+		void WorkerLoop();
+	public:
+		ImageLoader(int threadCount = 2);
+		~ImageLoader();
+
+		int Request(const std::filesystem::path& path, int listIndex, int priority = 0, const DecodeOptions& options = DecodeOptions()); // Returns the request id
+		void SetPriority(int requestId, int priority); // Only has an effect if the request hasn't been picked up by a worker yet
+		void Cancel(int requestId);
+
+		std::vector<ImageLoadResult> PollFinished(); // Call on the main thread, cancelled requests are never returned
+	};
+}
+
+#endif
\ No newline at end of file
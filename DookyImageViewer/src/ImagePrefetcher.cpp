@@ -0,0 +1,316 @@
+#include "ImagePrefetcher.h"
+
+#include <cmath>
+#include <algorithm>
+#include <unordered_set>
+#include <Windows.h>
+
+int PREFETCH_MAX_AHEAD = 8;
+int PREFETCH_MAX_BEHIND = 2;
+float PREFETCH_MEMORY_FRACTION = 0.25f; // How much of the available physical memory prefetched images may use, on top of the cache budget
+
+size_t GetAvailablePhysicalMemory() {
+	MEMORYSTATUSEX status;
+	status.dwLength = sizeof(status);
+
+	if (GlobalMemoryStatusEx(&status))
+		return status.ullAvailPhys;
+
+	return 0;
+}
+
+namespace Dooky {
+	////////////////////////////////////////
+	///// CLASS: IMAGE PREFETCHER
+	////////////////////////////////////////
+
+	ImagePrefetcher::ImagePrefetcher(ImageLoader& loader, ImageCache& cache) : loader(loader), cache(cache) {
+		currentIndex = 0;
+		step = 1;
+
+		decodeOptions.allowEmbeddedPreview = true;
+
+		fullResolutionRequestId = -1;
+		fullResolutionFailed = false;
+
+		lastNavigateTime = std::chrono::steady_clock::now();
+		averageBrowseInterval = 1.0f;
+		averageDecodeTime = 0.0f;
+		averageDecodedBytes = 0.0;
+
+		aheadDepth = 1;
+		behindDepth = 1;
+	}
+
+	////////////////////////////////////////
+	///// PRIVATE
+	////////////////////////////////////////
+
+	void ImagePrefetcher::UpdateDepth() {
+		int maxByMemory = PREFETCH_MAX_AHEAD + PREFETCH_MAX_BEHIND;
+		double memory = cache.GetBudget(); // Prefetching more than the cache holds would just evict what was prefetched
+		size_t availableMemory = GetAvailablePhysicalMemory();
+
+		if (availableMemory > 0)
+			memory = std::min(memory, availableMemory * (double)PREFETCH_MEMORY_FRACTION);
+
+		if (averageDecodedBytes > 0.0)
+			maxByMemory = (int)(memory / averageDecodedBytes);
+
+		// Enough images have to be decoding at once to hide the decode time at the speed the user is browsing
+		int neededAhead = 1 + (int)ceilf(averageDecodeTime / std::max(averageBrowseInterval, 0.05f));
+
+		aheadDepth = std::clamp(neededAhead, 1, PREFETCH_MAX_AHEAD);
+		aheadDepth = std::min(aheadDepth, std::max(maxByMemory, 0));
+		behindDepth = std::clamp(maxByMemory - aheadDepth, 0, PREFETCH_MAX_BEHIND);
+	}
+
+	void ImagePrefetcher::Schedule() {
+		if (browsingList.empty())
+			return;
+
+		int listSize = browsingList.size();
+
+		// Same wrapping rules as browsing with the arrow keys
+		auto Advance = [listSize](int index, int amount) {
+			index += amount;
+
+			if (index >= listSize) index = 0;
+			if (index < 0) index = listSize - 1;
+
+			return index;
+		};
+
+		struct WantedImage {
+			int index;
+			int priority;
+		};
+
+		std::vector<WantedImage> wantedImages;
+		wantedImages.push_back({ currentIndex, 0 });
+
+		int index = currentIndex;
+
+		for (int i = 1; i <= aheadDepth; i++) {
+			index = Advance(index, step);
+			wantedImages.push_back({ index, i });
+		}
+
+		index = currentIndex;
+
+		for (int i = 1; i <= behindDepth; i++) {
+			index = Advance(index, -step);
+			wantedImages.push_back({ index, i * 2 }); // Going backwards is less likely than going forwards
+		}
+
+		// Request whatever isn't already decoded or decoding
+		std::unordered_set<std::wstring> wantedPaths;
+
+		for (WantedImage& wanted : wantedImages) {
+			const std::filesystem::path& path = browsingList[wanted.index];
+			std::wstring key = path.wstring();
+
+			if (!wantedPaths.insert(key).second) // Small lists wrap around onto themselves
+				continue;
+
+			if (failedPaths.contains(key) || uncachedImages.contains(key) || cache.Contains(path))
+				continue;
+
+			auto found = requestIds.find(key);
+
+			if (found != requestIds.end()) {
+				loader.SetPriority(found->second, wanted.priority);
+			} else {
+				requestIds[key] = loader.Request(path, wanted.index, wanted.priority, decodeOptions);
+			}
+		}
+
+		// Forget everything that is outside of the window
+		for (auto it = requestIds.begin(); it != requestIds.end();) {
+			if (!wantedPaths.contains(it->first)) {
+				loader.Cancel(it->second);
+				it = requestIds.erase(it);
+			} else {
+				it++;
+			}
+		}
+
+		for (auto it = uncachedImages.begin(); it != uncachedImages.end();) {
+			if (!wantedPaths.contains(it->first)) {
+				it = uncachedImages.erase(it);
+			} else {
+				it++;
+			}
+		}
+
+		for (auto it = failedPaths.begin(); it != failedPaths.end();) {
+			if (!wantedPaths.contains(*it)) {
+				it = failedPaths.erase(it);
+			} else {
+				it++;
+			}
+		}
+
+		// Full resolution is only ever wanted for the current image
+		if (!fullResolutionPath.empty() && fullResolutionPath != browsingList[currentIndex].wstring())
+			ForgetFullResolution();
+	}
+
+	void ImagePrefetcher::ForgetFullResolution() {
+		if (fullResolutionRequestId >= 0)
+			loader.Cancel(fullResolutionRequestId);
+
+		fullResolutionPath.clear();
+		fullResolutionRequestId = -1;
+		fullResolutionFailed = false;
+		fullResolutionImage.reset();
+	}
+
+	////////////////////////////////////////
+	///// PUBLIC
+	////////////////////////////////////////
+
+	void ImagePrefetcher::SetBrowsingList(const std::vector<std::filesystem::path>& newBrowsingList) {
+		browsingList = newBrowsingList;
+
+		for (auto& request : requestIds) {
+			loader.Cancel(request.second);
+		}
+
+		requestIds.clear();
+		uncachedImages.clear();
+		failedPaths.clear();
+		ForgetFullResolution();
+
+		currentIndex = 0;
+		step = 1;
+	}
+
+	void ImagePrefetcher::Navigate(int index, int step) {
+		auto now = std::chrono::steady_clock::now();
+		float interval = std::min(std::chrono::duration<float>(now - lastNavigateTime).count(), 2.0f);
+
+		averageBrowseInterval = averageBrowseInterval * 0.7f + interval * 0.3f;
+		lastNavigateTime = now;
+
+		currentIndex = index;
+
+		if (step != 0)
+			this->step = step;
+
+		UpdateDepth();
+		Schedule();
+	}
+
+	void ImagePrefetcher::SetTargetSize(int width, int height) {
+		decodeOptions.targetWidth = width;
+		decodeOptions.targetHeight = height;
+	}
+
+	void ImagePrefetcher::HandleFinished(ImageLoadResult& result) {
+		std::wstring key = result.path.wstring();
+
+		if (result.requestId == fullResolutionRequestId) {
+			fullResolutionRequestId = -1;
+
+			if (result.success) {
+				fullResolutionImage = result.image;
+				cache.Insert(result.path, result.image); // Replaces the preview
+			} else {
+				fullResolutionFailed = true;
+			}
+
+			return;
+		}
+
+		auto found = requestIds.find(key);
+
+		if (found == requestIds.end() || found->second != result.requestId)
+			return; // Nobody is waiting for this one anymore
+
+		requestIds.erase(found);
+
+		if (result.success) {
+			size_t bytes = GetDecodedImageSize(*result.image);
+
+			if (averageDecodedBytes == 0.0) {
+				averageDecodeTime = result.decodeTime;
+				averageDecodedBytes = bytes;
+			} else {
+				averageDecodeTime = averageDecodeTime * 0.7f + result.decodeTime * 0.3f;
+				averageDecodedBytes = averageDecodedBytes * 0.7 + bytes * 0.3;
+			}
+		}
+
+		if (result.success) {
+			if (!cache.Insert(result.path, result.image))
+				uncachedImages[key] = result.image;
+		} else {
+			failedPaths.insert(key);
+		}
+
+		// The measurements changed so the window might have too
+		UpdateDepth();
+		Schedule();
+	}
+
+	bool ImagePrefetcher::GetFinished(const std::filesystem::path& path, std::shared_ptr<DecodedImage>& image) {
+		std::wstring key = path.wstring();
+
+		if (failedPaths.contains(key)) {
+			image = nullptr;
+			return true;
+		}
+
+		auto found = uncachedImages.find(key);
+
+		if (found != uncachedImages.end()) {
+			image = found->second;
+			return true;
+		}
+
+		image = cache.Peek(path);
+
+		return image != nullptr;
+	}
+
+	bool ImagePrefetcher::GetFullResolution(const std::filesystem::path& path, std::shared_ptr<DecodedImage>& image) {
+		std::wstring key = path.wstring();
+
+		// Might have been decoded at full resolution to begin with
+		std::shared_ptr<DecodedImage> cached = cache.Peek(path);
+
+		if (cached != nullptr && !IsPreview(*cached)) {
+			image = cached;
+			return true;
+		}
+
+		if (fullResolutionPath != key) {
+			ForgetFullResolution();
+
+			fullResolutionPath = key;
+			fullResolutionRequestId = loader.Request(path, currentIndex, -1); // Before anything that is only being prefetched
+		}
+
+		if (fullResolutionFailed) {
+			image = nullptr;
+			return true;
+		}
+
+		image = fullResolutionImage;
+
+		return image != nullptr;
+	}
+
+	bool ImagePrefetcher::IsDecodingFullResolution() {
+		return fullResolutionRequestId >= 0;
+	}
+
+	int ImagePrefetcher::GetAheadDepth() {
+		return aheadDepth;
+	}
+
+	int ImagePrefetcher::GetBehindDepth() {
+		return behindDepth;
+	}
+}
\ No newline at end of file
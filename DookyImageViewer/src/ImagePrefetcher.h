@@ -0,0 +1,65 @@
+#ifndef IMAGEPREFETCHER_H
+#define IMAGEPREFETCHER_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <filesystem>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ImageLoader.h"
+#include "ImageCache.h"
+
+namespace Dooky {
+	// Decodes the images around the current browsing list index ahead of time, in the direction the user is browsing
+	class ImagePrefetcher {
+	private:
+		ImageLoader& loader;
+		ImageCache& cache; // Where finished images end up
+
+		std::vector<std::filesystem::path> browsingList;
+		std::unordered_map<std::wstring, std::shared_ptr<DecodedImage>> uncachedImages; // Images in the window too big for the cache
+		std::unordered_set<std::wstring> failedPaths; // Images in the window that couldn't be decoded, so they aren't retried over and over
+		std::unordered_map<std::wstring, int> requestIds; // Requests that haven't finished yet, keyed by path
+
+		int currentIndex;
+		int step; // Signed, e.g -10 when going left with control held down
+
+		DecodeOptions decodeOptions; // Prefetched images only have to be good enough to show fit on screen
+
+		std::wstring fullResolutionPath; // The current image at full resolution, for when it was prefetched as a preview and then zoomed into
+		int fullResolutionRequestId; // -1 if not decoding
+		bool fullResolutionFailed;
+		std::shared_ptr<DecodedImage> fullResolutionImage;
+
+		std::chrono::steady_clock::time_point lastNavigateTime;
+		float averageBrowseInterval; // Seconds between each navigation
+		float averageDecodeTime; // Seconds
+		double averageDecodedBytes;
+
+		int aheadDepth;
+		int behindDepth;
+
+		void UpdateDepth();
+		void Schedule();
+		void ForgetFullResolution();
+	public:
+		ImagePrefetcher(ImageLoader& loader, ImageCache& cache);
+
+		void SetBrowsingList(const std::vector<std::filesystem::path>& newBrowsingList);
+		void Navigate(int index, int step); // Call every time the browsing list index changes, step is how far and in which direction it moved
+		void SetTargetSize(int width, int height); // Usually the area the image is shown in
+
+		void HandleFinished(ImageLoadResult& result);
+		bool GetFinished(const std::filesystem::path& path, std::shared_ptr<DecodedImage>& image); // Returns false if still decoding, image is null if decoding failed, doesn't count towards the cache statistics
+		bool GetFullResolution(const std::filesystem::path& path, std::shared_ptr<DecodedImage>& image); // Starts decoding at full resolution if it isn't already, same return values as GetFinished
+		bool IsDecodingFullResolution();
+
+		int GetAheadDepth();
+		int GetBehindDepth();
+	};
+}
+
+#endif
\ No newline at end of file
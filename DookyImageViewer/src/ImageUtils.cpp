@@ -1,121 +1,168 @@
 #include "ImageUtils.h"
 
-#include <iostream>
-#include <stdexcept>
-#include <string>
-#include <Windows.h>
-#include <thumbcache.h>
+#include <cmath>
+#include <algorithm>
 
-namespace Dooky {
-	FileThumbnailImage GetImageFileThumbnail(const std::filesystem::path& path, int targetSize) {
-		std::wstring convertedWideString = path.wstring();
-		std::replace(convertedWideString.begin(), convertedWideString.end(), '/', '\\');
-
-		FileThumbnailImage thumbnailImage;
-		thumbnailImage.width = 0;
-		thumbnailImage.height = 0;
-		
-		try {
-			HRESULT hr = CoInitialize(nullptr);
+#include "ImageDecoder.h"
+#include "TiledImage.h"
 
-			if (FAILED(hr)) throw std::runtime_error("Failed CoInitialize in LoadImageFile");
+namespace Dooky {
+	// Whichever pixels of the decoded image are quickest to shrink, TIFFs too big to decode come from the smallest pyramid level that
+	// is still at least targetSize and palette frames get expanded
+	bool GetThumbnailSourcePixels(const DecodedImage& decoded, int targetSize, const std::atomic<bool>* cancelled, std::vector<unsigned char>& pixels, int& width, int& height, PixelFormat& format) {
+		if (!decoded.data.empty()) {
+			pixels = decoded.data;
+			width = decoded.width;
+			height = decoded.height;
+			format = decoded.format;
+
+			return true;
+		}
 
-			IShellItem* item = nullptr;
-			hr = SHCreateItemFromParsingName(convertedWideString.c_str(), 0, IID_PPV_ARGS(&item));
+		if (!decoded.frames.empty()) {
+			const DecodedImageFrame& frame = decoded.frames[0];
 
-			if (FAILED(hr)) throw std::runtime_error("Failed SHCreateItemFromParsingName in LoadImageFile");
+			width = decoded.width;
+			height = decoded.height;
 
-			IThumbnailCache* cache = nullptr;
-			hr = CoCreateInstance(CLSID_LocalThumbnailCache, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&cache));
+			if (frame.palette.empty()) {
+				pixels = frame.data;
+				format = decoded.format;
+			} else {
+				pixels.resize((size_t)width * height * 4);
+				format = PixelFormat::RGBA8;
 
-			if (FAILED(hr)) throw std::runtime_error("Failed CoCreateInstance in LoadImageFile");
+				for (size_t i = 0; i < (size_t)width * height; i++) {
+					std::copy_n(&frame.palette[frame.data[i] * 4], 4, &pixels[i * 4]);
+				}
+			}
 
-			ISharedBitmap* shared_bitmap;
-			hr = cache->GetThumbnail(item, targetSize, WTS_EXTRACT | WTS_SCALETOREQUESTEDSIZE, &shared_bitmap, nullptr, nullptr);
+			return true;
+		}
 
-			if (FAILED(hr)) throw std::runtime_error("Failed GetThumbnail in LoadImageFile");
+		if (decoded.tileSource != nullptr) {
+			TileSource& source = *decoded.tileSource;
+			int level = 0;
 
-			HBITMAP hBitmap = NULL;
-			hr = shared_bitmap->GetSharedBitmap(&hBitmap);
+			while (level + 1 < source.GetLevelCount()) {
+				glm::ivec2 nextSize = source.GetLevelSize(level + 1);
 
-			if (FAILED(hr)) throw std::runtime_error("Failed GetSharedBitmap in LoadImageFile");
+				if (std::max(nextSize.x, nextSize.y) < targetSize)
+					break;
 
-			HDC dc = GetDC(NULL);
-			HDC dc_mem = CreateCompatibleDC(dc);
+				level++;
+			}
 
-			BITMAPINFO bmi;
-			ZeroMemory(&bmi, sizeof(BITMAPINFO));
-			bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-			GetDIBits(dc_mem, hBitmap, 0, 0, nullptr, &bmi, DIB_RGB_COLORS);
+			glm::ivec2 levelSize = source.GetLevelSize(level);
 
-			WTS_ALPHATYPE alpha_type;
-			hr = shared_bitmap->GetFormat(&alpha_type);
+			width = levelSize.x;
+			height = levelSize.y;
+			format = source.GetFormat();
 
-			if (FAILED(hr)) throw std::runtime_error("Failed GetFormat in LoadImageFile");
+			return source.ReadRegion(level, 0, 0, width, height, pixels, cancelled);
+		}
 
-			bmi.bmiHeader.biBitCount = alpha_type == WTSAT_RGB ? 24 : 32;
-			bmi.bmiHeader.biHeight = std::abs(bmi.bmiHeader.biHeight);
-			bmi.bmiHeader.biCompression = BI_RGB;
+		return false;
+	}
 
-			// Get Image Data
+	// Each thumbnail pixel averages whatever is under it
+	void FitPixelsToThumbnail(const unsigned char* pixels, int width, int height, PixelFormat format, int targetSize, bool sourceBottomRowFirst, FileThumbnailImage& thumbnailImage) {
+		float scale = std::min((float)targetSize / std::max(width, height), 1.0f);
+		int thumbnailWidth = std::max((int)std::lround(width * scale), 1);
+		int thumbnailHeight = std::max((int)std::lround(height * scale), 1);
+		size_t pixelSize = GetPixelFormatSize(format);
 
-			unsigned char* buffer = new unsigned char[bmi.bmiHeader.biSizeImage];
-			GetDIBits(dc_mem, hBitmap, 0, bmi.bmiHeader.biHeight, buffer, &bmi, DIB_RGB_COLORS);
+		thumbnailImage.bitmap.resize((size_t)thumbnailWidth * thumbnailHeight * 4);
 
-			int width = bmi.bmiHeader.biWidth;
-			int height = bmi.bmiHeader.biHeight;
-			int bitCount = bmi.bmiHeader.biBitCount;
-			int bytesPerPixel = bitCount / 8;
-			int stride = ((width * bytesPerPixel + 3) & ~3) % width;
+		for (int y = 0; y < thumbnailHeight; y++) {
+			int y0 = y * height / thumbnailHeight;
+			int y1 = std::max((y + 1) * height / thumbnailHeight, y0 + 1);
 
-			thumbnailImage.bitmap.resize(width * height * 4, 0);
+			// Bottom row first, so top down pixels get flipped
+			unsigned char* row = &thumbnailImage.bitmap[(size_t)(sourceBottomRowFirst ? y : thumbnailHeight - 1 - y) * thumbnailWidth * 4];
 
-			size_t bitmapIndex = 0;
+			for (int x = 0; x < thumbnailWidth; x++) {
+				int x0 = x * width / thumbnailWidth;
+				int x1 = std::max((x + 1) * width / thumbnailWidth, x0 + 1);
+				float sum[4] = {};
 
-			for (int y = 0; y < height; y++) {
-				for (int x = 0; x < width; x++) {
-					size_t index = y * width + x;
+				for (int sy = y0; sy < y1; sy++) {
+					for (int sx = x0; sx < x1; sx++) {
+						float rgba[4];
+						ReadPixel(&pixels[((size_t)sy * width + sx) * pixelSize], format, rgba);
 
-					if (bytesPerPixel == 3) {
-						thumbnailImage.bitmap[index * 4 + 0] = (float)buffer[bitmapIndex + 2];
-						thumbnailImage.bitmap[index * 4 + 1] = (float)buffer[bitmapIndex + 1];
-						thumbnailImage.bitmap[index * 4 + 2] = (float)buffer[bitmapIndex + 0];
-						thumbnailImage.bitmap[index * 4 + 3] = 255;
-					} else if (bytesPerPixel == 4) {
-						thumbnailImage.bitmap[index * 4 + 0] = (float)buffer[bitmapIndex + 2];
-						thumbnailImage.bitmap[index * 4 + 1] = (float)buffer[bitmapIndex + 1];
-						thumbnailImage.bitmap[index * 4 + 2] = (float)buffer[bitmapIndex + 0];
-						thumbnailImage.bitmap[index * 4 + 3] = (float)buffer[bitmapIndex + 3];
+						for (int c = 0; c < 4; c++) {
+							sum[c] += rgba[c];
+						}
 					}
-
-					bitmapIndex += bytesPerPixel;
 				}
 
-				bitmapIndex += stride;
+				float count = (float)((x1 - x0) * (y1 - y0));
+
+				for (int c = 0; c < 4; c++) {
+					row[x * 4 + c] = (unsigned char)std::clamp(sum[c] / count * 255.0f + 0.5f, 0.0f, 255.0f);
+				}
 			}
+		}
+
+		thumbnailImage.width = thumbnailWidth;
+		thumbnailImage.height = thumbnailHeight;
+		thumbnailImage.success = true;
+	}
 
-			thumbnailImage.width = width;
-			thumbnailImage.height = height;
-			thumbnailImage.success = true;
-
-			item->Release();
-			cache->Release();
-			shared_bitmap->Detach(&hBitmap);
-			shared_bitmap->Release();
-
-			DeleteObject(item);
-			DeleteObject(cache);
-			DeleteObject(shared_bitmap);
-			DeleteObject(hBitmap);
-			ReleaseDC(NULL, dc);
-			ReleaseDC(NULL, dc_mem);
-
-			delete[] buffer;
-		} catch (std::exception& exception) {
-			//std::cout << "EXCEPTION: " << exception.what() << std::endl;
-			thumbnailImage.success = false;
+	FileThumbnailImage GetImageFileThumbnail(const std::filesystem::path& path, int targetSize, const std::atomic<bool>* cancelled) {
+		FileThumbnailImage thumbnailImage;
+		thumbnailImage.success = false;
+		thumbnailImage.width = 0;
+		thumbnailImage.height = 0;
+
+		// Camera files use their EXIF thumbnail if it's big enough, then JPEGs get scaled while decoding and RAW files give up their
+		// embedded preview. Everything else is decoded in full
+		DecodeOptions options;
+		options.targetWidth = targetSize;
+		options.targetHeight = targetSize;
+		options.allowEmbeddedPreview = true;
+		options.allowExifThumbnail = true;
+
+		DecodedImage decoded;
+
+		if (!DecodeImageFile(path, decoded, cancelled, options))
+			return thumbnailImage;
+
+		std::vector<unsigned char> pixels;
+		int width;
+		int height;
+		PixelFormat format;
+
+		if (!GetThumbnailSourcePixels(decoded, targetSize, cancelled, pixels, width, height, format))
+			return thumbnailImage;
+
+		decoded = DecodedImage(); // Could be big, no need to hold on to it while shrinking
+
+		// Halve until it's less than twice the size, then each thumbnail pixel averages whatever is left under it
+		std::vector<unsigned char> halved;
+
+		while (width >= targetSize * 2 && height >= targetSize * 2) {
+			halved.resize((size_t)((width + 1) / 2) * ((height + 1) / 2) * GetPixelFormatSize(format));
+			DownsamplePixels(pixels.data(), width, height, format, halved.data());
+
+			pixels.swap(halved);
+			width = (width + 1) / 2;
+			height = (height + 1) / 2;
 		}
 
+		FitPixelsToThumbnail(pixels.data(), width, height, format, targetSize, false, thumbnailImage);
+
+		return thumbnailImage;
+	}
+
+	FileThumbnailImage ShrinkThumbnail(const FileThumbnailImage& thumbnail, int targetSize) {
+		if (!thumbnail.success || std::max(thumbnail.width, thumbnail.height) <= targetSize)
+			return thumbnail;
+
+		FileThumbnailImage thumbnailImage;
+		FitPixelsToThumbnail(thumbnail.bitmap.data(), thumbnail.width, thumbnail.height, PixelFormat::RGBA8, targetSize, true, thumbnailImage);
+
 		return thumbnailImage;
 	}
 }
\ No newline at end of file
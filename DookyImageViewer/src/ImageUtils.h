@@ -3,16 +3,21 @@
 
 #include <filesystem>
 #include <vector>
+#include <atomic>
 
 namespace Dooky {
 	struct FileThumbnailImage {
 		bool success;
 		int width;
 		int height;
-		std::vector<unsigned char> bitmap;
+		std::vector<unsigned char> bitmap; // RGBA8, bottom row first
 	};
 
-	FileThumbnailImage GetImageFileThumbnail(const std::filesystem::path& path, int targetSize);
+	// Decodes as little of the file as it can get away with and shrinks it to fit inside targetSize by targetSize
+	// Thread safe, if cancelled is set while decoding then it gives up as soon as it can and fails
+	FileThumbnailImage GetImageFileThumbnail(const std::filesystem::path& path, int targetSize, const std::atomic<bool>* cancelled = nullptr);
+
+	FileThumbnailImage ShrinkThumbnail(const FileThumbnailImage& thumbnail, int targetSize); // Box filtered, ones that already fit come back as they are
 }
 
 
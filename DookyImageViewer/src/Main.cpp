@@ -6,6 +6,7 @@
 #include <Magick++.h>
 
 #include "ConfigReader.h"
+#include "Benchmark.h"
 
 
 int wmain(int argc, wchar_t** argv) {
@@ -41,6 +42,23 @@ int wmain(int argc, wchar_t** argv) {
         printf("Failed to retrieve current working directory.\n");
     }
 
+    // Benchmarks, skip the viewer entirely
+
+    if (argc >= 3 && std::wstring(argv[1]) == L"--benchmark-decoders") {
+        Dooky::RunDecoderBenchmark(argv[2]);
+        return 0;
+    }
+
+    if (argc >= 2 && std::wstring(argv[1]) == L"--benchmark-conversion") {
+        Dooky::RunConversionBenchmark();
+        return 0;
+    }
+
+    if (argc >= 3 && std::wstring(argv[1]) == L"--benchmark-chunked") {
+        Dooky::RunChunkedDecodeBenchmark(argv[2]);
+        return 0;
+    }
+
     // Read image viewer config
     Config config = ReadConfigFile("imageviewerconfig.ini");
 
@@ -0,0 +1,83 @@
+#include "MappedFile.h"
+
+#include <Windows.h>
+
+namespace Dooky {
+	////////////////////////////////////////
+	///// CLASS: MAPPED FILE
+	////////////////////////////////////////
+
+	MappedFile::MappedFile() {
+		fileHandle = INVALID_HANDLE_VALUE;
+		mappingHandle = nullptr;
+		data = nullptr;
+		size = 0;
+	}
+
+	MappedFile::~MappedFile() {
+		Close();
+	}
+
+	////////////////////////////////////////
+	///// PUBLIC
+	////////////////////////////////////////
+
+	bool MappedFile::Open(const std::filesystem::path& path) {
+		Close();
+
+		fileHandle = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+		if (fileHandle == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize;
+
+		if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart <= 0) {
+			Close();
+			return false;
+		}
+
+		// Empty files can't be mapped, hence the check above
+		mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+		if (mappingHandle == nullptr) {
+			Close();
+			return false;
+		}
+
+		data = (const unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+
+		if (data == nullptr) {
+			Close();
+			return false;
+		}
+
+		size = (size_t)fileSize.QuadPart;
+
+		return true;
+	}
+
+	void MappedFile::Close() {
+		if (data != nullptr)
+			UnmapViewOfFile(data);
+
+		if (mappingHandle != nullptr)
+			CloseHandle(mappingHandle);
+
+		if (fileHandle != INVALID_HANDLE_VALUE)
+			CloseHandle(fileHandle);
+
+		fileHandle = INVALID_HANDLE_VALUE;
+		mappingHandle = nullptr;
+		data = nullptr;
+		size = 0;
+	}
+
+	const unsigned char* MappedFile::GetData() {
+		return data;
+	}
+
+	size_t MappedFile::GetSize() {
+		return size;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <filesystem>
+
+namespace Dooky {
+	// Read only view of a whole file without reading it in, the OS pages it in as it gets touched so files bigger than memory are fine
+	class MappedFile {
+	private:
+		void* fileHandle;
+		void* mappingHandle;
+		const unsigned char* data;
+		size_t size;
+	public:
+		MappedFile();
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool Open(const std::filesystem::path& path);
+		void Close();
+
+		const unsigned char* GetData();
+		size_t GetSize();
+	};
+}
+
+#endif
\ No newline at end of file
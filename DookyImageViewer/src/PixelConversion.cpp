@@ -0,0 +1,671 @@
+#include "PixelConversion.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "ThreadPool.h"
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#define DOOKY_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+size_t PIXEL_CONVERSION_CHUNK_SIZE = 1 << 16; // Pixels, anything smaller isn't worth sending to another thread
+
+#ifdef DOOKY_USE_SSE2
+
+// The first Count samples of a pixel widened to floats in one go, the lanes after them are 0
+// Odd sizes are put together in registers, going through memory would stall on loading more than was just stored
+template<typename T, int Count>
+inline __m128 LoadSamples(const T* p) {
+	__m128i zero = _mm_setzero_si128();
+
+	if constexpr (sizeof(T) == 1) {
+		uint32_t bytes;
+
+		if constexpr (Count == 4) {
+			memcpy(&bytes, p, 4);
+		} else if constexpr (Count == 3) {
+			bytes = p[0] | (p[1] << 8) | (p[2] << 16);
+		} else if constexpr (Count == 2) {
+			bytes = p[0] | (p[1] << 8);
+		} else {
+			bytes = p[0];
+		}
+
+		return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero));
+	} else if constexpr (sizeof(T) == 2) {
+		__m128i i;
+
+		if constexpr (Count == 4) {
+			i = _mm_loadl_epi64((const __m128i*)p);
+		} else if constexpr (Count == 3) {
+			i = _mm_insert_epi16(_mm_cvtsi32_si128(p[0] | ((uint32_t)p[1] << 16)), p[2], 2);
+		} else if constexpr (Count == 2) {
+			i = _mm_cvtsi32_si128(p[0] | ((uint32_t)p[1] << 16));
+		} else {
+			i = _mm_cvtsi32_si128(p[0]);
+		}
+
+		return _mm_cvtepi32_ps(_mm_unpacklo_epi16(i, zero));
+	} else {
+		if constexpr (Count == 4) {
+			return _mm_loadu_ps(p);
+		} else if constexpr (Count == 3) {
+			return _mm_set_ps(0.0f, p[2], p[1], p[0]);
+		} else if constexpr (Count == 2) {
+			return _mm_set_ps(0.0f, 0.0f, p[1], p[0]);
+		} else {
+			return _mm_set_ss(p[0]);
+		}
+	}
+}
+
+// Every source pixel gets turned into one normalised RGBA vector, the compiler inlines it into the loop for each source type and layout
+template<typename T, Dooky::PixelLayout Layout>
+inline __m128 LoadPixel(const T* p, __m128 scale, float maximum) {
+	using Dooky::PixelLayout;
+
+	__m128 opaque = _mm_set_ps(maximum, 0.0f, 0.0f, 0.0f); // Added on to layouts without alpha, whose alpha lane loads as 0
+
+	if constexpr (Layout == PixelLayout::Gray) {
+		__m128 v = LoadSamples<T, 1>(p);
+		return _mm_mul_ps(_mm_add_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 0, 0)), opaque), scale);
+	} else if constexpr (Layout == PixelLayout::GrayAlpha) {
+		__m128 v = LoadSamples<T, 2>(p);
+		return _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 0, 0)), scale);
+	} else if constexpr (Layout == PixelLayout::RGB) {
+		return _mm_mul_ps(_mm_add_ps(LoadSamples<T, 3>(p), opaque), scale);
+	} else if constexpr (Layout == PixelLayout::RGBA) {
+		return _mm_mul_ps(LoadSamples<T, 4>(p), scale);
+	} else {
+		// Same naive CMYK to RGB as ImageMagick uses: (1 - C) * (1 - K)
+		// The alpha lane starts out at maximum so that it comes out as 0 and the alpha can be added on top
+		__m128 one = _mm_set1_ps(1.0f);
+		__m128 cmyk = _mm_mul_ps(LoadSamples<T, 4>(p), scale);
+		__m128 k = _mm_shuffle_ps(cmyk, cmyk, _MM_SHUFFLE(3, 3, 3, 3));
+		__m128 cmy = _mm_add_ps(_mm_and_ps(cmyk, _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1))), _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f));
+		__m128 rgb = _mm_mul_ps(_mm_sub_ps(one, cmy), _mm_sub_ps(one, k));
+
+		float alpha = Layout == PixelLayout::CMYKA ? (float)p[4] / maximum : 1.0f;
+
+		return _mm_add_ps(rgb, _mm_set_ps(alpha, 0.0f, 0.0f, 0.0f));
+	}
+}
+
+// And then written out in the destination format, gray formats keep the red channel
+template<Dooky::PixelFormat Format>
+inline void StorePixel(unsigned char* d, __m128 v) {
+	using Dooky::PixelFormat;
+
+	if constexpr (Format == PixelFormat::RGBA32F) {
+		_mm_storeu_ps((float*)d, v);
+	} else if constexpr (Format == PixelFormat::RGBA16F) {
+		alignas(16) float f[4];
+		_mm_store_ps(f, v);
+
+		uint16_t h[4] = { Dooky::FloatToHalf(f[0]), Dooky::FloatToHalf(f[1]), Dooky::FloatToHalf(f[2]), Dooky::FloatToHalf(f[3]) };
+		memcpy(d, h, sizeof(h));
+	} else if constexpr (Format == PixelFormat::R8 || Format == PixelFormat::RG8 || Format == PixelFormat::RGBA8) {
+		v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+
+		__m128i i = _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(255.0f)));
+		i = _mm_packs_epi32(i, i);
+		i = _mm_packus_epi16(i, i);
+
+		uint32_t packed = _mm_cvtsi128_si32(i);
+
+		if constexpr (Format == PixelFormat::RGBA8) {
+			memcpy(d, &packed, 4);
+		} else {
+			d[0] = packed & 0xFF;
+			if constexpr (Format == PixelFormat::RG8) d[1] = packed >> 24;
+		}
+	} else {
+		v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+
+		// SSE2 can only pack to signed 16 bit so shift it down first and flip the sign bit back afterwards
+		__m128i i = _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(65535.0f)));
+		i = _mm_sub_epi32(i, _mm_set1_epi32(32768));
+		i = _mm_packs_epi32(i, i);
+		i = _mm_xor_si128(i, _mm_set1_epi16((short)0x8000));
+
+		alignas(16) uint16_t s[8];
+		_mm_store_si128((__m128i*)s, i);
+
+		if constexpr (Format == PixelFormat::RGBA16) {
+			memcpy(d, s, 8);
+		} else {
+			memcpy(d, &s[0], 2);
+			if constexpr (Format == PixelFormat::RG16) memcpy(d + 2, &s[3], 2);
+		}
+	}
+}
+
+template<typename T, Dooky::PixelLayout Layout, int Channels, Dooky::PixelFormat Format>
+void ConvertKernel(const T* source, unsigned char* destination, size_t pixelCount, float maximum) {
+	size_t size = Dooky::GetPixelFormatSize(Format);
+	__m128 scale = _mm_set1_ps(1.0f / maximum);
+
+	for (size_t i = 0; i < pixelCount; i++) {
+		StorePixel<Format>(destination + i * size, LoadPixel<T, Layout>(source + i * Channels, scale, maximum));
+	}
+}
+
+// 8 bit RGBA straight to 8 bit RGBA is just a copy
+template<>
+void ConvertKernel<unsigned char, Dooky::PixelLayout::RGBA, 4, Dooky::PixelFormat::RGBA8>(const unsigned char* source, unsigned char* destination, size_t pixelCount, float) {
+	memcpy(destination, source, pixelCount * 4);
+}
+
+// 8 bit RGBA to float gets to do 4 pixels at a time
+template<>
+void ConvertKernel<unsigned char, Dooky::PixelLayout::RGBA, 4, Dooky::PixelFormat::RGBA32F>(const unsigned char* source, unsigned char* destination, size_t pixelCount, float maximum) {
+	__m128 scale = _mm_set1_ps(1.0f / maximum);
+	__m128i zero = _mm_setzero_si128();
+	float* d = (float*)destination;
+
+	size_t i = 0;
+
+	for (; i + 4 <= pixelCount; i += 4) {
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(source + i * 4));
+		__m128i low = _mm_unpacklo_epi8(bytes, zero);
+		__m128i high = _mm_unpackhi_epi8(bytes, zero);
+
+		_mm_storeu_ps(d + i * 4 + 0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero)), scale));
+		_mm_storeu_ps(d + i * 4 + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero)), scale));
+		_mm_storeu_ps(d + i * 4 + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero)), scale));
+		_mm_storeu_ps(d + i * 4 + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero)), scale));
+	}
+
+	for (; i < pixelCount; i++) {
+		_mm_storeu_ps(d + i * 4, LoadPixel<unsigned char, Dooky::PixelLayout::RGBA>(source + i * 4, scale, maximum));
+	}
+}
+
+#else
+
+// Plain version for when SSE2 isn't available
+template<typename T, Dooky::PixelLayout Layout, int Channels, Dooky::PixelFormat Format>
+void ConvertKernel(const T* source, unsigned char* destination, size_t pixelCount, float maximum) {
+	using Dooky::PixelLayout;
+
+	float scale = 1.0f / maximum;
+	size_t size = Dooky::GetPixelFormatSize(Format);
+
+	for (size_t i = 0; i < pixelCount; i++) {
+		const T* p = source + i * Channels;
+		float rgba[4];
+
+		if constexpr (Layout == PixelLayout::Gray || Layout == PixelLayout::GrayAlpha) {
+			rgba[0] = rgba[1] = rgba[2] = p[0] * scale;
+			rgba[3] = Layout == PixelLayout::GrayAlpha ? p[1] * scale : 1.0f;
+		} else if constexpr (Layout == PixelLayout::RGB || Layout == PixelLayout::RGBA) {
+			rgba[0] = p[0] * scale;
+			rgba[1] = p[1] * scale;
+			rgba[2] = p[2] * scale;
+			rgba[3] = Layout == PixelLayout::RGBA ? p[3] * scale : 1.0f;
+		} else {
+			float k = 1.0f - p[3] * scale;
+
+			rgba[0] = (1.0f - p[0] * scale) * k;
+			rgba[1] = (1.0f - p[1] * scale) * k;
+			rgba[2] = (1.0f - p[2] * scale) * k;
+			rgba[3] = Layout == PixelLayout::CMYKA ? p[4] * scale : 1.0f;
+		}
+
+		Dooky::WritePixel(destination + i * size, Format, rgba);
+	}
+}
+
+#endif
+
+template<typename T, Dooky::PixelLayout Layout, int Channels>
+void ConvertToFormat(const T* source, unsigned char* destination, Dooky::PixelFormat format, size_t pixelCount, float maximum) {
+	using Dooky::PixelFormat;
+
+	switch (format) {
+	case PixelFormat::R8:      ConvertKernel<T, Layout, Channels, PixelFormat::R8>(source, destination, pixelCount, maximum); break;
+	case PixelFormat::RG8:     ConvertKernel<T, Layout, Channels, PixelFormat::RG8>(source, destination, pixelCount, maximum); break;
+	case PixelFormat::RGBA8:   ConvertKernel<T, Layout, Channels, PixelFormat::RGBA8>(source, destination, pixelCount, maximum); break;
+	case PixelFormat::R16:     ConvertKernel<T, Layout, Channels, PixelFormat::R16>(source, destination, pixelCount, maximum); break;
+	case PixelFormat::RG16:    ConvertKernel<T, Layout, Channels, PixelFormat::RG16>(source, destination, pixelCount, maximum); break;
+	case PixelFormat::RGBA16:  ConvertKernel<T, Layout, Channels, PixelFormat::RGBA16>(source, destination, pixelCount, maximum); break;
+	case PixelFormat::RGBA16F: ConvertKernel<T, Layout, Channels, PixelFormat::RGBA16F>(source, destination, pixelCount, maximum); break;
+	case PixelFormat::RGBA32F: ConvertKernel<T, Layout, Channels, PixelFormat::RGBA32F>(source, destination, pixelCount, maximum); break;
+	}
+}
+
+template<typename T>
+void ConvertPixelsGeneric(const T* source, Dooky::PixelLayout layout, float maximum, unsigned char* destination, Dooky::PixelFormat format, size_t pixelCount) {
+	using Dooky::PixelLayout;
+
+	int channels = Dooky::GetPixelLayoutChannels(layout);
+	size_t size = Dooky::GetPixelFormatSize(format);
+
+	Dooky::GetSharedThreadPool().ParallelFor(pixelCount, PIXEL_CONVERSION_CHUNK_SIZE, [&](size_t begin, size_t end) {
+		const T* s = source + begin * channels;
+		unsigned char* d = destination + begin * size;
+		size_t count = end - begin;
+
+		switch (layout) {
+		case PixelLayout::Gray:      ConvertToFormat<T, PixelLayout::Gray, 1>(s, d, format, count, maximum); break;
+		case PixelLayout::GrayAlpha: ConvertToFormat<T, PixelLayout::GrayAlpha, 2>(s, d, format, count, maximum); break;
+		case PixelLayout::RGB:       ConvertToFormat<T, PixelLayout::RGB, 3>(s, d, format, count, maximum); break;
+		case PixelLayout::RGBA:      ConvertToFormat<T, PixelLayout::RGBA, 4>(s, d, format, count, maximum); break;
+		case PixelLayout::CMYK:      ConvertToFormat<T, PixelLayout::CMYK, 4>(s, d, format, count, maximum); break;
+		case PixelLayout::CMYKA:     ConvertToFormat<T, PixelLayout::CMYKA, 5>(s, d, format, count, maximum); break;
+		}
+	});
+}
+
+// 2x2 box filter, the last row and column get repeated for odd sizes
+template<typename T, typename Average>
+void DownsampleRows(const T* source, int width, int height, int channels, T* destination, size_t beginRow, size_t endRow, Average average) {
+	int destinationWidth = (width + 1) / 2;
+
+	for (size_t y = beginRow; y < endRow; y++) {
+		const T* row0 = source + (size_t)(y * 2) * width * channels;
+		const T* row1 = source + (size_t)std::min((int)y * 2 + 1, height - 1) * width * channels;
+		T* d = destination + y * destinationWidth * channels;
+
+		for (int x = 0; x < destinationWidth; x++) {
+			int x0 = x * 2 * channels;
+			int x1 = std::min(x * 2 + 1, width - 1) * channels;
+
+			for (int c = 0; c < channels; c++) {
+				d[x * channels + c] = average(row0[x0 + c], row0[x1 + c], row1[x0 + c], row1[x1 + c]);
+			}
+		}
+	}
+}
+
+// Lanczos 3 weights for halving, every destination pixel sits exactly between two source pixels so the same 12 taps work everywhere
+struct HalvingLanczosWeights {
+	float weights[12];
+
+	HalvingLanczosWeights() {
+		auto sinc = [](float x) {
+			return x == 0.0f ? 1.0f : std::sin(x * 3.14159265f) / (x * 3.14159265f);
+		};
+
+		float total = 0.0f;
+
+		for (int i = 0; i < 12; i++) {
+			float x = (i - 5.5f) / 2.0f; // Tap i is source pixel 2 * x - 5 + i, measured in destination pixels
+			weights[i] = sinc(x) * sinc(x / 3.0f);
+			total += weights[i];
+		}
+
+		for (float& weight : weights) {
+			weight /= total;
+		}
+	}
+};
+
+// Separable Lanczos, the source rows a chunk needs get filtered horizontally once into floats and then each destination row is a
+// weighted sum of 12 of them. Edges are clamped, same sizes as the box filter
+template<typename T, typename ToFloat, typename FromFloat>
+void LanczosDownsampleRows(const T* source, int width, int height, int channels, T* destination, size_t beginRow, size_t endRow, ToFloat toFloat, FromFloat fromFloat) {
+	static const HalvingLanczosWeights lanczos;
+	const float* weights = lanczos.weights;
+
+	int destinationWidth = (width + 1) / 2;
+	size_t rowLength = (size_t)destinationWidth * channels;
+	int firstSourceRow = (int)beginRow * 2 - 5;
+	int sourceRows = (int)(endRow - beginRow) * 2 + 10;
+
+	std::vector<float> filtered(sourceRows * rowLength);
+
+	for (int r = 0; r < sourceRows; r++) {
+		const T* s = source + (size_t)std::clamp(firstSourceRow + r, 0, height - 1) * width * channels;
+		float* f = &filtered[r * rowLength];
+
+		for (int x = 0; x < destinationWidth; x++) {
+			int first = x * 2 - 5;
+			bool inside = first >= 0 && first + 11 < width; // Most of the row doesn't need clamping
+
+			for (int c = 0; c < channels; c++) {
+				float sum = 0.0f;
+
+				for (int i = 0; i < 12; i++) {
+					int sx = inside ? first + i : std::clamp(first + i, 0, width - 1);
+					sum += weights[i] * toFloat(s[sx * channels + c]);
+				}
+
+				f[x * channels + c] = sum;
+			}
+		}
+	}
+
+	for (size_t y = beginRow; y < endRow; y++) {
+		const float* f = &filtered[(y - beginRow) * 2 * rowLength];
+		T* d = destination + y * rowLength;
+		size_t i = 0;
+
+#ifdef DOOKY_USE_SSE2
+		for (; i + 4 <= rowLength; i += 4) {
+			__m128 sum = _mm_setzero_ps();
+
+			for (int k = 0; k < 12; k++) {
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(f + k * rowLength + i)));
+			}
+
+			alignas(16) float values[4];
+			_mm_store_ps(values, sum);
+
+			for (int j = 0; j < 4; j++) {
+				d[i + j] = fromFloat(values[j]);
+			}
+		}
+#endif
+
+		for (; i < rowLength; i++) {
+			float sum = 0.0f;
+
+			for (int k = 0; k < 12; k++) {
+				sum += weights[k] * f[k * rowLength + i];
+			}
+
+			d[i] = fromFloat(sum);
+		}
+	}
+}
+
+namespace Dooky {
+	int GetPixelLayoutChannels(PixelLayout layout) {
+		switch (layout) {
+		case PixelLayout::Gray: return 1;
+		case PixelLayout::GrayAlpha: return 2;
+		case PixelLayout::RGB: return 3;
+		case PixelLayout::RGBA: return 4;
+		case PixelLayout::CMYK: return 4;
+		case PixelLayout::CMYKA: return 5;
+		}
+
+		return 4;
+	}
+
+	int GetPixelFormatChannels(PixelFormat format) {
+		switch (format) {
+		case PixelFormat::R8: case PixelFormat::R16: return 1;
+		case PixelFormat::RG8: case PixelFormat::RG16: return 2;
+		default: return 4;
+		}
+	}
+
+	size_t GetPixelFormatSize(PixelFormat format) {
+		switch (format) {
+		case PixelFormat::R8: return 1;
+		case PixelFormat::RG8: return 2;
+		case PixelFormat::RGBA8: return 4;
+		case PixelFormat::R16: return 2;
+		case PixelFormat::RG16: return 4;
+		case PixelFormat::RGBA16: return 8;
+		case PixelFormat::RGBA16F: return 8;
+		case PixelFormat::RGBA32F: return 16;
+		}
+
+		return 16;
+	}
+
+	// Rounds to nearest even, same as the GPU would
+	uint16_t FloatToHalf(float value) {
+		uint32_t bits;
+		memcpy(&bits, &value, 4);
+
+		uint32_t sign = (bits >> 16) & 0x8000;
+		uint32_t absolute = bits & 0x7FFFFFFF;
+
+		if (absolute >= 0x47800000) // Too big for a half, infinity or NaN
+			return sign | (absolute > 0x7F800000 ? 0x7E00 : 0x7C00);
+
+		if (absolute < 0x38800000) { // Comes out as a denormal, adding 0.5 lines the mantissa up and lets the FPU do the rounding
+			float f;
+			memcpy(&f, &absolute, 4);
+			f += 0.5f;
+
+			uint32_t rounded;
+			memcpy(&rounded, &f, 4);
+
+			return sign | (rounded - 0x3F000000);
+		}
+
+		uint32_t mantissaOdd = (absolute >> 13) & 1;
+		absolute += 0xC8000FFF + mantissaOdd; // Rebias the exponent from 127 to 15 and round
+
+		return sign | (absolute >> 13);
+	}
+
+	float HalfToFloat(uint16_t value) {
+		uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+		uint32_t exponent = (value >> 10) & 0x1F;
+		uint32_t mantissa = value & 0x3FF;
+
+		if (exponent == 0) { // Zero or denormal
+			float f = mantissa * (1.0f / 16777216.0f);
+			return sign ? -f : f;
+		}
+
+		uint32_t bits;
+
+		if (exponent == 31) {
+			bits = sign | 0x7F800000 | (mantissa << 13);
+		} else {
+			bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+		}
+
+		float f;
+		memcpy(&f, &bits, 4);
+
+		return f;
+	}
+
+	void ReadPixel(const unsigned char* pixel, PixelFormat format, float* rgba) {
+		uint16_t shorts[4] = { 0, 0, 0, 0 };
+
+		switch (format) {
+		case PixelFormat::R8:
+			rgba[0] = rgba[1] = rgba[2] = pixel[0] / 255.0f;
+			rgba[3] = 1.0f;
+			break;
+		case PixelFormat::RG8:
+			rgba[0] = rgba[1] = rgba[2] = pixel[0] / 255.0f;
+			rgba[3] = pixel[1] / 255.0f;
+			break;
+		case PixelFormat::RGBA8:
+			for (int i = 0; i < 4; i++) rgba[i] = pixel[i] / 255.0f;
+			break;
+		case PixelFormat::R16:
+			memcpy(shorts, pixel, 2);
+			rgba[0] = rgba[1] = rgba[2] = shorts[0] / 65535.0f;
+			rgba[3] = 1.0f;
+			break;
+		case PixelFormat::RG16:
+			memcpy(shorts, pixel, 4);
+			rgba[0] = rgba[1] = rgba[2] = shorts[0] / 65535.0f;
+			rgba[3] = shorts[1] / 65535.0f;
+			break;
+		case PixelFormat::RGBA16:
+			memcpy(shorts, pixel, 8);
+			for (int i = 0; i < 4; i++) rgba[i] = shorts[i] / 65535.0f;
+			break;
+		case PixelFormat::RGBA16F:
+			memcpy(shorts, pixel, 8);
+			for (int i = 0; i < 4; i++) rgba[i] = HalfToFloat(shorts[i]);
+			break;
+		case PixelFormat::RGBA32F:
+			memcpy(rgba, pixel, 16);
+			break;
+		}
+	}
+
+	void WritePixel(unsigned char* pixel, PixelFormat format, const float* rgba) {
+		auto To8 = [](float value) {
+			return (unsigned char)lroundf(std::clamp(value, 0.0f, 1.0f) * 255.0f);
+		};
+
+		auto To16 = [](float value) {
+			return (uint16_t)lroundf(std::clamp(value, 0.0f, 1.0f) * 65535.0f);
+		};
+
+		uint16_t shorts[4];
+
+		switch (format) {
+		case PixelFormat::R8:
+			pixel[0] = To8(rgba[0]);
+			break;
+		case PixelFormat::RG8:
+			pixel[0] = To8(rgba[0]);
+			pixel[1] = To8(rgba[3]);
+			break;
+		case PixelFormat::RGBA8:
+			for (int i = 0; i < 4; i++) pixel[i] = To8(rgba[i]);
+			break;
+		case PixelFormat::R16:
+			shorts[0] = To16(rgba[0]);
+			memcpy(pixel, shorts, 2);
+			break;
+		case PixelFormat::RG16:
+			shorts[0] = To16(rgba[0]);
+			shorts[1] = To16(rgba[3]);
+			memcpy(pixel, shorts, 4);
+			break;
+		case PixelFormat::RGBA16:
+			for (int i = 0; i < 4; i++) shorts[i] = To16(rgba[i]);
+			memcpy(pixel, shorts, 8);
+			break;
+		case PixelFormat::RGBA16F:
+			for (int i = 0; i < 4; i++) shorts[i] = FloatToHalf(rgba[i]);
+			memcpy(pixel, shorts, 8);
+			break;
+		case PixelFormat::RGBA32F:
+			memcpy(pixel, rgba, 16);
+			break;
+		}
+	}
+
+	int ConvertPixelsToIndexed(const unsigned char* source, unsigned char* indices, unsigned char* palette, size_t pixelCount) {
+		// Small open addressing table from colour to index, plenty for 256 entries
+		const int TABLE_SIZE = 1024;
+		uint32_t tableColors[TABLE_SIZE];
+		int16_t tableIndices[TABLE_SIZE];
+		std::fill(tableIndices, tableIndices + TABLE_SIZE, -1);
+
+		int colorCount = 0;
+		uint32_t lastColor = 0;
+		int lastIndex = -1;
+
+		for (size_t i = 0; i < pixelCount; i++) {
+			uint32_t color;
+			memcpy(&color, source + i * 4, 4);
+
+			// Runs of the same colour are the common case
+			if (color == lastColor && lastIndex >= 0) {
+				indices[i] = lastIndex;
+				continue;
+			}
+
+			uint32_t slot = (color * 2654435761u) >> 22;
+
+			while (tableIndices[slot] >= 0 && tableColors[slot] != color) {
+				slot = (slot + 1) & (TABLE_SIZE - 1);
+			}
+
+			if (tableIndices[slot] < 0) {
+				if (colorCount == 256)
+					return 0;
+
+				tableColors[slot] = color;
+				tableIndices[slot] = colorCount;
+				memcpy(palette + colorCount * 4, &color, 4);
+				colorCount++;
+			}
+
+			lastColor = color;
+			lastIndex = tableIndices[slot];
+			indices[i] = lastIndex;
+		}
+
+		return colorCount;
+	}
+
+	void ConvertPixels(const unsigned char* source, PixelLayout layout, unsigned char* destination, PixelFormat format, size_t pixelCount) {
+		ConvertPixelsGeneric(source, layout, 255.0f, destination, format, pixelCount);
+	}
+
+	void ConvertPixels(const unsigned short* source, PixelLayout layout, unsigned char* destination, PixelFormat format, size_t pixelCount) {
+		ConvertPixelsGeneric(source, layout, 65535.0f, destination, format, pixelCount);
+	}
+
+	void ConvertPixels(const float* source, PixelLayout layout, float maximum, unsigned char* destination, PixelFormat format, size_t pixelCount) {
+		ConvertPixelsGeneric(source, layout, maximum, destination, format, pixelCount);
+	}
+
+	void DownsamplePixels(const unsigned char* source, int width, int height, PixelFormat format, unsigned char* destination, DownsampleFilter filter) {
+		int channels = GetPixelFormatChannels(format);
+		size_t rows = (height + 1) / 2;
+		size_t chunkRows = std::max(PIXEL_CONVERSION_CHUNK_SIZE / std::max((size_t)width, (size_t)1), (size_t)1);
+
+		if (filter == DownsampleFilter::Lanczos) {
+			// Lanczos rings so the integer formats get clamped back into range, floats are left alone
+			GetSharedThreadPool().ParallelFor(rows, chunkRows, [&](size_t begin, size_t end) {
+				switch (format) {
+				case PixelFormat::R8:
+				case PixelFormat::RG8:
+				case PixelFormat::RGBA8:
+					LanczosDownsampleRows(source, width, height, channels, destination, begin, end, [](unsigned char v) { return (float)v; }, [](float v) {
+						return (unsigned char)std::clamp(v + 0.5f, 0.0f, 255.0f);
+					});
+					break;
+				case PixelFormat::R16:
+				case PixelFormat::RG16:
+				case PixelFormat::RGBA16:
+					LanczosDownsampleRows((const uint16_t*)source, width, height, channels, (uint16_t*)destination, begin, end, [](uint16_t v) { return (float)v; }, [](float v) {
+						return (uint16_t)std::clamp(v + 0.5f, 0.0f, 65535.0f);
+					});
+					break;
+				case PixelFormat::RGBA16F:
+					LanczosDownsampleRows((const uint16_t*)source, width, height, channels, (uint16_t*)destination, begin, end, HalfToFloat, FloatToHalf);
+					break;
+				case PixelFormat::RGBA32F:
+					LanczosDownsampleRows((const float*)source, width, height, channels, (float*)destination, begin, end, [](float v) { return v; }, [](float v) { return v; });
+					break;
+				}
+			});
+
+			return;
+		}
+
+		GetSharedThreadPool().ParallelFor(rows, chunkRows, [&](size_t begin, size_t end) {
+			switch (format) {
+			case PixelFormat::R8:
+			case PixelFormat::RG8:
+			case PixelFormat::RGBA8:
+				DownsampleRows(source, width, height, channels, destination, begin, end, [](unsigned int a, unsigned int b, unsigned int c, unsigned int d) {
+					return (unsigned char)((a + b + c + d + 2) / 4);
+				});
+				break;
+			case PixelFormat::R16:
+			case PixelFormat::RG16:
+			case PixelFormat::RGBA16:
+				DownsampleRows((const uint16_t*)source, width, height, channels, (uint16_t*)destination, begin, end, [](unsigned int a, unsigned int b, unsigned int c, unsigned int d) {
+					return (uint16_t)((a + b + c + d + 2) / 4);
+				});
+				break;
+			case PixelFormat::RGBA16F:
+				DownsampleRows((const uint16_t*)source, width, height, channels, (uint16_t*)destination, begin, end, [](uint16_t a, uint16_t b, uint16_t c, uint16_t d) {
+					return FloatToHalf((HalfToFloat(a) + HalfToFloat(b) + HalfToFloat(c) + HalfToFloat(d)) * 0.25f);
+				});
+				break;
+			case PixelFormat::RGBA32F:
+				DownsampleRows((const float*)source, width, height, channels, (float*)destination, begin, end, [](float a, float b, float c, float d) {
+					return (a + b + c + d) * 0.25f;
+				});
+				break;
+			}
+		});
+	}
+}
\ No newline at end of file
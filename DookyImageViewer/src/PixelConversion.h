@@ -0,0 +1,61 @@
+#ifndef PIXELCONVERSION_H
+#define PIXELCONVERSION_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Dooky {
+	// Channel layouts decoders hand pixels over in
+	enum class PixelLayout {
+		Gray,
+		GrayAlpha,
+		RGB,
+		RGBA,
+		CMYK,
+		CMYKA
+	};
+
+	// How pixels are stored in memory and on the GPU, gray formats get expanded to RGBA with a texture swizzle
+	enum class PixelFormat {
+		R8, // Gray
+		RG8, // Gray and alpha
+		RGBA8,
+		R16,
+		RG16,
+		RGBA16,
+		RGBA16F, // HDR
+		RGBA32F
+	};
+
+	// Filters DownsamplePixels can halve with
+	enum class DownsampleFilter {
+		Box, // 2x2 average, fast
+		Lanczos // Lanczos 3, sharper but a lot slower
+	};
+
+	int GetPixelLayoutChannels(PixelLayout layout);
+	int GetPixelFormatChannels(PixelFormat format);
+	size_t GetPixelFormatSize(PixelFormat format); // Bytes per pixel
+
+	uint16_t FloatToHalf(float value);
+	float HalfToFloat(uint16_t value);
+
+	// One pixel at a time, colours are normalised RGBA the same way the shader sees them
+	void ReadPixel(const unsigned char* pixel, PixelFormat format, float* rgba);
+	void WritePixel(unsigned char* pixel, PixelFormat format, const float* rgba);
+
+	// Turns RGBA8 into 8 bit palette indices and a palette of up to 256 RGBA8 colours, exact so it gives up if there are more colours than that
+	// Returns the number of colours in the palette, or 0 if it gave up
+	int ConvertPixelsToIndexed(const unsigned char* source, unsigned char* indices, unsigned char* palette, size_t pixelCount);
+
+	// Converts straight into the destination format in one pass, gray formats only make sense for gray layouts
+	// Big images get split up across the shared thread pool
+	void ConvertPixels(const unsigned char* source, PixelLayout layout, unsigned char* destination, PixelFormat format, size_t pixelCount); // 0 to 255
+	void ConvertPixels(const unsigned short* source, PixelLayout layout, unsigned char* destination, PixelFormat format, size_t pixelCount); // 0 to 65535
+	void ConvertPixels(const float* source, PixelLayout layout, float maximum, unsigned char* destination, PixelFormat format, size_t pixelCount); // 0 to maximum, e.g 65535 for ImageMagick quantums
+
+	// Halves the width and height, odd sizes round up so the destination is (width + 1) / 2 by (height + 1) / 2
+	void DownsamplePixels(const unsigned char* source, int width, int height, PixelFormat format, unsigned char* destination, DownsampleFilter filter = DownsampleFilter::Box);
+}
+
+#endif
\ No newline at end of file
@@ -11,4 +11,9 @@ namespace Dooky {
             }
         );
     }
+
+    std::string PathToUTF8String(const std::filesystem::path& path) {
+        std::u8string utf8 = path.u8string();
+        return std::string(utf8.begin(), utf8.end());
+    }
 }
\ No newline at end of file
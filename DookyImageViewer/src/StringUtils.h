@@ -3,9 +3,11 @@
 
 #include <string>
 #include <algorithm>
+#include <filesystem>
 
 namespace Dooky {
     void LowerString(std::string& str);
+    std::string PathToUTF8String(const std::filesystem::path& path); // ImageMagick wants UTF-8 file names
 }
 
 #endif
\ No newline at end of file
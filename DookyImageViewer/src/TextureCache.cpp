@@ -0,0 +1,448 @@
+#include "TextureCache.h"
+
+#include <cstring>
+#include <iterator>
+#include <algorithm>
+#include <GL/glew.h>
+
+#include "ThreadPool.h"
+
+size_t TEXTURE_CACHE_VRAM_RESERVE = 256 * 1024 * 1024; // Always left free for everything else when the driver says how much is free
+
+namespace Dooky {
+	////////////////////////////////////////
+	///// CLASS: TEXTURE CACHE
+	////////////////////////////////////////
+
+	TextureCache::TextureCache(size_t budget) {
+		this->budget = budget;
+		usedBytes = 0;
+		wantedUseMipmaps = false;
+		compressedTexture = 0;
+		compressedLevel = 0;
+
+		hitCount = 0;
+		missCount = 0;
+		evictionCount = 0;
+	}
+
+	TextureCache::~TextureCache() {
+		Clear();
+	}
+
+	////////////////////////////////////////
+	///// PRIVATE
+	////////////////////////////////////////
+
+	std::list<TextureCache::CacheEntry>::iterator TextureCache::Lookup(const DecodedImage* image, bool useMipmaps) {
+		for (auto entry = entries.begin(); entry != entries.end(); entry++) {
+			// A dead image's address can be reused by a new one, so it has to still be alive to count
+			if (entry->key == image && entry->useMipmaps == useMipmaps && !entry->image.expired())
+				return entry;
+		}
+
+		return entries.end();
+	}
+
+	void TextureCache::Remove(std::list<CacheEntry>::iterator entry) {
+		glDeleteTextures(1, &entry->texture);
+		usedBytes -= entry->bytes;
+		entries.erase(entry);
+	}
+
+	bool TextureCache::EvictToBudget(size_t extraBytes) {
+		size_t available = GetAvailableBudget();
+
+		// Least recently used first, but anything that's about to be looked at only goes if nothing else is left
+		for (int pass = 0; pass < 2; pass++) {
+			auto entry = entries.end();
+
+			while (usedBytes + extraBytes > available && entry != entries.begin()) {
+				auto evicted = std::prev(entry);
+
+				if (pass == 0 && IsWanted(evicted->key)) {
+					entry = evicted;
+					continue;
+				}
+
+				Remove(evicted);
+				evictionCount++;
+			}
+		}
+
+		return usedBytes + extraBytes <= available;
+	}
+
+	size_t TextureCache::GetAvailableBudget() {
+		GLint available = -1; // In kilobytes
+
+		if (GLEW_NVX_gpu_memory_info) {
+			glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &available);
+		} else if (GLEW_ATI_meminfo) {
+			GLint info[4] = { -1, 0, 0, 0 }; // Total free, biggest free block, and the same for shared memory
+			glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, info);
+			available = info[0];
+		}
+
+		if (available < 0)
+			return budget;
+
+		// What's already cached could be handed straight back, so it counts as free
+		size_t free = (size_t)available * 1024;
+		size_t spare = free > TEXTURE_CACHE_VRAM_RESERVE ? free - TEXTURE_CACHE_VRAM_RESERVE : 0;
+
+		return std::min(budget, usedBytes + spare);
+	}
+
+	bool TextureCache::IsWanted(const DecodedImage* image) {
+		for (const std::weak_ptr<const DecodedImage>& weak : wanted) {
+			std::shared_ptr<const DecodedImage> wantedImage = weak.lock();
+
+			if (wantedImage != nullptr && wantedImage.get() == image)
+				return true;
+		}
+
+		return false;
+	}
+
+	size_t TextureCache::GetWantedBytes() {
+		size_t bytes = 0;
+
+		for (const CacheEntry& entry : entries) {
+			if (IsWanted(entry.key))
+				bytes += entry.bytes;
+		}
+
+		return bytes;
+	}
+
+	void TextureCache::InsertEntry(std::shared_ptr<const DecodedImage> image, unsigned int texture, bool useMipmaps, bool compressed, size_t bytes) {
+		auto found = Lookup(image.get(), useMipmaps);
+
+		if (found != entries.end())
+			Remove(found);
+
+		CacheEntry entry;
+		entry.image = image;
+		entry.key = image.get();
+		entry.texture = texture;
+		entry.useMipmaps = useMipmaps;
+		entry.compressed = compressed;
+		entry.bytes = bytes;
+
+		if (entry.bytes > budget || !EvictToBudget(entry.bytes)) {
+			glDeleteTextures(1, &texture);
+			return;
+		}
+
+		entries.push_front(entry);
+		usedBytes += entry.bytes;
+	}
+
+	void TextureCache::StartNext(DownsampleFilter mipmapFilter) {
+		size_t available = GetAvailableBudget();
+		size_t wantedBytes = GetWantedBytes();
+
+		for (const std::weak_ptr<const DecodedImage>& weak : wanted) {
+			std::shared_ptr<const DecodedImage> image = weak.lock();
+
+			if (image == nullptr || Lookup(image.get(), wantedUseMipmaps) != entries.end())
+				continue;
+
+			// Only into space that isn't already taken by the other wanted images, otherwise they'd keep pushing each other out
+			// BC7 is a byte a pixel, BC1 half that
+			bool compress = CanCompress(*image);
+			size_t bytes = GetTextureSize(*image, wantedUseMipmaps) / (compress ? GetPixelFormatSize(image->format) : 1);
+
+			if (wantedBytes + bytes > available)
+				continue;
+
+			if (compress) {
+				StartCompression(image, wantedUseMipmaps, mipmapFilter, false);
+			} else {
+				uploadingImage = image;
+				upload = std::make_unique<TextureUpload>(image, wantedUseMipmaps, mipmapFilter);
+			}
+
+			return;
+		}
+
+		// Nothing left to upload ahead of time, so the full precision textures that were handed over get shrunk
+		for (const CacheEntry& entry : entries) {
+			std::shared_ptr<const DecodedImage> image = entry.image.lock();
+
+			if (!entry.compressed && image != nullptr && CanCompress(*image)) {
+				StartCompression(image, entry.useMipmaps, mipmapFilter, true);
+				return;
+			}
+		}
+	}
+
+	void TextureCache::StartCompression(std::shared_ptr<const DecodedImage> image, bool useMipmaps, DownsampleFilter mipmapFilter, bool replacing) {
+		compression = std::make_shared<CompressionJob>();
+		compression->image = image;
+		compression->useMipmaps = useMipmaps;
+		compression->mipmapFilter = mipmapFilter;
+		compression->replacing = replacing;
+		compression->finished = false;
+		compression->cancelled = false;
+
+		std::shared_ptr<CompressionJob> job = compression;
+
+		GetSharedThreadPool().Submit([job]() {
+			CompressImage(job);
+		});
+	}
+
+	void TextureCache::ContinueCompression() {
+		if (!compression->finished)
+			return;
+
+		if (compression->levels.empty()) { // Cancelled
+			CancelCompression();
+			return;
+		}
+
+		GLenum internalFormat = compression->format == BlockFormat::BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_BPTC_UNORM;
+
+		if (compressedTexture == 0) {
+			glGenTextures(1, &compressedTexture);
+			glBindTexture(GL_TEXTURE_2D, compressedTexture);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)compression->levels.size() - 1);
+			glBindTexture(GL_TEXTURE_2D, 0);
+
+			compressedLevel = 0;
+		}
+
+		// A level a frame, the first one is at most a byte a pixel so it's a lot less than a full precision upload
+		const std::vector<unsigned char>& level = compression->levels[compressedLevel];
+		glm::ivec2 levelSize = compression->levelSizes[compressedLevel];
+
+		glBindTexture(GL_TEXTURE_2D, compressedTexture);
+		glCompressedTexImage2D(GL_TEXTURE_2D, compressedLevel, internalFormat, levelSize.x, levelSize.y, 0, (GLsizei)level.size(), level.data());
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		compressedLevel++;
+
+		if (compressedLevel < (int)compression->levels.size())
+			return;
+
+		size_t bytes = 0;
+
+		for (const std::vector<unsigned char>& blocks : compression->levels) {
+			bytes += blocks.size();
+		}
+
+		// Whoever the full precision one was for might have taken it back out in the meantime
+		if (compression->replacing && Lookup(compression->image.get(), compression->useMipmaps) == entries.end()) {
+			glDeleteTextures(1, &compressedTexture);
+		} else {
+			InsertEntry(compression->image, compressedTexture, compression->useMipmaps, true, bytes);
+		}
+
+		compressedTexture = 0;
+		compression.reset();
+	}
+
+	void TextureCache::CancelCompression() {
+		if (compression == nullptr)
+			return;
+
+		compression->cancelled = true;
+		compression.reset();
+
+		glDeleteTextures(1, &compressedTexture);
+		compressedTexture = 0;
+	}
+
+	void TextureCache::CompressImage(std::shared_ptr<CompressionJob> job) {
+		const DecodedImage& image = *job->image;
+		int width = image.width;
+		int height = image.height;
+		int channels = GetPixelFormatChannels(image.format);
+		size_t pixelCount = (size_t)width * height;
+
+		// The encoder only takes RGBA8, gray gets spread across the colour channels the same way the texture swizzle would
+		std::vector<unsigned char> pixels(pixelCount * 4);
+		bool hasAlpha = false;
+
+		for (size_t i = 0; i < pixelCount; i++) {
+			const unsigned char* source = &image.data[i * channels];
+			unsigned char* destination = &pixels[i * 4];
+
+			if (channels == 4) {
+				memcpy(destination, source, 4);
+			} else {
+				destination[0] = destination[1] = destination[2] = source[0];
+				destination[3] = channels == 2 ? source[1] : 255;
+			}
+
+			hasAlpha = hasAlpha || destination[3] != 255;
+		}
+
+		job->format = hasAlpha ? BlockFormat::BC7 : BlockFormat::BC1;
+
+		std::vector<unsigned char> filtered;
+
+		while (true) {
+			if (job->cancelled) {
+				job->levels.clear();
+				break;
+			}
+
+			std::vector<unsigned char> blocks(GetBlockCompressedSize(job->format, width, height));
+			CompressBlocks(pixels.data(), width, height, job->format, blocks.data());
+
+			job->levels.push_back(std::move(blocks));
+			job->levelSizes.push_back({ width, height });
+
+			if (!job->useMipmaps || (width == 1 && height == 1))
+				break;
+
+			// Smaller levels round down like OpenGL's, DownsamplePixels rounds up so the extra row and column are left off
+			int nextWidth = std::max(width / 2, 1);
+			int nextHeight = std::max(height / 2, 1);
+			int filteredWidth = (width + 1) / 2;
+
+			filtered.resize((size_t)filteredWidth * ((height + 1) / 2) * 4);
+			DownsamplePixels(pixels.data(), width, height, PixelFormat::RGBA8, filtered.data(), job->mipmapFilter);
+
+			pixels.resize((size_t)nextWidth * nextHeight * 4);
+
+			for (int y = 0; y < nextHeight; y++) {
+				memcpy(&pixels[(size_t)y * nextWidth * 4], &filtered[(size_t)y * filteredWidth * 4], (size_t)nextWidth * 4);
+			}
+
+			width = nextWidth;
+			height = nextHeight;
+		}
+
+		job->finished = true;
+	}
+
+	////////////////////////////////////////
+	///// PUBLIC
+	////////////////////////////////////////
+
+	size_t TextureCache::GetTextureSize(const DecodedImage& image, bool useMipmaps) {
+		size_t bytes = (size_t)image.width * image.height * GetPixelFormatSize(image.format);
+
+		return useMipmaps ? bytes + bytes / 3 : bytes;
+	}
+
+	bool TextureCache::CanCompress(const DecodedImage& image) {
+		bool eightBit = image.format == PixelFormat::R8 || image.format == PixelFormat::RG8 || image.format == PixelFormat::RGBA8;
+
+		return eightBit && GLEW_EXT_texture_compression_s3tc && GLEW_ARB_texture_compression_bptc;
+	}
+
+	void TextureCache::Insert(std::shared_ptr<const DecodedImage> image, unsigned int texture, bool useMipmaps) {
+		InsertEntry(image, texture, useMipmaps, false, GetTextureSize(*image, useMipmaps));
+	}
+
+	bool TextureCache::Take(const DecodedImage* image, bool useMipmaps, unsigned int& texture, bool& compressed) {
+		auto found = Lookup(image, useMipmaps);
+
+		if (found == entries.end()) {
+			missCount++;
+			return false;
+		}
+
+		hitCount++;
+
+		texture = found->texture;
+		compressed = found->compressed;
+		usedBytes -= found->bytes;
+		entries.erase(found);
+
+		return true;
+	}
+
+	void TextureCache::SetWanted(const std::vector<std::shared_ptr<const DecodedImage>>& images, bool useMipmaps) {
+		wanted.assign(images.begin(), images.end());
+		wantedUseMipmaps = useMipmaps;
+
+		if (upload != nullptr && !IsWanted(uploadingImage.get())) {
+			upload.reset();
+			uploadingImage.reset();
+		}
+
+		if (compression != nullptr && !compression->replacing && !IsWanted(compression->image.get()))
+			CancelCompression();
+	}
+
+	void TextureCache::Update(bool allowUploading, DownsampleFilter mipmapFilter) {
+		// Textures of images that aren't in memory any more can never be asked for again
+		for (auto entry = entries.begin(); entry != entries.end();) {
+			auto next = std::next(entry);
+
+			if (entry->image.expired())
+				Remove(entry);
+
+			entry = next;
+		}
+
+		// Shares the frame's upload time with whatever else is uploading, so it waits its turn
+		if (!allowUploading)
+			return;
+
+		if (upload == nullptr && compression == nullptr)
+			StartNext(mipmapFilter);
+
+		if (compression != nullptr)
+			ContinueCompression();
+
+		if (upload != nullptr && upload->Continue()) {
+			unsigned int texture = upload->TakeTexture();
+			upload.reset();
+
+			Insert(uploadingImage, texture, wantedUseMipmaps);
+			uploadingImage.reset();
+		}
+	}
+
+	void TextureCache::Clear() {
+		upload.reset();
+		uploadingImage.reset();
+		CancelCompression();
+
+		while (!entries.empty()) {
+			Remove(entries.begin());
+		}
+	}
+
+	void TextureCache::SetBudget(size_t bytes) {
+		budget = bytes;
+		EvictToBudget(0);
+	}
+
+	size_t TextureCache::GetBudget() {
+		return budget;
+	}
+
+	size_t TextureCache::GetUsedBytes() {
+		return usedBytes;
+	}
+
+	size_t TextureCache::GetEntryCount() {
+		return entries.size();
+	}
+
+	size_t TextureCache::GetCompressedEntryCount() {
+		return std::count_if(entries.begin(), entries.end(), [](const CacheEntry& entry) {
+			return entry.compressed;
+		});
+	}
+
+	size_t TextureCache::GetHitCount() {
+		return hitCount;
+	}
+
+	size_t TextureCache::GetMissCount() {
+		return missCount;
+	}
+
+	size_t TextureCache::GetEvictionCount() {
+		return evictionCount;
+	}
+}
\ No newline at end of file
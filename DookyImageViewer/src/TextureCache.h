@@ -0,0 +1,112 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <list>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <glm/glm.hpp>
+
+#include "ImageDecoder.h"
+#include "TextureUpload.h"
+#include "BlockCompression.h"
+
+namespace Dooky {
+	// Keeps finished textures of recently viewed images on the GPU so going back to one is just a bind, and uploads the images the
+	// prefetcher decoded next to the current one ahead of time. Least recently used ones are thrown out first to stay inside the budget,
+	// which shrinks to whatever the driver says is free when it can tell (NVX_gpu_memory_info or ATI_meminfo)
+	// When the driver has BC1 and BC7, 8 bit images are kept block compressed on worker threads so 4 to 8 times as many fit. Full precision
+	// textures handed to it get compressed in the background, and whoever takes a compressed one out is expected to upload it properly
+	// Textures are found by which DecodedImage they hold, the cache only keeps weak references to those so it never keeps pixels in memory
+	// Must only be used on the thread that owns the OpenGL context
+	class TextureCache {
+	private:
+		struct CacheEntry {
+			std::weak_ptr<const DecodedImage> image;
+			const DecodedImage* key; // Still compared after the image is gone, entries for dead images get thrown out
+			unsigned int texture;
+			bool useMipmaps;
+			bool compressed;
+			size_t bytes;
+		};
+
+		// Compressed on the shared thread pool, then uploaded a level a frame
+		struct CompressionJob {
+			std::shared_ptr<const DecodedImage> image;
+			bool useMipmaps;
+			DownsampleFilter mipmapFilter;
+			bool replacing; // Taking the place of a full precision entry rather than being uploaded ahead of time
+			BlockFormat format;
+			std::vector<std::vector<unsigned char>> levels; // Level 0 first, only touched by the task until finished is set
+			std::vector<glm::ivec2> levelSizes;
+			std::atomic<bool> finished;
+			std::atomic<bool> cancelled;
+		};
+
+		std::list<CacheEntry> entries; // Most recently used at the front
+
+		std::vector<std::weak_ptr<const DecodedImage>> wanted; // To upload ahead of time, most important first
+		std::shared_ptr<const DecodedImage> uploadingImage;
+		bool wantedUseMipmaps;
+		std::unique_ptr<TextureUpload> upload;
+		std::shared_ptr<CompressionJob> compression;
+		unsigned int compressedTexture; // Filled in with compression's levels once they're ready, 0 until then
+		int compressedLevel; // Next one to upload
+
+		size_t budget; // In bytes
+		size_t usedBytes;
+
+		size_t hitCount;
+		size_t missCount;
+		size_t evictionCount;
+
+		std::list<CacheEntry>::iterator Lookup(const DecodedImage* image, bool useMipmaps); // Returns entries.end() if missing
+		void Remove(std::list<CacheEntry>::iterator entry); // Deletes the texture too
+		void InsertEntry(std::shared_ptr<const DecodedImage> image, unsigned int texture, bool useMipmaps, bool compressed, size_t bytes);
+		bool EvictToBudget(size_t extraBytes); // Makes room for that many more bytes, wanted images go last. False if it can't
+		size_t GetAvailableBudget(); // The budget or what the GPU has room for, whichever is smaller
+		bool IsWanted(const DecodedImage* image);
+		size_t GetWantedBytes(); // Taken up by wanted images that are already uploaded
+		void StartNext(DownsampleFilter mipmapFilter); // Picks the next wanted image to upload, or something to compress
+		void StartCompression(std::shared_ptr<const DecodedImage> image, bool useMipmaps, DownsampleFilter mipmapFilter, bool replacing);
+		void ContinueCompression(); // Uploads the next level once they're all compressed
+		void CancelCompression();
+
+		static void CompressImage(std::shared_ptr<CompressionJob> job);
+	public:
+		TextureCache(size_t budget);
+		~TextureCache();
+
+		TextureCache(const TextureCache&) = delete;
+		TextureCache& operator=(const TextureCache&) = delete;
+
+		static size_t GetTextureSize(const DecodedImage& image, bool useMipmaps); // Bytes it takes up on the GPU at full precision, roughly
+		static bool CanCompress(const DecodedImage& image); // 8 bit formats when the driver has both BC1 and BC7
+
+		// The cache owns the texture from then on, it has to have all of the image in it. Deleted straight away if it doesn't fit
+		void Insert(std::shared_ptr<const DecodedImage> image, unsigned int texture, bool useMipmaps);
+
+		// Takes the texture back out, the caller owns it from then on. Counts as a hit or miss
+		// A compressed texture is only meant to be shown until the full precision one has been uploaded
+		bool Take(const DecodedImage* image, bool useMipmaps, unsigned int& texture, bool& compressed);
+
+		// Replaces the images to upload ahead of time, anything already uploading that isn't in the list is given up on
+		void SetWanted(const std::vector<std::shared_ptr<const DecodedImage>>& images, bool useMipmaps);
+
+		// Continues uploading the wanted images, once a frame. Nothing new gets started while uploading isn't allowed
+		void Update(bool allowUploading, DownsampleFilter mipmapFilter);
+		void Clear();
+
+		void SetBudget(size_t bytes);
+		size_t GetBudget();
+		size_t GetUsedBytes();
+		size_t GetEntryCount();
+		size_t GetCompressedEntryCount();
+
+		size_t GetHitCount();
+		size_t GetMissCount();
+		size_t GetEvictionCount();
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,264 @@
+#include "TextureUpload.h"
+
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+#include "Image.h"
+#include "ThreadPool.h"
+
+double TEXTURE_UPLOAD_BUDGET_MS = 4.0; // Spent uploading each frame, checked after every slice
+size_t TEXTURE_UPLOAD_SEGMENT_SIZE = 4 * 1024 * 1024; // Bytes per slice, the staging buffer is a ring of these
+int TEXTURE_UPLOAD_SEGMENTS = 4; // Slices the GPU can still be reading while the next ones get written
+
+namespace Dooky {
+	////////////////////////////////////////
+	///// CLASS: TEXTURE UPLOAD
+	////////////////////////////////////////
+
+	TextureUpload::TextureUpload(std::shared_ptr<const DecodedImage> image, bool useMipmaps, DownsampleFilter mipmapFilter) : image(image) {
+		format = image->format;
+		width = image->width;
+		height = image->height;
+		textureTaken = false;
+		level = 0;
+		row = 0;
+		nextSegment = 0;
+
+		levelCount = 1;
+
+		while (useMipmaps && (width >> levelCount) + (height >> levelCount) > 0) {
+			levelCount++;
+		}
+
+		GLint swizzle[4];
+		GetPixelFormatGL(format, internalFormat, pixelDataFormat, pixelDataType, swizzle);
+
+		// Immutable storage when the driver has it so it never has to check the levels are consistent
+		// Only the base level is sampled until the others are in
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+		if (GLEW_ARB_texture_storage) {
+			glTexStorage2D(GL_TEXTURE_2D, levelCount, internalFormat, width, height);
+		} else {
+			for (int i = 0; i < levelCount; i++) {
+				glm::ivec2 levelSize = GetLevelSize(i);
+				glTexImage2D(GL_TEXTURE_2D, i, internalFormat, levelSize.x, levelSize.y, 0, pixelDataFormat, pixelDataType, nullptr);
+			}
+		}
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		// Small images don't need a whole segment, but every segment has to fit at least one row
+		size_t rowSize = (size_t)width * GetPixelFormatSize(format);
+		size_t imageSize = rowSize * height;
+
+		segmentSize = std::max(std::min(TEXTURE_UPLOAD_SEGMENT_SIZE, imageSize), rowSize);
+		segments.assign(TEXTURE_UPLOAD_SEGMENTS, { nullptr });
+
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+
+		// Mapped once and written straight into for the whole upload when the driver can do that, otherwise each slice maps its segment
+		if (GLEW_ARB_buffer_storage) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+			glBufferStorage(GL_PIXEL_UNPACK_BUFFER, segmentSize * segments.size(), nullptr, flags);
+			mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, segmentSize * segments.size(), flags);
+		} else {
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, segmentSize * segments.size(), nullptr, GL_STREAM_DRAW);
+			mapped = nullptr;
+		}
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		// The levels get built on the pool while level 0 uploads
+		if (levelCount > 1) {
+			mipmapBuild = std::make_shared<MipmapBuild>();
+			mipmapBuild->image = image;
+			mipmapBuild->levels.resize(levelCount - 1);
+			mipmapBuild->levelsBuilt = 1;
+			mipmapBuild->cancelled = false;
+
+			std::shared_ptr<MipmapBuild> build = mipmapBuild;
+
+			GetSharedThreadPool().Submit([build, mipmapFilter]() {
+				BuildMipmaps(build, mipmapFilter);
+			});
+		}
+	}
+
+	TextureUpload::~TextureUpload() {
+		if (mipmapBuild != nullptr)
+			mipmapBuild->cancelled = true;
+
+		for (StagingSegment& segment : segments) {
+			if (segment.fence != nullptr)
+				glDeleteSync(segment.fence);
+		}
+
+		if (mapped != nullptr) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+
+		glDeleteBuffers(1, &buffer);
+
+		if (!textureTaken)
+			glDeleteTextures(1, &texture);
+	}
+
+	////////////////////////////////////////
+	///// PRIVATE
+	////////////////////////////////////////
+
+	void TextureUpload::BuildMipmaps(std::shared_ptr<MipmapBuild> build, DownsampleFilter filter) {
+		PixelFormat format = build->image->format;
+		size_t pixelSize = GetPixelFormatSize(format);
+		int width = build->image->width;
+		int height = build->image->height;
+		std::vector<unsigned char> filtered;
+
+		for (size_t i = 0; i < build->levels.size(); i++) {
+			if (build->cancelled)
+				return;
+
+			const unsigned char* previous = i == 0 ? build->image->data.data() : build->levels[i - 1].data();
+			int previousWidth = std::max(width >> i, 1);
+			int previousHeight = std::max(height >> i, 1);
+			int levelWidth = std::max(width >> (i + 1), 1);
+			int levelHeight = std::max(height >> (i + 1), 1);
+			int filteredWidth = (previousWidth + 1) / 2;
+
+			std::vector<unsigned char>& levelPixels = build->levels[i];
+			levelPixels.resize((size_t)levelWidth * levelHeight * pixelSize);
+
+			// DownsamplePixels rounds odd sizes up where GL rounds down, the extra row and column are left off
+			if (filteredWidth == levelWidth && (previousHeight + 1) / 2 == levelHeight) {
+				DownsamplePixels(previous, previousWidth, previousHeight, format, levelPixels.data(), filter);
+			} else {
+				filtered.resize((size_t)filteredWidth * ((previousHeight + 1) / 2) * pixelSize);
+				DownsamplePixels(previous, previousWidth, previousHeight, format, filtered.data(), filter);
+
+				for (int y = 0; y < levelHeight; y++) {
+					memcpy(&levelPixels[(size_t)y * levelWidth * pixelSize], &filtered[(size_t)y * filteredWidth * pixelSize], levelWidth * pixelSize);
+				}
+			}
+
+			build->levelsBuilt = (int)i + 2;
+		}
+	}
+
+	glm::ivec2 TextureUpload::GetLevelSize(int level) {
+		return { std::max(width >> level, 1), std::max(height >> level, 1) };
+	}
+
+	bool TextureUpload::UploadSlice() {
+		StagingSegment& segment = segments[nextSegment];
+
+		// Never wait on the GPU, whatever didn't fit this frame goes next frame
+		if (segment.fence != nullptr) {
+			if (glClientWaitSync(segment.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+				return false;
+
+			glDeleteSync(segment.fence);
+			segment.fence = nullptr;
+		}
+
+		glm::ivec2 levelSize = GetLevelSize(level);
+		size_t rowSize = (size_t)levelSize.x * GetPixelFormatSize(format);
+		int rows = std::min((int)(segmentSize / rowSize), levelSize.y - row);
+		size_t offset = nextSegment * segmentSize;
+		size_t sliceSize = rows * rowSize;
+
+		const unsigned char* levelPixels = level == 0 ? image->data.data() : mipmapBuild->levels[level - 1].data();
+		const unsigned char* source = levelPixels + (size_t)row * rowSize;
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+
+		if (mapped != nullptr) {
+			memcpy(mapped + offset, source, sliceSize);
+		} else {
+			void* destination = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, sliceSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+
+			if (destination != nullptr)
+				memcpy(destination, source, sliceSize);
+
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, row, levelSize.x, rows, pixelDataFormat, pixelDataType, (const void*)offset);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		row += rows;
+
+		// The level can be sampled now that it's all there
+		if (row >= levelSize.y) {
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level);
+
+			level++;
+			row = 0;
+		}
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		segment.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		nextSegment = (nextSegment + 1) % segments.size();
+
+		// The CPU copies aren't needed once they're all on the GPU
+		if (level >= levelCount)
+			mipmapBuild.reset();
+
+		return true;
+	}
+
+	////////////////////////////////////////
+	///// PUBLIC
+	////////////////////////////////////////
+
+	bool TextureUpload::Continue() {
+		auto start = std::chrono::steady_clock::now();
+
+		while (level < levelCount) {
+			// Comes back next frame if the worker hasn't got to this level yet
+			if (level > 0 && mipmapBuild->levelsBuilt <= level)
+				break;
+
+			if (!UploadSlice())
+				break;
+
+			if (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() > TEXTURE_UPLOAD_BUDGET_MS)
+				break;
+		}
+
+		return level >= levelCount;
+	}
+
+	bool TextureUpload::IsBaseLevelDone() {
+		return level > 0;
+	}
+
+	unsigned int TextureUpload::TakeTexture() {
+		textureTaken = true;
+		return texture;
+	}
+
+	bool TextureUpload::IsTextureTaken() {
+		return textureTaken;
+	}
+
+	PixelFormat TextureUpload::GetFormat() {
+		return format;
+	}
+
+	glm::ivec2 TextureUpload::GetSize() {
+		return { width, height };
+	}
+}
\ No newline at end of file
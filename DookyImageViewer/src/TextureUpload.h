@@ -0,0 +1,78 @@
+#ifndef TEXTUREUPLOAD_H
+#define TEXTUREUPLOAD_H
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "ImageDecoder.h"
+#include "PixelConversion.h"
+
+namespace Dooky {
+	// Uploads a decoded image into a new texture a slice of rows at a time through a pixel buffer object, spread over as many frames as it
+	// takes to stay inside a time budget each frame. Mip levels get built on the shared thread pool while the levels above them upload
+	// The texture can be taken and drawn as soon as the base level is in, the smaller levels keep streaming into it and get turned on
+	// with GL_TEXTURE_MAX_LEVEL as each one finishes
+	class TextureUpload {
+	private:
+		struct StagingSegment {
+			GLsync fence; // Signalled once the GPU has finished reading the segment, null if it's free
+		};
+
+		// Shared with the task building the mip levels so it can outlive this if it's cancelled halfway through a level
+		struct MipmapBuild {
+			std::shared_ptr<const DecodedImage> image; // Level 0
+			std::vector<std::vector<unsigned char>> levels; // Level 1 first, a level is only touched by the task until levelsBuilt covers it
+			std::atomic<int> levelsBuilt; // Including level 0
+			std::atomic<bool> cancelled;
+		};
+
+		std::shared_ptr<const DecodedImage> image; // Keeps level 0 alive
+		PixelFormat format;
+		GLint internalFormat;
+		GLenum pixelDataFormat;
+		GLenum pixelDataType;
+		int width;
+		int height;
+
+		unsigned int texture;
+		bool textureTaken;
+		int levelCount;
+		int level; // Being uploaded
+		int row; // Next row of the level to upload
+		std::shared_ptr<MipmapBuild> mipmapBuild; // Null without mipmaps
+
+		unsigned int buffer;
+		unsigned char* mapped; // Null unless the buffer is persistently mapped
+		size_t segmentSize;
+		std::vector<StagingSegment> segments;
+		int nextSegment;
+
+		static void BuildMipmaps(std::shared_ptr<MipmapBuild> build, DownsampleFilter filter);
+
+		glm::ivec2 GetLevelSize(int level);
+		bool UploadSlice(); // Returns false if the GPU is still reading from the next segment
+	public:
+		TextureUpload(std::shared_ptr<const DecodedImage> image, bool useMipmaps, DownsampleFilter mipmapFilter = DownsampleFilter::Box);
+		~TextureUpload();
+
+		TextureUpload(const TextureUpload&) = delete;
+		TextureUpload& operator=(const TextureUpload&) = delete;
+
+		// Uploads until the frame's budget runs out or the next mip level isn't built yet, returns true once every level is in
+		// Must be called on the thread that owns the OpenGL context
+		bool Continue();
+		bool IsBaseLevelDone();
+
+		// The caller owns it from then on and has to keep calling Continue until it returns true for the rest of the levels to arrive
+		unsigned int TakeTexture();
+		bool IsTextureTaken();
+
+		PixelFormat GetFormat();
+		glm::ivec2 GetSize();
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+namespace Dooky {
+	////////////////////////////////////////
+	///// CLASS: THREAD POOL
+	////////////////////////////////////////
+
+	ThreadPool::ThreadPool(int threadCount) {
+		shouldStop = false;
+
+		if (threadCount < 1)
+			threadCount = 1;
+
+		for (int i = 0; i < threadCount; i++) {
+			workers.emplace_back(&ThreadPool::WorkerLoop, this);
+		}
+	}
+
+	ThreadPool::~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			shouldStop = true;
+		}
+
+		condition.notify_all();
+
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+	}
+
+	////////////////////////////////////////
+	///// PRIVATE
+	////////////////////////////////////////
+
+	void ThreadPool::WorkerLoop() {
+		while (true) {
+			std::function<void()> task;
+
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [&]() { return shouldStop || !tasks.empty(); });
+
+				if (shouldStop && tasks.empty())
+					return;
+
+				task = std::move(tasks.front());
+				tasks.pop_front();
+			}
+
+			task();
+		}
+	}
+
+	////////////////////////////////////////
+	///// PUBLIC
+	////////////////////////////////////////
+
+	void ThreadPool::Submit(std::function<void()> task) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.push_back(std::move(task));
+		}
+
+		condition.notify_one();
+	}
+
+	int ThreadPool::GetThreadCount() {
+		return workers.size();
+	}
+
+	void ThreadPool::ParallelFor(size_t count, size_t minimumChunkSize, const std::function<void(size_t begin, size_t end)>& function) {
+		if (count == 0)
+			return;
+
+		size_t chunkCount = std::min(count / std::max(minimumChunkSize, (size_t)1), workers.size() + 1);
+
+		if (chunkCount <= 1) {
+			function(0, count);
+			return;
+		}
+
+		struct ParallelForState {
+			std::atomic<size_t> nextChunk;
+			std::atomic<size_t> finishedChunks;
+			std::mutex mutex;
+			std::condition_variable finished;
+		};
+
+		// Shared because helpers that only get picked up after everything is done still touch it
+		std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+		state->nextChunk = 0;
+		state->finishedChunks = 0;
+
+		auto RunChunks = [state, chunkCount, count, &function]() {
+			while (true) {
+				size_t chunk = state->nextChunk++;
+
+				if (chunk >= chunkCount)
+					return;
+
+				function(count * chunk / chunkCount, count * (chunk + 1) / chunkCount);
+
+				if (++state->finishedChunks == chunkCount) {
+					std::lock_guard<std::mutex> lock(state->mutex);
+					state->finished.notify_all();
+				}
+			}
+		};
+
+		for (size_t i = 1; i < chunkCount; i++) {
+			Submit(RunChunks);
+		}
+
+		RunChunks();
+
+		std::unique_lock<std::mutex> lock(state->mutex);
+		state->finished.wait(lock, [&]() { return state->finishedChunks == chunkCount; });
+	}
+
+	ThreadPool& GetSharedThreadPool() {
+		static ThreadPool pool(std::max((int)std::thread::hardware_concurrency() - 1, 1));
+		return pool;
+	}
+}
\ No newline at end of file
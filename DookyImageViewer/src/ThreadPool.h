@@ -0,0 +1,38 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+namespace Dooky {
+	// Generic worker threads for splitting up CPU heavy work, e.g converting pixels
+	class ThreadPool {
+	private:
+		std::vector<std::thread> workers;
+		std::deque<std::function<void()>> tasks;
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool shouldStop;
+
+		void WorkerLoop();
+	public:
+		ThreadPool(int threadCount);
+		~ThreadPool();
+
+		void Submit(std::function<void()> task);
+		int GetThreadCount();
+
+		// Splits [0, count) into chunks of at least minimumChunkSize and runs them across the pool, then waits for all of them
+		// The calling thread works on chunks too, so it's fine to call from inside a task or while the pool is busy
+		void ParallelFor(size_t count, size_t minimumChunkSize, const std::function<void(size_t begin, size_t end)>& function);
+	};
+
+	ThreadPool& GetSharedThreadPool(); // Created on first use with a thread per core (minus the one calling ParallelFor)
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,145 @@
+#include "ThumbnailAtlas.h"
+
+#include <cstddef>
+#include <glm/ext/matrix_clip_space.hpp>
+
+namespace Dooky {
+	////////////////////////////////////////
+	///// CLASS: THUMBNAIL ATLAS
+	////////////////////////////////////////
+
+	ThumbnailAtlas::ThumbnailAtlas(int slotSize, int atlasSize) {
+		this->slotSize = slotSize;
+		this->atlasSize = atlasSize;
+		slotsPerRow = atlasSize / (slotSize + 2); // A texel of gutter on each side so neighbours never bleed in
+		instanceBufferCapacity = 0;
+
+		// Handed out lowest first
+		for (int i = slotsPerRow * slotsPerRow - 1; i >= 0; i--) {
+			freeSlots.push_back(i);
+		}
+
+		std::vector<unsigned char> clear((size_t)atlasSize * atlasSize * 4, 0);
+
+		glGenTextures(1, &textureId);
+		glBindTexture(GL_TEXTURE_2D, textureId);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); // Thumbnails are drawn at the size they were made
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasSize, atlasSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, clear.data());
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		// No vertex buffer, the shader makes the corners from gl_VertexID and everything else is per instance
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &instanceBuffer);
+
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), (void*)offsetof(QuadInstance, rect));
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), (void*)offsetof(QuadInstance, textureRect));
+		glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), (void*)offsetof(QuadInstance, color));
+		glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), (void*)offsetof(QuadInstance, textured));
+
+		for (int i = 0; i < 4; i++) {
+			glEnableVertexAttribArray(i);
+			glVertexAttribDivisor(i, 1);
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
+
+		shader.LoadShaderFile("./resources/shaders/Thumbnails.shader");
+	}
+
+	ThumbnailAtlas::~ThumbnailAtlas() {
+		glDeleteTextures(1, &textureId);
+		glDeleteVertexArrays(1, &vao);
+		glDeleteBuffers(1, &instanceBuffer);
+	}
+
+	////////////////////////////////////////
+	///// PRIVATE
+	////////////////////////////////////////
+
+	glm::ivec2 ThumbnailAtlas::GetSlotOrigin(int slot) {
+		return { (slot % slotsPerRow) * (slotSize + 2) + 1, (slot / slotsPerRow) * (slotSize + 2) + 1 };
+	}
+
+	////////////////////////////////////////
+	///// PUBLIC
+	////////////////////////////////////////
+
+	int ThumbnailAtlas::AllocateSlot() {
+		if (freeSlots.empty())
+			return -1;
+
+		int slot = freeSlots.back();
+		freeSlots.pop_back();
+
+		return slot;
+	}
+
+	void ThumbnailAtlas::FreeSlot(int slot) {
+		if (slot >= 0)
+			freeSlots.push_back(slot);
+	}
+
+	void ThumbnailAtlas::Upload(int slot, int width, int height, const std::vector<unsigned char>& bitmap) {
+		if (slot < 0 || width <= 0 || height <= 0 || width > slotSize || height > slotSize || bitmap.size() < (size_t)width * height * 4)
+			return;
+
+		glm::ivec2 origin = GetSlotOrigin(slot);
+
+		glBindTexture(GL_TEXTURE_2D, textureId);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, origin.x, origin.y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, bitmap.data());
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	void ThumbnailAtlas::AddQuad(glm::vec4 rect, glm::vec4 color) {
+		quads.push_back({ rect, { 0.0f, 0.0f, 0.0f, 0.0f }, color, 0.0f });
+	}
+
+	void ThumbnailAtlas::AddQuad(glm::vec4 rect, int slot, glm::ivec2 size) {
+		glm::vec2 origin = GetSlotOrigin(slot);
+		glm::vec4 textureRect = glm::vec4(origin.x, origin.y, size.x, size.y) / (float)atlasSize;
+
+		quads.push_back({ rect, textureRect, { 1.0f, 1.0f, 1.0f, 1.0f }, 1.0f });
+	}
+
+	void ThumbnailAtlas::Draw(Window& window) {
+		if (quads.empty())
+			return;
+
+		glm::ivec2 winSize = window.GetSize();
+
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+
+		// Only grows, the same buffer gets refilled every frame
+		if (quads.size() > instanceBufferCapacity) {
+			instanceBufferCapacity = quads.size() * 2;
+			glBufferData(GL_ARRAY_BUFFER, sizeof(QuadInstance) * instanceBufferCapacity, nullptr, GL_DYNAMIC_DRAW);
+		}
+
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(QuadInstance) * quads.size(), quads.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		shader.Bind();
+		shader.SetUniformMat4fv("projection", glm::ortho(0.0f, (float)winSize.x, (float)winSize.y, 0.0f)); // Top left origin like the rects
+		shader.SetUniform1i("atlas", 0);
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, textureId);
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)quads.size());
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindVertexArray(0);
+
+		shader.Unbind();
+
+		quads.clear();
+	}
+}
\ No newline at end of file
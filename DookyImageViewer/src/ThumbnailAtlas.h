@@ -0,0 +1,56 @@
+#ifndef THUMBNAILATLAS_H
+#define THUMBNAILATLAS_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include <GL/glew.h>
+
+#include "Window.h"
+#include "Shader.h"
+
+namespace Dooky {
+	// All the thumbnails in the strip share one texture split into equal slots, everything added with AddQuad goes out in a single
+	// instanced draw. Needs the GL context to exist before it's made
+	class ThumbnailAtlas {
+	private:
+		struct QuadInstance {
+			glm::vec4 rect; // Window pixels from the top left
+			glm::vec4 textureRect; // Atlas coordinates, starting from the bottom row
+			glm::vec4 color;
+			float textured;
+		};
+
+		unsigned int textureId;
+		unsigned int vao;
+		unsigned int instanceBuffer;
+		size_t instanceBufferCapacity; // In quads
+
+		Shader shader;
+
+		int atlasSize;
+		int slotSize;
+		int slotsPerRow;
+		std::vector<int> freeSlots;
+
+		std::vector<QuadInstance> quads;
+
+		glm::ivec2 GetSlotOrigin(int slot); // Texel the slot's pixels start at, the gutter is around it
+	public:
+		ThumbnailAtlas(int slotSize, int atlasSize = 1024);
+		~ThumbnailAtlas();
+
+		ThumbnailAtlas(const ThumbnailAtlas&) = delete;
+		ThumbnailAtlas& operator=(const ThumbnailAtlas&) = delete;
+
+		int AllocateSlot(); // -1 if they're all taken
+		void FreeSlot(int slot);
+		void Upload(int slot, int width, int height, const std::vector<unsigned char>& bitmap); // RGBA8, bottom row first, no bigger than the slot
+
+		void AddQuad(glm::vec4 rect, glm::vec4 color);
+		void AddQuad(glm::vec4 rect, int slot, glm::ivec2 size); // Size of what was uploaded to the slot
+
+		void Draw(Window& window); // Draws everything added since the last one
+	};
+}
+
+#endif
\ No newline at end of file
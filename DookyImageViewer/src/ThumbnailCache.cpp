@@ -0,0 +1,573 @@
+#include "ThumbnailCache.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <Magick++.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <bcrypt.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "vendor/stb_image/stb_image.h"
+
+const int THUMBNAIL_CACHE_NORMAL_SIZE = 128; // Set by the spec
+const int THUMBNAIL_CACHE_LARGE_SIZE = 256;
+const char* THUMBNAIL_CACHE_FAIL_DIRECTORY = "fail/DookyImageViewer"; // Files that couldn't be made into thumbnails, so they aren't tried again
+
+namespace Dooky {
+	////////////////////////////////////////
+	///// MD5
+	////////////////////////////////////////
+
+#ifdef _WIN32
+	bool GetMD5Digest(const std::string& text, unsigned char digest[16]) {
+		return BCRYPT_SUCCESS(BCryptHash(BCRYPT_MD5_ALG_HANDLE, nullptr, 0, (PUCHAR)text.data(), (ULONG)text.size(), digest, 16));
+	}
+#else
+	// Nothing else this links against has MD5 outside of Windows
+	bool GetMD5Digest(const std::string& text, unsigned char digest[16]) {
+		static const int SHIFTS[64] = {
+			7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+			5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+			4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+			6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+		};
+
+		// floor(abs(sin(i + 1)) * 2^32)
+		static const uint32_t SINES[64] = {
+			0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+			0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+			0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+			0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+			0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+			0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+			0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+			0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+		};
+
+		// Padded with a 1 bit and zeros up to 8 bytes short of a whole block, then the length in bits
+		std::vector<unsigned char> message(text.begin(), text.end());
+		uint64_t bitLength = (uint64_t)text.size() * 8;
+
+		message.push_back(0x80);
+
+		while (message.size() % 64 != 56) {
+			message.push_back(0);
+		}
+
+		for (int i = 0; i < 8; i++) {
+			message.push_back((unsigned char)(bitLength >> (i * 8)));
+		}
+
+		uint32_t state[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+
+		for (size_t offset = 0; offset < message.size(); offset += 64) {
+			uint32_t words[16];
+
+			for (int i = 0; i < 16; i++) {
+				const unsigned char* p = &message[offset + i * 4];
+				words[i] = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+			}
+
+			uint32_t a = state[0];
+			uint32_t b = state[1];
+			uint32_t c = state[2];
+			uint32_t d = state[3];
+
+			for (int i = 0; i < 64; i++) {
+				uint32_t f;
+				int g;
+
+				if (i < 16) {
+					f = (b & c) | (~b & d);
+					g = i;
+				} else if (i < 32) {
+					f = (d & b) | (~d & c);
+					g = (i * 5 + 1) % 16;
+				} else if (i < 48) {
+					f = b ^ c ^ d;
+					g = (i * 3 + 5) % 16;
+				} else {
+					f = c ^ (b | ~d);
+					g = (i * 7) % 16;
+				}
+
+				f += a + SINES[i] + words[g];
+				a = d;
+				d = c;
+				c = b;
+				b += (f << SHIFTS[i]) | (f >> (32 - SHIFTS[i]));
+			}
+
+			state[0] += a;
+			state[1] += b;
+			state[2] += c;
+			state[3] += d;
+		}
+
+		for (int i = 0; i < 16; i++) {
+			digest[i] = (unsigned char)(state[i / 4] >> ((i % 4) * 8));
+		}
+
+		return true;
+	}
+#endif
+
+	std::string GetMD5String(const std::string& text) {
+		unsigned char digest[16];
+
+		if (!GetMD5Digest(text, digest))
+			return "";
+
+		const char* hex = "0123456789abcdef";
+		std::string result;
+
+		for (int i = 0; i < 16; i++) {
+			result += hex[digest[i] >> 4];
+			result += hex[digest[i] & 15];
+		}
+
+		return result;
+	}
+
+	////////////////////////////////////////
+	///// PNG
+	////////////////////////////////////////
+
+	// Pixels are RGBA8 top row first, ImageMagick writes every attribute as a text chunk (zTXt once it's 128 bytes or longer)
+	bool EncodePNG(const unsigned char* pixels, int width, int height, const std::vector<std::pair<std::string, std::string>>& text, std::vector<unsigned char>& png) {
+		try {
+			Magick::Image image(width, height, "RGBA", Magick::CharPixel, pixels);
+			image.depth(8);
+			image.magick("PNG");
+
+			for (const std::pair<std::string, std::string>& entry : text) {
+				image.attribute(entry.first, entry.second);
+			}
+
+			Magick::Blob blob;
+			image.write(&blob);
+
+			png.assign((const unsigned char*)blob.data(), (const unsigned char*)blob.data() + blob.length());
+		} catch (std::exception& exception) {
+			std::cout << "ERROR: Failed to encode thumbnail: " << exception.what() << std::endl;
+			return false;
+		}
+
+		return !png.empty();
+	}
+
+	// zTXt and compressed iTXt hold a zlib stream
+	bool InflatePNGText(const unsigned char* data, size_t length, std::string& value) {
+		int inflatedLength = 0;
+		char* inflated = stbi_zlib_decode_malloc((const char*)data, (int)length, &inflatedLength);
+
+		if (inflated == nullptr)
+			return false;
+
+		value.assign(inflated, inflatedLength);
+		stbi_image_free(inflated);
+
+		return true;
+	}
+
+	// Value of a tEXt, zTXt or iTXt chunk
+	bool FindPNGText(const std::vector<unsigned char>& png, const std::string& keyword, std::string& value) {
+		size_t offset = 8; // Skip signature
+
+		while (offset + 12 <= png.size()) {
+			size_t length = ((size_t)png[offset] << 24) | (png[offset + 1] << 16) | (png[offset + 2] << 8) | png[offset + 3];
+			const unsigned char* type = &png[offset + 4];
+			const unsigned char* data = &png[offset + 8];
+
+			if (length > png.size() - offset - 12 || memcmp(type, "IEND", 4) == 0)
+				return false;
+
+			bool isText = memcmp(type, "tEXt", 4) == 0 || memcmp(type, "zTXt", 4) == 0 || memcmp(type, "iTXt", 4) == 0;
+
+			if (isText && length > keyword.size() && memcmp(data, keyword.c_str(), keyword.size() + 1) == 0) {
+				const unsigned char* text = data + keyword.size() + 1;
+				const unsigned char* end = data + length;
+
+				if (type[0] == 't') {
+					value.assign(text, end);
+					return true;
+				}
+
+				if (type[0] == 'z') // Compression method, then the compressed text
+					return end - text > 1 && InflatePNGText(text + 1, end - text - 1, value);
+
+				// Compression flag and method, then the language and translated keyword which both end with a 0
+				if (end - text < 2)
+					return false;
+
+				bool compressed = text[0] != 0;
+				const unsigned char* language = (const unsigned char*)memchr(text + 2, 0, end - text - 2);
+				const unsigned char* translated = language != nullptr ? (const unsigned char*)memchr(language + 1, 0, end - language - 1) : nullptr;
+
+				if (translated == nullptr)
+					return false;
+
+				if (!compressed) {
+					value.assign(translated + 1, end);
+					return true;
+				}
+
+				return InflatePNGText(translated + 1, end - translated - 1, value);
+			}
+
+			offset += 12 + length; // Length, type, data and CRC
+		}
+
+		return false;
+	}
+
+	////////////////////////////////////////
+	///// CACHE
+	////////////////////////////////////////
+
+	std::string GetEnvironmentString(const char* name) {
+#ifdef _WIN32
+		char* value = nullptr;
+		size_t length = 0;
+
+		if (_dupenv_s(&value, &length, name) != 0 || value == nullptr)
+			return "";
+
+		std::string result = value;
+		free(value);
+
+		return result;
+#else
+		const char* value = std::getenv(name);
+		return value != nullptr ? value : "";
+#endif
+	}
+
+	// XDG_CACHE_HOME or ~/.cache, empty if neither is set
+	std::filesystem::path GetXDGCacheHome() {
+		std::string cacheHome = GetEnvironmentString("XDG_CACHE_HOME");
+
+		if (!cacheHome.empty() && std::filesystem::path(cacheHome).is_absolute())
+			return cacheHome;
+
+		std::string home = GetEnvironmentString("HOME");
+
+		if (home.empty())
+			return std::filesystem::path();
+
+		return std::filesystem::path(home) / ".cache";
+	}
+
+	std::filesystem::path GetApplicationCacheDirectory() {
+#ifdef _WIN32
+		std::string localAppData = GetEnvironmentString("LOCALAPPDATA");
+
+		if (localAppData.empty())
+			return std::filesystem::path();
+
+		return std::filesystem::path(localAppData) / "DookyImageViewer";
+#else
+		std::filesystem::path cacheHome = GetXDGCacheHome();
+
+		if (cacheHome.empty())
+			return std::filesystem::path();
+
+		return cacheHome / "DookyImageViewer";
+#endif
+	}
+
+	std::filesystem::path GetThumbnailCacheDirectory() {
+#ifdef _WIN32
+		// Nothing else on Windows reads the freedesktop cache, so it's kept with the rest of this program's cache
+		std::filesystem::path applicationCache = GetApplicationCacheDirectory();
+
+		if (applicationCache.empty())
+			return std::filesystem::path();
+
+		return applicationCache / "thumbnails";
+#else
+		std::filesystem::path cacheHome = GetXDGCacheHome();
+
+		if (cacheHome.empty())
+			return std::filesystem::path();
+
+		return cacheHome / "thumbnails";
+#endif
+	}
+
+	std::string GetThumbnailURI(const std::filesystem::path& path) {
+		std::error_code error;
+		std::filesystem::path absolutePath = std::filesystem::absolute(path, error).lexically_normal();
+
+		if (error)
+			absolutePath = path;
+
+		std::u8string utf8 = absolutePath.generic_u8string();
+		std::string uri = "file://";
+
+		// Windows paths start with the drive letter
+		if (utf8.empty() || utf8[0] != u8'/')
+			uri += '/';
+
+		// Same characters GLib leaves alone, so the hashes match the ones file managers make
+		const char* hex = "0123456789ABCDEF";
+
+		for (char8_t character : utf8) {
+			unsigned char c = (unsigned char)character;
+
+			if ((c < 0x80 && isalnum(c)) || (c != 0 && strchr("!$&'()*+,-./:=@_~", c) != nullptr)) {
+				uri += (char)c;
+			} else {
+				uri += '%';
+				uri += hex[c >> 4];
+				uri += hex[c & 15];
+			}
+		}
+
+		return uri;
+	}
+
+	struct ThumbnailSourceInfo {
+		std::string uri;
+		std::string modifiedTime; // Seconds since 1970
+		std::string size;
+	};
+
+	bool GetThumbnailFileStamp(const std::filesystem::path& path, long long& modifiedTime, unsigned long long& size) {
+#ifdef _WIN32
+		std::error_code error;
+		std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(path, error);
+
+		if (error)
+			return false;
+
+		size = std::filesystem::file_size(path, error);
+
+		if (error)
+			return false;
+
+		auto sinceEpoch = std::chrono::clock_cast<std::chrono::system_clock>(writeTime).time_since_epoch();
+		modifiedTime = std::chrono::floor<std::chrono::seconds>(sinceEpoch).count();
+
+		return true;
+#else
+		// Straight from stat like file managers do, clock_cast isn't in libstdc++ before 13 either
+		struct stat status;
+
+		if (stat(path.c_str(), &status) != 0 || !S_ISREG(status.st_mode))
+			return false;
+
+		modifiedTime = status.st_mtime;
+		size = status.st_size;
+
+		return true;
+#endif
+	}
+
+	bool GetThumbnailSourceInfo(const std::filesystem::path& path, ThumbnailSourceInfo& info) {
+		long long modifiedTime;
+		unsigned long long size;
+
+		if (!GetThumbnailFileStamp(path, modifiedTime, size))
+			return false;
+
+		info.uri = GetThumbnailURI(path);
+		info.modifiedTime = std::to_string(modifiedTime);
+		info.size = std::to_string(size);
+
+		return true;
+	}
+
+	// A thumbnail only counts if it was made from this exact version of the file, Thumb::Size is optional in the spec
+	bool IsThumbnailUpToDate(const std::vector<unsigned char>& png, const ThumbnailSourceInfo& info) {
+		std::string uri;
+		std::string modifiedTime;
+		std::string size;
+
+		if (!FindPNGText(png, "Thumb::URI", uri) || uri != info.uri)
+			return false;
+
+		if (!FindPNGText(png, "Thumb::MTime", modifiedTime) || std::strtoll(modifiedTime.c_str(), nullptr, 10) != std::stoll(info.modifiedTime))
+			return false;
+
+		if (FindPNGText(png, "Thumb::Size", size) && size != info.size)
+			return false;
+
+		return true;
+	}
+
+	bool ReadCachedThumbnail(const std::filesystem::path& cachePath, const ThumbnailSourceInfo& info, std::vector<unsigned char>& png) {
+		std::ifstream input(cachePath, std::ios::binary | std::ios::ate);
+
+		if (!input.is_open())
+			return false;
+
+		std::streamsize length = input.tellg();
+
+		if (length <= 8)
+			return false;
+
+		png.resize(length);
+		input.seekg(0);
+		input.read((char*)png.data(), length);
+
+		return input.good() && memcmp(png.data(), "\x89PNG\r\n\x1A\n", 8) == 0 && IsThumbnailUpToDate(png, info);
+	}
+
+	bool DecodeCachedThumbnail(const std::vector<unsigned char>& png, FileThumbnailImage& thumbnailImage) {
+		int width = 0;
+		int height = 0;
+		int components = 0;
+		unsigned char* pixels = stbi_load_from_memory(png.data(), (int)png.size(), &width, &height, &components, 4);
+
+		if (pixels == nullptr)
+			return false;
+
+		size_t stride = (size_t)width * 4;
+
+		thumbnailImage.bitmap.resize(stride * height);
+
+		// Bottom row first
+		for (int y = 0; y < height; y++) {
+			memcpy(&thumbnailImage.bitmap[(height - 1 - y) * stride], pixels + y * stride, stride);
+		}
+
+		stbi_image_free(pixels);
+
+		thumbnailImage.width = width;
+		thumbnailImage.height = height;
+		thumbnailImage.success = true;
+
+		return true;
+	}
+
+	// Written to a temporary file and renamed over, so other programs never see half a thumbnail. Only the user gets to read them
+	void WriteCachedThumbnail(const std::filesystem::path& cachePath, const ThumbnailSourceInfo& info, const FileThumbnailImage& thumbnailImage) {
+		std::error_code error;
+		std::filesystem::create_directories(cachePath.parent_path(), error);
+		std::filesystem::permissions(cachePath.parent_path(), std::filesystem::perms::owner_all, error);
+
+		std::vector<unsigned char> pixels(thumbnailImage.bitmap.size());
+		size_t stride = (size_t)thumbnailImage.width * 4;
+
+		for (int y = 0; y < thumbnailImage.height; y++) {
+			memcpy(&pixels[y * stride], &thumbnailImage.bitmap[(thumbnailImage.height - 1 - y) * stride], stride);
+		}
+
+		std::vector<unsigned char> png;
+
+		bool encoded = EncodePNG(pixels.data(), thumbnailImage.width, thumbnailImage.height, {
+			{ "Thumb::URI", info.uri },
+			{ "Thumb::MTime", info.modifiedTime },
+			{ "Thumb::Size", info.size },
+			{ "Software", "DookyImageViewer" }
+		}, png);
+
+		if (!encoded)
+			return;
+
+		std::filesystem::path temporaryPath = cachePath;
+		temporaryPath += "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+
+		{
+			std::ofstream output(temporaryPath, std::ios::binary | std::ios::trunc);
+
+			if (!output.is_open())
+				return;
+
+			output.write((const char*)png.data(), png.size());
+
+			if (!output.good()) {
+				output.close();
+				std::filesystem::remove(temporaryPath, error);
+				return;
+			}
+		}
+
+		std::filesystem::permissions(temporaryPath, std::filesystem::perms::owner_read | std::filesystem::perms::owner_write, error);
+		std::filesystem::rename(temporaryPath, cachePath, error);
+
+		if (error)
+			std::filesystem::remove(temporaryPath, error);
+	}
+
+	FileThumbnailImage GetCachedImageFileThumbnail(const std::filesystem::path& path, int targetSize, const std::atomic<bool>* cancelled) {
+		std::filesystem::path cacheDirectory = GetThumbnailCacheDirectory();
+		ThumbnailSourceInfo info;
+
+		if (cacheDirectory.empty() || !GetThumbnailSourceInfo(path, info))
+			return GetImageFileThumbnail(path, targetSize, cancelled);
+
+		// The spec says not to make thumbnails of thumbnails
+		std::error_code error;
+		std::filesystem::path absolutePath = std::filesystem::absolute(path, error).lexically_normal();
+		std::filesystem::path relativePath = absolutePath.lexically_relative(cacheDirectory);
+
+		if (!relativePath.empty() && *relativePath.begin() != "..")
+			return GetImageFileThumbnail(path, targetSize, cancelled);
+
+		std::string fileName = GetMD5String(info.uri) + ".png";
+		bool wantsLarge = targetSize > THUMBNAIL_CACHE_NORMAL_SIZE;
+		std::filesystem::path normalPath = cacheDirectory / "normal" / fileName;
+		std::filesystem::path largePath = cacheDirectory / "large" / fileName;
+		std::vector<unsigned char> png;
+
+		// A large one made by something else is just as good if it has to be shrunk anyway
+		std::vector<std::filesystem::path> cachePaths = { largePath };
+
+		if (!wantsLarge)
+			cachePaths.insert(cachePaths.begin(), normalPath);
+
+		for (const std::filesystem::path& cachePath : cachePaths) {
+			FileThumbnailImage cached;
+
+			if (ReadCachedThumbnail(cachePath, info, png) && DecodeCachedThumbnail(png, cached))
+				return ShrinkThumbnail(cached, targetSize);
+		}
+
+		FileThumbnailImage thumbnailImage;
+		thumbnailImage.success = false;
+		thumbnailImage.width = 0;
+		thumbnailImage.height = 0;
+
+		std::filesystem::path failPath = cacheDirectory / THUMBNAIL_CACHE_FAIL_DIRECTORY / fileName;
+
+		if (ReadCachedThumbnail(failPath, info, png))
+			return thumbnailImage;
+
+		// Missing or out of date, this is already off the main thread so it just gets made again here
+		FileThumbnailImage made = GetImageFileThumbnail(path, wantsLarge ? THUMBNAIL_CACHE_LARGE_SIZE : THUMBNAIL_CACHE_NORMAL_SIZE, cancelled);
+
+		if (cancelled != nullptr && cancelled->load())
+			return thumbnailImage;
+
+		if (!made.success) {
+			// Failures are saved as a 1x1 image
+			FileThumbnailImage failed;
+			failed.success = true;
+			failed.width = 1;
+			failed.height = 1;
+			failed.bitmap = { 0, 0, 0, 0 };
+
+			WriteCachedThumbnail(failPath, info, failed);
+
+			return thumbnailImage;
+		}
+
+		WriteCachedThumbnail(wantsLarge ? largePath : normalPath, info, made);
+
+		return ShrinkThumbnail(made, targetSize);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include <filesystem>
+#include <string>
+#include <atomic>
+
+#include "ImageUtils.h"
+
+namespace Dooky {
+	// Thumbnails are shared with file managers through the freedesktop thumbnail spec, they live in ~/.cache/thumbnails/normal (128px)
+	// and large (256px) as PNGs named after the MD5 of the file's URI. Thumb::MTime and Thumb::Size inside them say which version of the
+	// file they were made from. Windows has nothing that reads those, so there it's the same layout in %LOCALAPPDATA%\DookyImageViewer
+	std::filesystem::path GetApplicationCacheDirectory(); // Where this program keeps its own cache, empty if there's nowhere to put it
+	std::filesystem::path GetThumbnailCacheDirectory(); // Empty if there's nowhere to put it
+	std::string GetThumbnailURI(const std::filesystem::path& path); // file:// URI of the absolute path, what the cache names are hashed from
+	std::string GetMD5String(const std::string& text); // Lowercase hex
+	bool GetThumbnailFileStamp(const std::filesystem::path& path, long long& modifiedTime, unsigned long long& size); // Seconds since 1970 and bytes
+
+	// Loads the cached thumbnail if it's still up to date, otherwise makes one and saves it for next time. Same threading and cancelling
+	// rules as GetImageFileThumbnail
+	FileThumbnailImage GetCachedImageFileThumbnail(const std::filesystem::path& path, int targetSize, const std::atomic<bool>* cancelled = nullptr);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,216 @@
+#include "ThumbnailEngine.h"
+#include "ThumbnailCache.h"
+
+#include <cstdlib>
+#include <algorithm>
+
+size_t THUMBNAIL_PACK_SAVE_COUNT = 256; // Unsaved thumbnails before the pack gets saved while there are still requests left
+
+namespace Dooky {
+	////////////////////////////////////////
+	///// CLASS: THUMBNAIL ENGINE
+	////////////////////////////////////////
+
+	ThumbnailEngine::ThumbnailEngine(int threadCount, int thumbnailSize) {
+		shouldStop = false;
+		nextRequestId = 0;
+		centerIndex = 0;
+		useThumbnailPacks = false;
+		this->thumbnailSize = thumbnailSize;
+
+		if (threadCount < 1)
+			threadCount = 1;
+
+		for (int i = 0; i < threadCount; i++) {
+			workers.emplace_back(&ThumbnailEngine::WorkerLoop, this);
+		}
+	}
+
+	ThumbnailEngine::~ThumbnailEngine() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			shouldStop = true;
+
+			for (ThumbnailRequest& request : activeRequests) {
+				request.cancelled->store(true);
+			}
+
+			pendingRequests.clear();
+		}
+
+		condition.notify_all();
+
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+
+		pack.Save();
+	}
+
+	////////////////////////////////////////
+	///// PRIVATE
+	////////////////////////////////////////
+
+	FileThumbnailImage ThumbnailEngine::MakeThumbnail(const ThumbnailRequest& request) {
+		std::filesystem::path directory = request.path.parent_path();
+		std::u8string fileName = request.path.filename().u8string();
+		std::string packName(fileName.begin(), fileName.end());
+		long long modifiedTime;
+		unsigned long long fileSize;
+
+		bool usePack = useThumbnailPacks && GetThumbnailFileStamp(request.path, modifiedTime, fileSize);
+
+		if (usePack) {
+			std::lock_guard<std::mutex> lock(packMutex);
+
+			if (directory != packDirectory) {
+				pack.Save();
+				pack.Open(directory, thumbnailSize);
+				packDirectory = directory;
+			}
+
+			FileThumbnailImage thumbnail;
+
+			if (pack.Find(packName, modifiedTime, fileSize, thumbnail))
+				return thumbnail;
+		}
+
+		FileThumbnailImage thumbnail = GetCachedImageFileThumbnail(request.path, thumbnailSize, request.cancelled.get());
+
+		if (usePack && !request.cancelled->load()) {
+			std::lock_guard<std::mutex> lock(packMutex);
+
+			if (directory == packDirectory) {
+				pack.Add(packName, modifiedTime, fileSize, thumbnail);
+
+				if (pack.GetUnsavedCount() >= THUMBNAIL_PACK_SAVE_COUNT)
+					pack.Save();
+			}
+		}
+
+		return thumbnail;
+	}
+
+	void ThumbnailEngine::WorkerLoop() {
+		while (true) {
+			ThumbnailRequest request;
+
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [&]() { return shouldStop || !pendingRequests.empty(); });
+
+				if (shouldStop)
+					return;
+
+				// Closest to where the user is looking first, the centre moves so it's worked out when a request is picked up
+				auto next = std::min_element(pendingRequests.begin(), pendingRequests.end(), [&](const ThumbnailRequest& a, const ThumbnailRequest& b) {
+					return std::abs(a.listIndex - centerIndex) < std::abs(b.listIndex - centerIndex);
+				});
+
+				request = *next;
+				pendingRequests.erase(next);
+				activeRequests.push_back(request);
+			}
+
+			ThumbnailResult result;
+			result.requestId = request.requestId;
+			result.listIndex = request.listIndex;
+			result.path = request.path;
+			result.thumbnail = MakeThumbnail(request);
+
+			bool idle;
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				activeRequests.erase(std::remove_if(activeRequests.begin(), activeRequests.end(), [&](const ThumbnailRequest& r) {
+					return r.requestId == request.requestId;
+				}), activeRequests.end());
+
+				if (!request.cancelled->load())
+					finishedResults.push_back(std::move(result));
+
+				idle = pendingRequests.empty();
+			}
+
+			// Nothing left to do for now, so it's a good time to write out whatever was made
+			if (idle) {
+				std::lock_guard<std::mutex> lock(packMutex);
+				pack.Save();
+			}
+		}
+	}
+
+	////////////////////////////////////////
+	///// PUBLIC
+	////////////////////////////////////////
+
+	int ThumbnailEngine::Request(const std::filesystem::path& path, int listIndex) {
+		int requestId;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			requestId = nextRequestId++;
+
+			ThumbnailRequest request;
+			request.requestId = requestId;
+			request.listIndex = listIndex;
+			request.path = path;
+			request.cancelled = std::make_shared<std::atomic<bool>>(false);
+
+			pendingRequests.push_back(request);
+		}
+
+		condition.notify_one();
+
+		return requestId;
+	}
+
+	void ThumbnailEngine::Cancel(int requestId) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		pendingRequests.erase(std::remove_if(pendingRequests.begin(), pendingRequests.end(), [&](const ThumbnailRequest& r) {
+			return r.requestId == requestId;
+		}), pendingRequests.end());
+
+		for (ThumbnailRequest& request : activeRequests) {
+			if (request.requestId == requestId)
+				request.cancelled->store(true);
+		}
+
+		finishedResults.erase(std::remove_if(finishedResults.begin(), finishedResults.end(), [&](const ThumbnailResult& r) {
+			return r.requestId == requestId;
+		}), finishedResults.end());
+	}
+
+	void ThumbnailEngine::CancelAll() {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		pendingRequests.clear();
+
+		for (ThumbnailRequest& request : activeRequests) {
+			request.cancelled->store(true);
+		}
+
+		finishedResults.clear();
+	}
+
+	void ThumbnailEngine::SetCenterIndex(int index) {
+		std::lock_guard<std::mutex> lock(mutex);
+		centerIndex = index;
+	}
+
+	void ThumbnailEngine::SetUseThumbnailPacks(bool use) {
+		useThumbnailPacks = use;
+	}
+
+	std::vector<ThumbnailResult> ThumbnailEngine::PollFinished() {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		std::vector<ThumbnailResult> results;
+		results.swap(finishedResults);
+
+		return results;
+	}
+}
\ No newline at end of file
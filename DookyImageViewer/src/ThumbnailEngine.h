@@ -0,0 +1,69 @@
+#ifndef THUMBNAILENGINE_H
+#define THUMBNAILENGINE_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <filesystem>
+
+#include "ImageUtils.h"
+#include "ThumbnailPack.h"
+
+namespace Dooky {
+	struct ThumbnailResult {
+		int requestId;
+		int listIndex; // Index into the browsing list the request was made for
+		std::filesystem::path path;
+		FileThumbnailImage thumbnail;
+	};
+
+	// Makes thumbnails on worker threads, whichever request is closest to the centre index gets picked up next
+	// They go through the shared thumbnail cache on disk, so folders that have been opened before only need a PNG read per file.
+	// With thumbnail packs on they don't even need that, the whole directory's thumbnails come out of one mapped file
+	class ThumbnailEngine {
+	private:
+		struct ThumbnailRequest {
+			int requestId;
+			int listIndex;
+			std::filesystem::path path;
+			std::shared_ptr<std::atomic<bool>> cancelled;
+		};
+
+		std::vector<std::thread> workers;
+		std::deque<ThumbnailRequest> pendingRequests;
+		std::vector<ThumbnailRequest> activeRequests; // Requests currently being made by a worker
+		std::vector<ThumbnailResult> finishedResults;
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool shouldStop;
+		int nextRequestId;
+		int centerIndex;
+		int thumbnailSize;
+
+		std::atomic<bool> useThumbnailPacks;
+		std::mutex packMutex; // Separate so saving the pack doesn't hold up requests
+		std::filesystem::path packDirectory;
+		ThumbnailPack pack; // Only one directory at a time, browsing lists almost never span more
+
+		FileThumbnailImage MakeThumbnail(const ThumbnailRequest& request);
+		void WorkerLoop();
+	public:
+		ThumbnailEngine(int threadCount, int thumbnailSize);
+		~ThumbnailEngine();
+
+		int Request(const std::filesystem::path& path, int listIndex); // Returns the request id
+		void Cancel(int requestId);
+		void CancelAll();
+		void SetCenterIndex(int index); // Usually the browsing list index of the image being looked at
+		void SetUseThumbnailPacks(bool use);
+
+		std::vector<ThumbnailResult> PollFinished(); // Call on the main thread, cancelled requests are never returned
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,368 @@
+#include "ThumbnailPack.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#include "ThumbnailCache.h"
+#include "BlockCompression.h"
+
+const uint32_t THUMBNAIL_PACK_VERSION = 1; // Packs from any other version are thrown away and made again
+
+namespace Dooky {
+	// Payloads and names first, then the index, the header at the start points to whichever index was written last
+	struct ThumbnailPackHeader {
+		char magic[4]; // DKTP
+		uint32_t version;
+		uint32_t thumbnailSize;
+		uint32_t entryCount;
+		uint64_t indexOffset;
+	};
+
+	struct ThumbnailPackEntry {
+		uint64_t nameOffset; // UTF-8 file name
+		uint64_t payloadOffset;
+		uint64_t payloadSize;
+		int64_t modifiedTime;
+		uint64_t fileSize;
+		uint32_t nameLength;
+		uint32_t width; // 0 if the file couldn't be made into a thumbnail
+		uint32_t height;
+		uint32_t format;
+	};
+
+	enum ThumbnailPackFormat {
+		THUMBNAIL_PACK_RGBA8,
+		THUMBNAIL_PACK_BC1, // Opaque thumbnails, an eighth of the size
+		THUMBNAIL_PACK_BC7
+	};
+
+	bool DecodeThumbnailPackPayload(const unsigned char* payload, size_t payloadSize, int width, int height, int format, FileThumbnailImage& thumbnail) {
+		size_t expectedSize;
+
+		switch (format) {
+		case THUMBNAIL_PACK_RGBA8: expectedSize = (size_t)width * height * 4; break;
+		case THUMBNAIL_PACK_BC1: expectedSize = GetBlockCompressedSize(BlockFormat::BC1, width, height); break;
+		case THUMBNAIL_PACK_BC7: expectedSize = GetBlockCompressedSize(BlockFormat::BC7, width, height); break;
+		default: return false;
+		}
+
+		if (payloadSize != expectedSize)
+			return false;
+
+		thumbnail.bitmap.resize((size_t)width * height * 4);
+
+		if (format == THUMBNAIL_PACK_RGBA8) {
+			memcpy(thumbnail.bitmap.data(), payload, payloadSize);
+		} else if (!DecompressBlocks(payload, width, height, format == THUMBNAIL_PACK_BC1 ? BlockFormat::BC1 : BlockFormat::BC7, thumbnail.bitmap.data())) {
+			return false;
+		}
+
+		thumbnail.width = width;
+		thumbnail.height = height;
+		thumbnail.success = true;
+
+		return true;
+	}
+
+	////////////////////////////////////////
+	///// CLASS: THUMBNAIL PACK
+	////////////////////////////////////////
+
+	ThumbnailPack::ThumbnailPack() {
+		thumbnailSize = 0;
+		entries = nullptr;
+		entryCount = 0;
+	}
+
+	////////////////////////////////////////
+	///// PRIVATE
+	////////////////////////////////////////
+
+	void ThumbnailPack::Map() {
+		file.Close();
+		entries = nullptr;
+		entryCount = 0;
+		entryLookup.clear();
+
+		if (!file.Open(packPath))
+			return;
+
+		const unsigned char* data = file.GetData();
+		size_t size = file.GetSize();
+
+		if (size < sizeof(ThumbnailPackHeader)) {
+			file.Close();
+			return;
+		}
+
+		const ThumbnailPackHeader* header = (const ThumbnailPackHeader*)data;
+
+		bool valid = memcmp(header->magic, "DKTP", 4) == 0 && header->version == THUMBNAIL_PACK_VERSION && header->thumbnailSize == (uint32_t)thumbnailSize &&
+			header->indexOffset % 8 == 0 && header->indexOffset <= size && header->entryCount <= (size - header->indexOffset) / sizeof(ThumbnailPackEntry);
+
+		if (!valid) {
+			file.Close();
+			return;
+		}
+
+		const ThumbnailPackEntry* index = (const ThumbnailPackEntry*)(data + header->indexOffset);
+
+		for (size_t i = 0; i < header->entryCount; i++) {
+			const ThumbnailPackEntry& entry = index[i];
+
+			if (entry.nameOffset > size || entry.nameLength > size - entry.nameOffset || entry.payloadOffset > size || entry.payloadSize > size - entry.payloadOffset) {
+				file.Close();
+				entryLookup.clear();
+				return;
+			}
+
+			entryLookup[std::string((const char*)data + entry.nameOffset, entry.nameLength)] = i;
+		}
+
+		entries = index;
+		entryCount = header->entryCount;
+	}
+
+	////////////////////////////////////////
+	///// PUBLIC
+	////////////////////////////////////////
+
+	bool ThumbnailPack::Open(const std::filesystem::path& directory, int thumbnailSize) {
+		Close();
+
+		std::filesystem::path cacheDirectory = GetApplicationCacheDirectory();
+
+		if (cacheDirectory.empty())
+			return false;
+
+		// Not in with the shared thumbnails, nothing else knows what these are
+		std::string fileName = GetMD5String(GetThumbnailURI(directory)) + "_" + std::to_string(thumbnailSize) + ".pack";
+
+		packPath = cacheDirectory / "thumbnailpacks" / fileName;
+		this->thumbnailSize = thumbnailSize;
+
+		Map();
+
+		return true;
+	}
+
+	void ThumbnailPack::Close() {
+		file.Close();
+		entries = nullptr;
+		entryCount = 0;
+		entryLookup.clear();
+
+		pendingEntries.clear();
+		pendingLookup.clear();
+		packPath.clear();
+	}
+
+	bool ThumbnailPack::Find(const std::string& fileName, long long modifiedTime, unsigned long long fileSize, FileThumbnailImage& thumbnail) {
+		thumbnail.success = false;
+		thumbnail.width = 0;
+		thumbnail.height = 0;
+
+		auto pending = pendingLookup.find(fileName);
+
+		if (pending != pendingLookup.end()) {
+			const PendingEntry& entry = pendingEntries[pending->second];
+
+			if (entry.modifiedTime != modifiedTime || entry.fileSize != fileSize)
+				return false;
+
+			return entry.width == 0 || DecodeThumbnailPackPayload(entry.payload.data(), entry.payload.size(), entry.width, entry.height, entry.format, thumbnail);
+		}
+
+		auto found = entryLookup.find(fileName);
+
+		if (found == entryLookup.end())
+			return false;
+
+		const ThumbnailPackEntry& entry = ((const ThumbnailPackEntry*)entries)[found->second];
+
+		if (entry.modifiedTime != modifiedTime || entry.fileSize != fileSize)
+			return false;
+
+		return entry.width == 0 || DecodeThumbnailPackPayload(file.GetData() + entry.payloadOffset, entry.payloadSize, entry.width, entry.height, entry.format, thumbnail);
+	}
+
+	void ThumbnailPack::Add(const std::string& fileName, long long modifiedTime, unsigned long long fileSize, const FileThumbnailImage& thumbnail) {
+		if (packPath.empty())
+			return;
+
+		PendingEntry entry;
+		entry.name = fileName;
+		entry.modifiedTime = modifiedTime;
+		entry.fileSize = fileSize;
+		entry.width = thumbnail.success ? thumbnail.width : 0;
+		entry.height = thumbnail.success ? thumbnail.height : 0;
+		entry.format = THUMBNAIL_PACK_RGBA8;
+
+		if (thumbnail.success) {
+			bool opaque = true;
+
+			for (size_t i = 3; i < thumbnail.bitmap.size() && opaque; i += 4) {
+				opaque = thumbnail.bitmap[i] == 255;
+			}
+
+			BlockFormat blockFormat = opaque ? BlockFormat::BC1 : BlockFormat::BC7;
+
+			entry.format = opaque ? THUMBNAIL_PACK_BC1 : THUMBNAIL_PACK_BC7;
+			entry.payload.resize(GetBlockCompressedSize(blockFormat, thumbnail.width, thumbnail.height));
+			CompressBlocks(thumbnail.bitmap.data(), thumbnail.width, thumbnail.height, blockFormat, entry.payload.data());
+		}
+
+		auto pending = pendingLookup.find(fileName);
+
+		if (pending != pendingLookup.end()) {
+			pendingEntries[pending->second] = std::move(entry);
+		} else {
+			pendingLookup[fileName] = pendingEntries.size();
+			pendingEntries.push_back(std::move(entry));
+		}
+	}
+
+	size_t ThumbnailPack::GetUnsavedCount() {
+		return pendingEntries.size();
+	}
+
+	bool ThumbnailPack::Save() {
+		if (pendingEntries.empty() || packPath.empty())
+			return true;
+
+		std::error_code error;
+		std::filesystem::create_directories(packPath.parent_path(), error);
+
+		// Old entries that haven't been replaced
+		std::vector<ThumbnailPackEntry> index;
+		uint64_t keptBytes = 0;
+		uint64_t newBytes = 0;
+
+		for (size_t i = 0; i < entryCount; i++) {
+			const ThumbnailPackEntry& entry = ((const ThumbnailPackEntry*)entries)[i];
+
+			if (pendingLookup.count(std::string((const char*)file.GetData() + entry.nameOffset, entry.nameLength)) == 0) {
+				index.push_back(entry);
+				keptBytes += entry.payloadSize + entry.nameLength;
+			}
+		}
+
+		for (const PendingEntry& entry : pendingEntries) {
+			newBytes += entry.payload.size() + entry.name.size();
+		}
+
+		// Appending leaves old indexes and replaced thumbnails behind, once that's more than what's still used it gets rewritten
+		size_t oldSize = entries != nullptr ? file.GetSize() : 0;
+		bool append = entries != nullptr && oldSize - sizeof(ThumbnailPackHeader) - keptBytes <= keptBytes + newBytes;
+		std::filesystem::path outputPath = packPath;
+
+		if (append) {
+			file.Close(); // Windows won't open it for writing while it's mapped
+		} else {
+			outputPath += ".tmp";
+		}
+
+		std::fstream output(outputPath, append ? std::ios::in | std::ios::out | std::ios::binary : std::ios::out | std::ios::binary | std::ios::trunc);
+
+		if (!output.is_open()) {
+			std::cout << "ERROR: Failed to write thumbnail pack " << outputPath << std::endl;
+			Map();
+			return false;
+		}
+
+		uint64_t offset = 0;
+
+		auto write = [&](const void* data, size_t length) {
+			output.write((const char*)data, length);
+			offset += length;
+		};
+
+		auto align = [&]() {
+			const char zeros[8] = {};
+			write(zeros, (8 - offset % 8) % 8);
+		};
+
+		ThumbnailPackHeader header = {};
+		memcpy(header.magic, "DKTP", 4);
+		header.version = THUMBNAIL_PACK_VERSION;
+		header.thumbnailSize = thumbnailSize;
+
+		if (append) {
+			output.seekp(0, std::ios::end);
+			offset = oldSize;
+		} else {
+			write(&header, sizeof(header)); // Filled in at the end
+
+			for (ThumbnailPackEntry& entry : index) {
+				const unsigned char* data = file.GetData();
+				uint64_t payloadOffset = offset;
+
+				write(data + entry.payloadOffset, entry.payloadSize);
+				entry.payloadOffset = payloadOffset;
+
+				uint64_t nameOffset = offset;
+
+				write(data + entry.nameOffset, entry.nameLength);
+				entry.nameOffset = nameOffset;
+			}
+		}
+
+		for (const PendingEntry& pending : pendingEntries) {
+			ThumbnailPackEntry entry = {};
+			entry.modifiedTime = pending.modifiedTime;
+			entry.fileSize = pending.fileSize;
+			entry.width = pending.width;
+			entry.height = pending.height;
+			entry.format = pending.format;
+			entry.nameLength = (uint32_t)pending.name.size();
+
+			entry.payloadOffset = offset;
+			entry.payloadSize = pending.payload.size();
+			write(pending.payload.data(), pending.payload.size());
+
+			entry.nameOffset = offset;
+			write(pending.name.data(), pending.name.size());
+
+			index.push_back(entry);
+		}
+
+		align();
+
+		header.entryCount = (uint32_t)index.size();
+		header.indexOffset = offset;
+		write(index.data(), index.size() * sizeof(ThumbnailPackEntry));
+
+		// Everything it points to is already there, so a pack cut off part way through still has its old index
+		output.flush();
+		output.seekp(0);
+		output.write((const char*)&header, sizeof(header));
+		output.close();
+
+		bool succeeded = !output.fail();
+
+		if (!append) {
+			file.Close();
+
+			if (succeeded)
+				std::filesystem::rename(outputPath, packPath, error);
+
+			if (!succeeded || error) {
+				std::filesystem::remove(outputPath, error);
+				succeeded = false;
+			}
+		}
+
+		if (!succeeded)
+			std::cout << "ERROR: Failed to write thumbnail pack " << packPath << std::endl;
+
+		pendingEntries.clear();
+		pendingLookup.clear();
+
+		Map();
+
+		return succeeded;
+	}
+}
\ No newline at end of file
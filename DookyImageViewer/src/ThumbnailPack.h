@@ -0,0 +1,59 @@
+#ifndef THUMBNAILPACK_H
+#define THUMBNAILPACK_H
+
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "ImageUtils.h"
+#include "MappedFile.h"
+
+namespace Dooky {
+	// Every thumbnail made for one directory in a single file, mapped in so looking one up doesn't have to open anything.
+	// New thumbnails are kept in memory until Save appends them along with a new index, the file only gets rewritten once most of
+	// it is out of date. Not thread safe
+	class ThumbnailPack {
+	private:
+		struct PendingEntry {
+			std::string name;
+			long long modifiedTime;
+			unsigned long long fileSize;
+			int width;
+			int height;
+			int format;
+			std::vector<unsigned char> payload;
+		};
+
+		std::filesystem::path packPath;
+		int thumbnailSize;
+
+		MappedFile file;
+		const void* entries; // Index in the mapped file
+		size_t entryCount;
+		std::unordered_map<std::string, size_t> entryLookup; // File name to index entry
+
+		std::vector<PendingEntry> pendingEntries;
+		std::unordered_map<std::string, size_t> pendingLookup;
+
+		void Map(); // Whatever's in the file now, an unreadable or out of date one counts as empty
+	public:
+		ThumbnailPack();
+
+		ThumbnailPack(const ThumbnailPack&) = delete;
+		ThumbnailPack& operator=(const ThumbnailPack&) = delete;
+
+		bool Open(const std::filesystem::path& directory, int thumbnailSize); // False if there's nowhere to keep it
+		void Close(); // Unsaved thumbnails are lost
+
+		// Only finds a thumbnail made from the same version of the file. Files that couldn't be made into one are found too, but
+		// don't succeed
+		bool Find(const std::string& fileName, long long modifiedTime, unsigned long long fileSize, FileThumbnailImage& thumbnail);
+		void Add(const std::string& fileName, long long modifiedTime, unsigned long long fileSize, const FileThumbnailImage& thumbnail);
+
+		size_t GetUnsavedCount();
+		bool Save();
+	};
+}
+
+#endif
\ No newline at end of file
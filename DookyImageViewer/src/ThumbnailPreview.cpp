@@ -3,9 +3,12 @@
 
 #include "StringUtils.h"
 
+#include <thread>
+#include <algorithm>
+
 
 namespace Dooky {
-	ThumbnailPreview::ThumbnailPreview() {
+	ThumbnailPreview::ThumbnailPreview() : atlas(64), engine(std::clamp((int)std::thread::hardware_concurrency() / 2, 1, 4), 64) {
 		isVisible = true;
 
 		position = { 0, 0 };
@@ -20,10 +23,24 @@ namespace Dooky {
 		clickedIndex = -1;
 		showHoverBox = false;
 
-		background.Create(1, 1, { 0.4f, 0.4f, 0.4f, 1.0f });
+		centerPreviewImage = nullptr;
+		hoverRect = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+		FileThumbnailImage noImage = GetImageFileThumbnail("./resources/images/NoImage.png", thumbnailSize);
+
+		if (!noImage.success) {
+			noImage.width = thumbnailSize;
+			noImage.height = thumbnailSize;
+			noImage.bitmap.clear();
+
+			for (int i = 0; i < thumbnailSize * thumbnailSize; i++) {
+				noImage.bitmap.insert(noImage.bitmap.end(), { 255, 0, 255, 255 });
+			}
+		}
 
-		hoverBox.Create(1, 1, { 0.2f, 0.5f, 1.0f, 0.5f });
-		hoverBox.adjustment_ShowAlphaCheckerboard = false;
+		noImageSlot = atlas.AllocateSlot();
+		noImageSize = { noImage.width, noImage.height };
+		atlas.Upload(noImageSlot, noImage.width, noImage.height, noImage.bitmap);
 
 		hoverText.LoadFontFromPath("./resources/fonts/Consolas.ttf", 12);
 		hoverText.SetColor(1.0f, 1.0f, 1.0f);
@@ -32,37 +49,81 @@ namespace Dooky {
 	}
 
 	ThumbnailPreview::~ThumbnailPreview() {
-		
+		for (Thumbnail* thumb : previewImages) {
+			DeleteThumbnail(thumb);
+		}
 	}
 
 	////////////////////////////////////////
-	///// MISC
+	///// PRIVATE
 	////////////////////////////////////////
 
-	Thumbnail* CreateThumbnail(std::filesystem::path path) {
-		FileThumbnailImage thumb = GetImageFileThumbnail(path, 64);
+	Thumbnail* ThumbnailPreview::CreateThumbnail(const std::filesystem::path& path, int listIndex) {
 		Thumbnail* thumbnail = new Thumbnail;
+		thumbnail->atlasSlot = -1;
+		thumbnail->size = { thumbnailSize, thumbnailSize };
+		thumbnail->position = { 0, 0 };
+		thumbnail->anchor = 0.5f;
 		thumbnail->offset = 0;
 		thumbnail->filePath = path;
+		thumbnail->listIndex = listIndex;
+		thumbnail->requestId = engine.Request(path, listIndex);
+
+		return thumbnail;
+	}
+
+	void ThumbnailPreview::DeleteThumbnail(Thumbnail* thumbnail) {
+		if (thumbnail->requestId >= 0)
+			engine.Cancel(thumbnail->requestId);
+
+		if (thumbnail->atlasSlot != noImageSlot)
+			atlas.FreeSlot(thumbnail->atlasSlot);
 
-		if (thumb.success) {
-			thumbnail->image.LoadRawData(thumb.width, thumb.height, thumb.bitmap);
+		delete thumbnail;
+	}
+
+	void ThumbnailPreview::LoadThumbnailImage(Thumbnail* thumbnail, const FileThumbnailImage& thumbnailImage) {
+		thumbnail->requestId = -1;
+
+		if (thumbnailImage.success) {
+			if (thumbnail->atlasSlot < 0 || thumbnail->atlasSlot == noImageSlot)
+				thumbnail->atlasSlot = atlas.AllocateSlot(); // Stays a placeholder if the atlas is full
+
+			atlas.Upload(thumbnail->atlasSlot, thumbnailImage.width, thumbnailImage.height, thumbnailImage.bitmap);
+			thumbnail->size = { thumbnailImage.width, thumbnailImage.height };
 		} else {
-			if (!thumbnail->image.LoadImageFile("./resources/images/NoImage.png")) {
-				thumbnail->image.Create(64, 64, { 1.0f, 0.0f, 1.0f, 1.0f });
-			}
+			if (thumbnail->atlasSlot != noImageSlot)
+				atlas.FreeSlot(thumbnail->atlasSlot);
 
-			thumbnail->image.FlipVertically(true);
+			thumbnail->atlasSlot = noImageSlot;
+			thumbnail->size = noImageSize;
 		}
+	}
 
-		thumbnail->image.adjustment_ShowAlphaCheckerboard = false;
+	void ThumbnailPreview::HandleFinishedThumbnails() {
+		bool changed = false;
 
-		return thumbnail;
-	};
+		for (ThumbnailResult& result : engine.PollFinished()) {
+			for (Thumbnail* thumb : previewImages) {
+				if (thumb->requestId == result.requestId) {
+					LoadThumbnailImage(thumb, result.thumbnail);
+					changed = true;
+				}
+			}
+		}
 
-	////////////////////////////////////////
-	///// PRIVATE
-	////////////////////////////////////////
+		if (changed)
+			ChangeIndex(currentIndex);
+	}
+
+	glm::vec4 ThumbnailPreview::GetThumbnailRect(Thumbnail* thumbnail) {
+		return {
+			thumbnail->position.x - (int)(thumbnail->size.x * thumbnail->anchor),
+			thumbnail->position.y - thumbnail->size.y / 2,
+			thumbnail->size.x,
+			thumbnail->size.y
+		};
+	}
 
 	////////////////////////////////////////
 	///// PUBLIC
@@ -72,6 +133,10 @@ namespace Dooky {
 		isVisible = visible;
 	}
 
+	void ThumbnailPreview::SetUseThumbnailPacks(bool use) {
+		engine.SetUseThumbnailPacks(use);
+	}
+
 	void ThumbnailPreview::SetPositionAndWidth(glm::ivec2 pos, int width) {
 		position = pos;
 		this->width = width;
@@ -93,22 +158,20 @@ namespace Dooky {
 		// Delete
 		
 		for (Thumbnail* thumb : previewImages) {
-			delete thumb;
+			DeleteThumbnail(thumb);
 		}
 
 		previewImages.clear();
+		engine.SetCenterIndex(index);
 
 		// Create
-		Thumbnail* thumb = CreateThumbnail(browsingList[index]);
-		thumb->listIndex = index;
-		thumb->image.SetAnchorPoint(0.5f, 0.5f);
+		Thumbnail* thumb = CreateThumbnail(browsingList[index], index);
+		thumb->anchor = 0.5f;
 		previewImages.push_back(thumb);
 		centerPreviewImage = thumb;
 
-		glm::ivec2 originalThumbSize = thumb->image.GetSize();
-
 		int i = index;
-		int originalOffset = thumb->image.GetSize().x / 2 + padding + centerImagePadding;
+		int originalOffset = thumb->size.x / 2 + padding + centerImagePadding;
 
 		// Create images
 		for (int side = 0; side < 2; side++) {
@@ -121,19 +184,18 @@ namespace Dooky {
 
 				if (i >= 0 && i < browsingList.size()) {
 					auto path = browsingList[i];
-					thumb = CreateThumbnail(path);
-					thumb->listIndex = i;
+					thumb = CreateThumbnail(path, i);
 					previewImages.push_back(thumb);
 					
 					if (side == 0) {
-						thumb->image.SetAnchorPoint(1.0f, 0.5f);
+						thumb->anchor = 1.0f;
 						thumb->offset = -offset;
 					} else {
-						thumb->image.SetAnchorPoint(0.0f, 0.5f);
+						thumb->anchor = 0.0f;
 						thumb->offset = offset;
 					}
 
-					offset += thumb->image.GetSize().x + padding;
+					offset += thumb->size.x + padding;
 
 					if (offset > width / 2) break;
 				} else {
@@ -142,17 +204,6 @@ namespace Dooky {
 			}
 		}
 
-		// Selection box
-		selectionBox.SetAnchorPoint(0.5f, 0.5f);
-		selectionBox.Create(originalThumbSize.x + 4, originalThumbSize.y + 4, { 0.2f, 0.8f, 1.0f });
-		selectionBox.adjustment_ShowAlphaCheckerboard = false;
-
-		for (int x = 2; x < originalThumbSize.x + 2; x++) {
-			for (int y = 2; y < originalThumbSize.y + 2; y++) {
-				selectionBox.SetPixel(x, y, { 0.0f, 0.0f, 0.0f, 0.0f });
-			}
-		}
-
 		currentIndex = index;
 	}
 
@@ -160,6 +211,8 @@ namespace Dooky {
 		if (browsingList.empty())
 			return;
 
+		engine.SetCenterIndex(index);
+
 		std::unordered_map<int, Thumbnail*> existingThumbnails;
 
 		for (Thumbnail* thumb : previewImages) {
@@ -172,19 +225,18 @@ namespace Dooky {
 		if (foundThumb != existingThumbnails.end()) {
 			thumb = foundThumb->second;
 		} else {
-			thumb = CreateThumbnail(browsingList[index]);
-			thumb->listIndex = index;
+			thumb = CreateThumbnail(browsingList[index], index);
 		}
 
-		int originalOffset = thumb->image.GetSize().x / 2 + padding + centerImagePadding;
+		int originalOffset = thumb->size.x / 2 + padding + centerImagePadding;
 
 		// Create images
 		std::vector<Thumbnail*> newPreviewImages;
 
-		glm::ivec2 originalThumbSize = thumb->image.GetSize();
 		thumb->offset = 0;
-		thumb->image.SetAnchorPoint(0.5f, 0.5f);
+		thumb->anchor = 0.5f;
 		newPreviewImages.push_back(thumb);
+		centerPreviewImage = thumb;
 
 		int i = index;
 
@@ -203,21 +255,20 @@ namespace Dooky {
 					if (foundThumb != existingThumbnails.end()) {
 						thumb = foundThumb->second;
 					} else {
-						thumb = CreateThumbnail(path);
-						thumb->listIndex = i;
+						thumb = CreateThumbnail(path, i);
 					}
 
 					newPreviewImages.push_back(thumb);
 					
 					if (side == 0) {
-						thumb->image.SetAnchorPoint(1.0f, 0.5f);
+						thumb->anchor = 1.0f;
 						thumb->offset = -offset;
 					} else {
-						thumb->image.SetAnchorPoint(0.0f, 0.5f);
+						thumb->anchor = 0.0f;
 						thumb->offset = offset;
 					}
 
-					offset += thumb->image.GetSize().x + padding;
+					offset += thumb->size.x + padding;
 
 					if (offset > width / 2) break;
 				} else {
@@ -226,17 +277,6 @@ namespace Dooky {
 			}
 		}
 
-		// Selection box
-		selectionBox.SetAnchorPoint(0.5f, 0.5f);
-		selectionBox.Create(originalThumbSize.x + 4, originalThumbSize.y + 4, { 0.2f, 0.8f, 1.0f });
-		selectionBox.adjustment_ShowAlphaCheckerboard = false;
-
-		for (int x = 2; x < originalThumbSize.x + 2; x++) {
-			for (int y = 2; y < originalThumbSize.y + 2; y++) {
-				selectionBox.SetPixel(x, y, { 0.0f, 0.0f, 0.0f, 0.0f });
-			}
-		}
-
 		// Delete unused thumbnails
 		for (Thumbnail* t1 : previewImages) {
 			bool found = false;
@@ -250,7 +290,7 @@ namespace Dooky {
 
 			if (found == false) {
 				//std::cout << "Deleted: " << t1->listIndex << std::endl;
-				delete t1;
+				DeleteThumbnail(t1);
 			}
 		}
 
@@ -268,36 +308,22 @@ namespace Dooky {
 			return;
 
 		glm::ivec2 mousePos = window.GetMousePosition();
-		glm::ivec2 backgroundPos = background.GetPosition();
-		glm::vec2 backgroundScale = background.GetScale();
 		bool clicked = window.WasMousePressed(GLFW_MOUSE_BUTTON_1);
 
-		if (mousePos.x < backgroundPos.x || mousePos.x > backgroundPos.x + backgroundScale.x || mousePos.y < backgroundPos.y || mousePos.y > backgroundPos.y + backgroundScale.y)
+		if (mousePos.x < 0 || mousePos.x > width || mousePos.y < position.y || mousePos.y > position.y + thumbnailSize + padding * 2)
 			return;
 
 		for (int i = 0; i < previewImages.size(); i++) {
 			Thumbnail* thumb = previewImages[i];
+			glm::vec4 rect = GetThumbnailRect(thumb);
 
-			glm::ivec2 pos = thumb->image.GetPosition();
-			glm::ivec2 size = thumb->image.GetSize();
-			glm::ivec2 halfSize = size / 2;
-			glm::vec2 anchor = thumb->image.GetAnchorPoint();
-
-			int lowerBoundX = (pos.x - (size.x * (anchor.x - 0.5f))) - halfSize.x;
-			int upperBoundX = (pos.x - (size.x * (anchor.x - 0.5f))) + halfSize.x;
-
-			int lowerBoundY = pos.y - (size.y / 2);
-			int upperBoundY = pos.y + (size.y / 2);
-
-			if (mousePos.x >= lowerBoundX && mousePos.x <= upperBoundX && mousePos.y >= lowerBoundY && mousePos.y <= upperBoundY) {
+			if (mousePos.x >= rect.x && mousePos.x <= rect.x + rect.z && mousePos.y >= rect.y && mousePos.y <= rect.y + rect.w) {
 				if (clicked) {
 					clickedIndex = thumb->listIndex;
 				}
 
 				showHoverBox = true;
-				hoverBox.SetScale(size.x, size.y);
-				hoverBox.SetPosition(pos.x, pos.y);
-				hoverBox.SetAnchorPoint(anchor.x, anchor.y);
+				hoverRect = rect;
 
 				// Hover text
 				std::string extension = "Unknown extension";
@@ -315,33 +341,45 @@ namespace Dooky {
 	}
 
 	void ThumbnailPreview::Draw(Window& window) {
+		HandleFinishedThumbnails();
+
 		if (!isVisible)
 			return;
 
 		int heightOffset = thumbnailSize / 2 + padding + position.y;
 
-		background.SetPosition(0, position.y);
-		background.SetScale(width, thumbnailSize + padding * 2);
-		background.Draw(window);
-
-		selectionBox.SetPosition(width / 2, heightOffset);
+		// Everything but the text goes into the atlas' batch and is drawn at once
+		atlas.AddQuad({ 0, position.y, width, thumbnailSize + padding * 2 }, { 0.4f, 0.4f, 0.4f, 1.0f });
 
-		// Draw thumbnails
 		for (int i = 0; i < previewImages.size(); i++) {
 			Thumbnail* thumb = previewImages[i];
-			thumb->image.SetPosition(width / 2 + thumb->offset, heightOffset);
-			thumb->image.Draw(window);
+			thumb->position = { width / 2 + thumb->offset, heightOffset };
+
+			if (thumb->atlasSlot >= 0) {
+				atlas.AddQuad(GetThumbnailRect(thumb), thumb->atlasSlot, thumb->size);
+			} else {
+				atlas.AddQuad(GetThumbnailRect(thumb), { 0.3f, 0.3f, 0.3f, 1.0f });
+			}
 		}
 
-		selectionBox.Draw(window);
+		// Selection box
+		if (centerPreviewImage != nullptr) {
+			glm::vec4 rect = GetThumbnailRect(centerPreviewImage);
+			glm::vec4 color = { 0.2f, 0.8f, 1.0f, 1.0f };
+
+			atlas.AddQuad({ rect.x - 2, rect.y - 2, rect.z + 4, 2 }, color);
+			atlas.AddQuad({ rect.x - 2, rect.y + rect.w, rect.z + 4, 2 }, color);
+			atlas.AddQuad({ rect.x - 2, rect.y, 2, rect.w }, color);
+			atlas.AddQuad({ rect.x + rect.z, rect.y, 2, rect.w }, color);
+		}
 
-		if (showHoverBox) {
-			hoverText.SetPosition(
-				(int)(hoverBox.GetPosition().x - (hoverBox.GetScale().x * (hoverBox.GetAnchorPoint().x - 0.5f))),
-				(int)(hoverBox.GetPosition().y + (hoverBox.GetScale().y / 2))
-			);
+		if (showHoverBox)
+			atlas.AddQuad(hoverRect, { 0.2f, 0.5f, 1.0f, 0.5f });
+
+		atlas.Draw(window);
 
-			hoverBox.Draw(window);
+		if (showHoverBox) {
+			hoverText.SetPosition((int)(hoverRect.x + hoverRect.z / 2), (int)(hoverRect.y + hoverRect.w));
 			hoverText.Draw(window);
 		}
 	}
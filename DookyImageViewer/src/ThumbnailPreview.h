@@ -4,18 +4,23 @@
 #include <filesystem>
 #include <unordered_map>
 
-#include "Image.h"
 #include "ImageUtils.h"
+#include "ThumbnailEngine.h"
+#include "ThumbnailAtlas.h"
 #include "Window.h"
 #include "GUI.h"
 #include "Text.h"
 
 namespace Dooky {
 	struct Thumbnail {
-		Image image;
+		int atlasSlot; // -1 while it's a placeholder, failed ones borrow the no image slot
+		glm::ivec2 size;
+		glm::ivec2 position; // Centre of the anchored edge, set when it's drawn
+		float anchor; // Horizontal, 0 for left of the centre image, 1 for right of it and 0.5 for the centre one
 		std::filesystem::path filePath;
 		int offset;
 		int listIndex;
+		int requestId; // Shows a placeholder until the engine has made the thumbnail, -1 after that
 	};
 
 	class ThumbnailPreview {
@@ -23,9 +28,10 @@ namespace Dooky {
 		std::vector<std::filesystem::path> browsingList;
 		std::vector<Thumbnail*> previewImages;
 		Thumbnail* centerPreviewImage;
-		Image background;
-		Image selectionBox;
-		Image hoverBox;
+		ThumbnailAtlas atlas;
+		int noImageSlot; // Shared by every thumbnail that couldn't be made
+		glm::ivec2 noImageSize;
+		glm::vec4 hoverRect;
 		Text hoverText;
 
 		bool isVisible;
@@ -41,11 +47,20 @@ namespace Dooky {
 
 		int clickedIndex;
 		int showHoverBox;
+
+		ThumbnailEngine engine;
+
+		Thumbnail* CreateThumbnail(const std::filesystem::path& path, int listIndex);
+		void DeleteThumbnail(Thumbnail* thumbnail);
+		void LoadThumbnailImage(Thumbnail* thumbnail, const FileThumbnailImage& thumbnailImage);
+		void HandleFinishedThumbnails(); // Lays everything out again if any came in, they're not all the same width
+		glm::vec4 GetThumbnailRect(Thumbnail* thumbnail); // x, y, width and height in window pixels from the top left
 	public:
 		ThumbnailPreview();
 		~ThumbnailPreview();
 		
 		void SetVisible(bool visible);
+		void SetUseThumbnailPacks(bool use);
 
 		void SetPositionAndWidth(glm::ivec2 pos, int width);
 		int GetClickedIndex();
@@ -0,0 +1,203 @@
+#include "TiffParser.h"
+
+uint64_t TIFF_MAX_DIRECTORY_ENTRIES = 4096; // Anything more is a broken file
+
+namespace Dooky {
+	////////////////////////////////////////
+	///// CLASS: TIFF PARSER
+	////////////////////////////////////////
+
+	TiffParser::TiffParser() {
+		data = nullptr;
+		size = 0;
+		littleEndian = true;
+		bigTiff = false;
+		firstDirectoryOffset = 0;
+	}
+
+	////////////////////////////////////////
+	///// PRIVATE
+	////////////////////////////////////////
+
+	size_t TiffParser::GetTypeSize(uint16_t type) {
+		switch (type) {
+		case 1: case 2: case 6: case 7: return 1; // BYTE, ASCII, SBYTE, UNDEFINED
+		case 3: case 8: return 2; // SHORT, SSHORT
+		case 4: case 9: case 11: case 13: return 4; // LONG, SLONG, FLOAT, IFD
+		case 5: case 10: case 12: case 16: case 17: case 18: return 8; // RATIONAL, SRATIONAL, DOUBLE, LONG8, SLONG8, IFD8
+		}
+
+		return 0;
+	}
+
+	////////////////////////////////////////
+	///// PUBLIC
+	////////////////////////////////////////
+
+	bool TiffParser::Open(const unsigned char* data, size_t size) {
+		this->data = data;
+		this->size = size;
+
+		if (size < 8)
+			return false;
+
+		if (data[0] == 'I' && data[1] == 'I') {
+			littleEndian = true;
+		} else if (data[0] == 'M' && data[1] == 'M') {
+			littleEndian = false;
+		} else {
+			return false;
+		}
+
+		uint16_t magic = ReadShort(2);
+
+		if (magic == 43) { // BigTIFF
+			if (ReadShort(4) != 8 || size < 16)
+				return false;
+
+			bigTiff = true;
+			firstDirectoryOffset = ReadLong8(8);
+		} else if (magic == 42 || magic == 0x4F52 || magic == 0x5352 || magic == 0x55) { // Olympus ORF and Panasonic RW2 use their own magic numbers
+			bigTiff = false;
+			firstDirectoryOffset = ReadLong(4);
+		} else {
+			return false;
+		}
+
+		return firstDirectoryOffset < size;
+	}
+
+	uint16_t TiffParser::ReadShort(uint64_t offset) {
+		if (offset > size || size - offset < 2)
+			return 0;
+
+		const unsigned char* p = data + offset;
+
+		if (littleEndian)
+			return p[0] | (p[1] << 8);
+
+		return (p[0] << 8) | p[1];
+	}
+
+	uint32_t TiffParser::ReadLong(uint64_t offset) {
+		if (offset > size || size - offset < 4)
+			return 0;
+
+		const unsigned char* p = data + offset;
+
+		if (littleEndian)
+			return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+
+		return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+	}
+
+	uint64_t TiffParser::ReadLong8(uint64_t offset) {
+		uint64_t first = ReadLong(offset);
+		uint64_t second = ReadLong(offset + 4);
+
+		if (littleEndian)
+			return first | (second << 32);
+
+		return (first << 32) | second;
+	}
+
+	bool TiffParser::ReadDirectory(uint64_t offset, TiffDirectory& directory) {
+		size_t countSize = bigTiff ? 8 : 2;
+		size_t entrySize = bigTiff ? 20 : 12;
+		size_t valueSize = bigTiff ? 8 : 4;
+
+		if (offset == 0 || offset >= size || size - offset < countSize)
+			return false;
+
+		uint64_t entryCount = bigTiff ? ReadLong8(offset) : ReadShort(offset);
+
+		if (entryCount > TIFF_MAX_DIRECTORY_ENTRIES || offset + countSize + entryCount * entrySize + valueSize > size)
+			return false;
+
+		directory.offset = offset;
+		directory.entries.clear();
+
+		for (uint64_t i = 0; i < entryCount; i++) {
+			uint64_t entryOffset = offset + countSize + i * entrySize;
+
+			TiffEntry entry;
+			entry.tag = ReadShort(entryOffset);
+			entry.type = ReadShort(entryOffset + 2);
+			entry.count = bigTiff ? ReadLong8(entryOffset + 4) : ReadLong(entryOffset + 4);
+
+			uint64_t valueFieldOffset = entryOffset + (bigTiff ? 12 : 8);
+
+			// Small values are stored in the entry itself
+			if (entry.count <= valueSize && GetTypeSize(entry.type) * entry.count <= valueSize) {
+				entry.valueOffset = valueFieldOffset;
+			} else {
+				entry.valueOffset = bigTiff ? ReadLong8(valueFieldOffset) : ReadLong(valueFieldOffset);
+			}
+
+			directory.entries[entry.tag] = entry;
+		}
+
+		uint64_t nextFieldOffset = offset + countSize + entryCount * entrySize;
+		directory.nextOffset = bigTiff ? ReadLong8(nextFieldOffset) : ReadLong(nextFieldOffset);
+
+		return true;
+	}
+
+	bool TiffParser::GetValues(const TiffDirectory& directory, uint16_t tag, std::vector<uint64_t>& values) {
+		auto found = directory.entries.find(tag);
+
+		if (found == directory.entries.end())
+			return false;
+
+		const TiffEntry& entry = found->second;
+		size_t typeSize = GetTypeSize(entry.type);
+
+		if (typeSize == 0 || entry.count > size || entry.valueOffset > size || (size - entry.valueOffset) / typeSize < entry.count)
+			return false;
+
+		values.resize(entry.count);
+
+		for (uint64_t i = 0; i < entry.count; i++) {
+			uint64_t offset = entry.valueOffset + i * typeSize;
+
+			switch (entry.type) {
+			case 1: case 6: case 7: values[i] = data[offset]; break;
+			case 3: case 8: values[i] = ReadShort(offset); break;
+			case 4: case 9: case 13: values[i] = ReadLong(offset); break;
+			case 16: case 17: case 18: values[i] = ReadLong8(offset); break;
+			default: return false; // Not an integer
+			}
+		}
+
+		return true;
+	}
+
+	uint64_t TiffParser::GetValue(const TiffDirectory& directory, uint16_t tag, uint64_t defaultValue) {
+		std::vector<uint64_t> values;
+
+		if (!GetValues(directory, tag, values) || values.empty())
+			return defaultValue;
+
+		return values[0];
+	}
+
+	uint64_t TiffParser::GetFirstDirectoryOffset() {
+		return firstDirectoryOffset;
+	}
+
+	bool TiffParser::IsBigTiff() {
+		return bigTiff;
+	}
+
+	bool TiffParser::IsLittleEndian() {
+		return littleEndian;
+	}
+
+	const unsigned char* TiffParser::GetData() {
+		return data;
+	}
+
+	size_t TiffParser::GetSize() {
+		return size;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+#ifndef TIFFPARSER_H
+#define TIFFPARSER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+
+namespace Dooky {
+	// The tags that get used, see the TIFF 6.0 and EXIF specifications for the rest
+	enum TiffTag : uint16_t {
+		TIFF_TAG_NEW_SUBFILE_TYPE = 0x00FE,
+		TIFF_TAG_IMAGE_WIDTH = 0x0100,
+		TIFF_TAG_IMAGE_LENGTH = 0x0101,
+		TIFF_TAG_BITS_PER_SAMPLE = 0x0102,
+		TIFF_TAG_COMPRESSION = 0x0103,
+		TIFF_TAG_PHOTOMETRIC_INTERPRETATION = 0x0106,
+		TIFF_TAG_STRIP_OFFSETS = 0x0111,
+		TIFF_TAG_SAMPLES_PER_PIXEL = 0x0115,
+		TIFF_TAG_ROWS_PER_STRIP = 0x0116,
+		TIFF_TAG_STRIP_BYTE_COUNTS = 0x0117,
+		TIFF_TAG_PLANAR_CONFIGURATION = 0x011C,
+		TIFF_TAG_PREDICTOR = 0x013D,
+		TIFF_TAG_TILE_WIDTH = 0x0142,
+		TIFF_TAG_TILE_LENGTH = 0x0143,
+		TIFF_TAG_TILE_OFFSETS = 0x0144,
+		TIFF_TAG_TILE_BYTE_COUNTS = 0x0145,
+		TIFF_TAG_SUB_IFDS = 0x014A,
+		TIFF_TAG_EXTRA_SAMPLES = 0x0152,
+		TIFF_TAG_SAMPLE_FORMAT = 0x0153,
+		TIFF_TAG_JPEG_TABLES = 0x015B,
+		TIFF_TAG_JPEG_INTERCHANGE_FORMAT = 0x0201,
+		TIFF_TAG_JPEG_INTERCHANGE_FORMAT_LENGTH = 0x0202,
+		TIFF_TAG_EXIF_IFD = 0x8769,
+		TIFF_TAG_PIXEL_X_DIMENSION = 0xA002, // In the EXIF IFD
+		TIFF_TAG_PIXEL_Y_DIMENSION = 0xA003
+	};
+
+	struct TiffEntry {
+		uint16_t tag;
+		uint16_t type;
+		uint64_t count;
+		uint64_t valueOffset; // Where the values are, points inside the entry itself if they fit in there
+	};
+
+	struct TiffDirectory {
+		uint64_t offset;
+		uint64_t nextOffset; // 0 if it's the last one
+		std::unordered_map<uint16_t, TiffEntry> entries;
+	};
+
+	// Reads the directory structure of TIFF based files straight from memory, e.g most RAW files and EXIF data
+	// Offsets are relative to the start of the TIFF header, everything is bounds checked so broken files just read as zeroes
+	class TiffParser {
+	private:
+		const unsigned char* data;
+		size_t size;
+		bool littleEndian;
+		bool bigTiff;
+		uint64_t firstDirectoryOffset;
+
+		size_t GetTypeSize(uint16_t type);
+	public:
+		TiffParser();
+
+		bool Open(const unsigned char* data, size_t size); // Returns false if it isn't TIFF
+
+		uint16_t ReadShort(uint64_t offset);
+		uint32_t ReadLong(uint64_t offset);
+		uint64_t ReadLong8(uint64_t offset);
+
+		bool ReadDirectory(uint64_t offset, TiffDirectory& directory);
+		bool GetValues(const TiffDirectory& directory, uint16_t tag, std::vector<uint64_t>& values); // Only for integer types
+		uint64_t GetValue(const TiffDirectory& directory, uint16_t tag, uint64_t defaultValue = 0);
+
+		uint64_t GetFirstDirectoryOffset();
+		bool IsBigTiff();
+		bool IsLittleEndian();
+		const unsigned char* GetData();
+		size_t GetSize();
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,915 @@
+#include "TiffTileSource.h"
+
+#include <cmath>
+#include <deque>
+#include <cstring>
+#include <algorithm>
+#include <unordered_set>
+
+#include "ThreadPool.h"
+#include "vendor/stb_image/stb_image.h"
+
+int TIFF_REGION_MAX_SHIFT = 2; // Levels up to this many halvings below a directory get read a region at a time and shrunk, any further is too many chunks per tile
+int TIFF_UNCOMPRESSED_STRIP_ROWS = 256; // Uncompressed strips taller than this get read a few rows at a time, some files are one strip for the whole image
+int TIFF_MAX_DIRECTORIES = 64; // Only looked through for reduced resolution copies
+size_t TIFF_MAX_CHUNK_BYTES = 64 * 1024 * 1024; // Decoded, bigger tiles or strips would be as bad as decoding the whole image
+size_t TIFF_CHUNK_CACHE_BYTES = 64 * 1024 * 1024; // Decoded tiles and strips kept around, tiles of the image often share them
+
+namespace Dooky {
+	// TIFF flavour of LZW, codes are MSB first and get wider one code early
+	bool DecodeTiffLZW(const unsigned char* input, size_t inputSize, unsigned char* output, size_t outputSize) {
+		const int CLEAR_CODE = 256;
+		const int END_CODE = 257;
+
+		std::vector<uint16_t> prefixes(4096);
+		std::vector<unsigned char> suffixes(4096);
+		std::vector<unsigned char> firsts(4096);
+		std::vector<uint16_t> lengths(4096);
+
+		for (int i = 0; i < 256; i++) {
+			suffixes[i] = i;
+			firsts[i] = i;
+			lengths[i] = 1;
+		}
+
+		size_t bitPosition = 0;
+		size_t written = 0;
+		int codeWidth = 9;
+		int nextCode = 258;
+		int previousCode = -1;
+
+		// Writes out the string for a code backwards by following the prefixes
+		auto WriteCode = [&](int code) {
+			size_t length = lengths[code];
+			size_t end = std::min(written + length, outputSize);
+
+			for (size_t i = written + length; i > written; i--) {
+				if (i - 1 < end)
+					output[i - 1] = suffixes[code];
+
+				code = prefixes[code];
+			}
+
+			written = end;
+		};
+
+		while (written < outputSize && bitPosition + codeWidth <= inputSize * 8) {
+			int code = 0;
+
+			for (int i = 0; i < codeWidth; i++) {
+				code = (code << 1) | ((input[(bitPosition + i) >> 3] >> (7 - ((bitPosition + i) & 7))) & 1);
+			}
+
+			bitPosition += codeWidth;
+
+			if (code == CLEAR_CODE) {
+				codeWidth = 9;
+				nextCode = 258;
+				previousCode = -1;
+				continue;
+			}
+
+			if (code == END_CODE)
+				break;
+
+			if (previousCode == -1) {
+				if (code > 255)
+					return false;
+
+				WriteCode(code);
+				previousCode = code;
+				continue;
+			}
+
+			if (code > nextCode || nextCode >= 4096)
+				return false;
+
+			// The code being added is the previous string plus the first character of this one, which for a code that isn't in the table yet is its own first character
+			prefixes[nextCode] = previousCode;
+			suffixes[nextCode] = code == nextCode ? firsts[previousCode] : firsts[code];
+			firsts[nextCode] = firsts[previousCode];
+			lengths[nextCode] = lengths[previousCode] + 1;
+			nextCode++;
+
+			WriteCode(code);
+			previousCode = code;
+
+			if (nextCode >= (1 << codeWidth) - 1 && codeWidth < 12)
+				codeWidth++;
+		}
+
+		return written == outputSize;
+	}
+
+	bool DecodePackBits(const unsigned char* input, size_t inputSize, unsigned char* output, size_t outputSize) {
+		size_t i = 0;
+		size_t written = 0;
+
+		while (i < inputSize && written < outputSize) {
+			int header = (signed char)input[i++];
+
+			if (header >= 0) { // Literal run
+				size_t count = std::min({ (size_t)header + 1, inputSize - i, outputSize - written });
+				memcpy(output + written, input + i, count);
+				i += header + 1;
+				written += count;
+			} else if (header != -128 && i < inputSize) { // Repeated byte
+				size_t count = std::min((size_t)(1 - header), outputSize - written);
+				memset(output + written, input[i++], count);
+				written += count;
+			}
+		}
+
+		return written == outputSize;
+	}
+
+	// Adds a row of decoded pixels onto the sums of the overview pixels they fall in
+	template<typename T, typename ToFloat>
+	void AccumulateOverviewRow(const T* row, int count, int channels, int x, int shift, int outputWidth, double* sums, int* counts, ToFloat toFloat) {
+		for (int i = 0; i < count; i++) {
+			int outputX = (x + i) >> shift;
+
+			if (outputX >= outputWidth)
+				break;
+
+			for (int c = 0; c < channels; c++) {
+				sums[outputX * channels + c] += toFloat(row[i * channels + c]);
+			}
+
+			counts[outputX]++;
+		}
+	}
+
+	template<typename T, typename FromFloat>
+	void FinishOverviewRow(const double* sums, const int* counts, int width, int channels, T* output, FromFloat fromFloat) {
+		for (int x = 0; x < width; x++) {
+			for (int c = 0; c < channels; c++) {
+				if (counts[x] > 0) {
+					output[x * channels + c] = fromFloat(sums[x * channels + c] / counts[x]);
+				} else {
+					output[x * channels + c] = x > 0 ? output[(x - 1) * channels + c] : fromFloat(0.0);
+				}
+			}
+		}
+	}
+
+	////////////////////////////////////////
+	///// CLASS: TIFF TILE SOURCE
+	////////////////////////////////////////
+
+	TiffTileSource::TiffTileSource() {
+		width = 0;
+		height = 0;
+		levelCount = 0;
+		format = PixelFormat::RGBA8;
+		cachedBytes = 0;
+	}
+
+	////////////////////////////////////////
+	///// PRIVATE
+	////////////////////////////////////////
+
+	bool TiffTileSource::ReadTiffDirectory(uint64_t offset, Directory& directory) {
+		TiffDirectory entries;
+
+		if (!tiff.ReadDirectory(offset, entries))
+			return false;
+
+		directory.width = tiff.GetValue(entries, TIFF_TAG_IMAGE_WIDTH);
+		directory.height = tiff.GetValue(entries, TIFF_TAG_IMAGE_LENGTH);
+		directory.samplesPerPixel = tiff.GetValue(entries, TIFF_TAG_SAMPLES_PER_PIXEL, 1);
+		directory.bitsPerSample = tiff.GetValue(entries, TIFF_TAG_BITS_PER_SAMPLE, 1);
+		directory.sampleFormat = tiff.GetValue(entries, TIFF_TAG_SAMPLE_FORMAT, 1);
+		directory.compression = tiff.GetValue(entries, TIFF_TAG_COMPRESSION, 1);
+		directory.photometric = tiff.GetValue(entries, TIFF_TAG_PHOTOMETRIC_INTERPRETATION, directory.samplesPerPixel >= 3 ? 2 : 1);
+		directory.predictor = tiff.GetValue(entries, TIFF_TAG_PREDICTOR, 1);
+		directory.level = 0;
+
+		if (directory.width <= 0 || directory.height <= 0)
+			return false;
+
+		if (directory.samplesPerPixel > 1 && tiff.GetValue(entries, TIFF_TAG_PLANAR_CONFIGURATION, 1) != 1)
+			return false; // Separate planes for each channel
+
+		directory.tiled = entries.entries.contains(TIFF_TAG_TILE_WIDTH);
+
+		if (directory.tiled) {
+			directory.chunkWidth = tiff.GetValue(entries, TIFF_TAG_TILE_WIDTH);
+			directory.chunkHeight = tiff.GetValue(entries, TIFF_TAG_TILE_LENGTH);
+			tiff.GetValues(entries, TIFF_TAG_TILE_OFFSETS, directory.offsets);
+			tiff.GetValues(entries, TIFF_TAG_TILE_BYTE_COUNTS, directory.byteCounts);
+		} else {
+			directory.chunkWidth = directory.width;
+			directory.chunkHeight = std::min((int)tiff.GetValue(entries, TIFF_TAG_ROWS_PER_STRIP, directory.height), directory.height);
+			tiff.GetValues(entries, TIFF_TAG_STRIP_OFFSETS, directory.offsets);
+			tiff.GetValues(entries, TIFF_TAG_STRIP_BYTE_COUNTS, directory.byteCounts);
+		}
+
+		if (directory.chunkWidth <= 0 || directory.chunkHeight <= 0 || directory.offsets.size() != directory.byteCounts.size())
+			return false;
+
+		// Only the sample types PixelConversion can take
+		bool supportedSamples = (directory.bitsPerSample == 8 || directory.bitsPerSample == 16) && directory.sampleFormat == 1;
+		supportedSamples = supportedSamples || (directory.bitsPerSample == 32 && directory.sampleFormat == 3);
+
+		if (!supportedSamples || directory.samplesPerPixel < 1 || directory.samplesPerPixel > 5)
+			return false;
+
+		switch (directory.compression) {
+		case 1: case 5: case 8: case 32946: case 32773: break; // None, LZW, Deflate (new and old tag) and PackBits
+		case 7: if (directory.bitsPerSample != 8) return false; break; // JPEG
+		default: return false;
+		}
+
+		int colorSamples;
+
+		switch (directory.photometric) {
+		case 0: case 1: colorSamples = 1; break; // White or black is zero
+		case 2: colorSamples = 3; break; // RGB
+		case 5: colorSamples = 4; break; // CMYK
+		case 6: if (directory.compression != 7) return false; colorSamples = 3; break; // YCbCr, only JPEG is supported which converts it itself
+		default: return false;
+		}
+
+		// One extra sample at most and only if it's straight alpha, premultiplied or unspecified ones are left to ImageMagick
+		if (directory.samplesPerPixel < colorSamples)
+			return false;
+
+		if (directory.samplesPerPixel > colorSamples) {
+			std::vector<uint64_t> extraSamples;
+			tiff.GetValues(entries, TIFF_TAG_EXTRA_SAMPLES, extraSamples);
+
+			if (directory.samplesPerPixel != colorSamples + 1 || extraSamples.size() != 1 || extraSamples[0] != 2)
+				return false;
+		}
+
+		if (directory.predictor != 1 && directory.predictor != 2 && directory.predictor != 3)
+			return false;
+
+		// Tables are in their own JPEG stream that only has those in it
+		auto tables = entries.entries.find(TIFF_TAG_JPEG_TABLES);
+
+		if (tables != entries.entries.end()) {
+			const TiffEntry& entry = tables->second;
+
+			if (entry.valueOffset > file.GetSize() || entry.count > file.GetSize() - entry.valueOffset || entry.count < 4)
+				return false;
+
+			directory.jpegTables.assign(file.GetData() + entry.valueOffset, file.GetData() + entry.valueOffset + entry.count);
+		}
+
+		// Split tall uncompressed strips into smaller ones, they can be read from anywhere so this is free
+		if (!directory.tiled && directory.compression == 1 && directory.chunkHeight > TIFF_UNCOMPRESSED_STRIP_ROWS) {
+			int rowsPerStrip = directory.chunkHeight;
+			int rows = TIFF_UNCOMPRESSED_STRIP_ROWS;
+
+			while (rowsPerStrip % rows != 0) {
+				rows--;
+			}
+
+			uint64_t rowBytes = (uint64_t)directory.width * directory.samplesPerPixel * (directory.bitsPerSample / 8);
+			std::vector<uint64_t> offsets;
+			std::vector<uint64_t> byteCounts;
+
+			for (size_t strip = 0; strip < directory.offsets.size(); strip++) {
+				// The last strip stops at the bottom of the image and any strip can be cut short, the pieces can't go past either
+				int stripRows = std::min(rowsPerStrip, (int)std::max((int64_t)directory.height - (int64_t)strip * rowsPerStrip, (int64_t)0));
+				uint64_t stripBytes = directory.byteCounts[strip];
+
+				for (int row = 0; row < stripRows; row += rows) {
+					uint64_t start = std::min(row * rowBytes, stripBytes);
+
+					offsets.push_back(directory.offsets[strip] + start);
+					byteCounts.push_back(std::min(rows * rowBytes, stripBytes - start)); // Nothing left leaves the piece black like a short strip
+				}
+			}
+
+			directory.chunkHeight = rows;
+			directory.offsets = std::move(offsets);
+			directory.byteCounts = std::move(byteCounts);
+		}
+
+		directory.chunksAcross = (directory.width + directory.chunkWidth - 1) / directory.chunkWidth;
+		directory.chunksDown = (directory.height + directory.chunkHeight - 1) / directory.chunkHeight;
+
+		if (directory.offsets.size() < (size_t)directory.chunksAcross * directory.chunksDown)
+			return false;
+
+		size_t chunkBytes = (size_t)directory.chunkWidth * directory.chunkHeight * std::max((size_t)directory.samplesPerPixel * directory.bitsPerSample / 8, (size_t)4);
+
+		return chunkBytes <= TIFF_MAX_CHUNK_BYTES;
+	}
+
+	// Reduced resolution directories have to come out in the same format as the full resolution one
+	bool TiffTileSource::IsCompatible(const Directory& directory) {
+		const Directory& first = directories.front();
+
+		return directory.samplesPerPixel == first.samplesPerPixel && directory.bitsPerSample == first.bitsPerSample
+			&& directory.sampleFormat == first.sampleFormat && GetLayout(directory, directory.samplesPerPixel) == GetLayout(first, first.samplesPerPixel);
+	}
+
+	PixelLayout TiffTileSource::GetLayout(const Directory& directory, int samples) {
+		switch (directory.photometric) {
+		case 0: case 1: return samples == 1 ? PixelLayout::Gray : PixelLayout::GrayAlpha;
+		case 5: return samples == 4 ? PixelLayout::CMYK : PixelLayout::CMYKA;
+		}
+
+		// RGB, and YCbCr once JPEG has turned it into RGB
+		return samples == 4 ? PixelLayout::RGBA : PixelLayout::RGB;
+	}
+
+	bool TiffTileSource::DecodeChunk(const Directory& directory, int index, std::vector<unsigned char>& pixels) {
+		int chunkY = index / directory.chunksAcross;
+		int rows = directory.tiled ? directory.chunkHeight : std::min(directory.chunkHeight, directory.height - chunkY * directory.chunkHeight);
+		size_t pixelCount = (size_t)directory.chunkWidth * rows;
+
+		uint64_t offset = directory.offsets[index];
+		uint64_t length = directory.byteCounts[index];
+
+		if (offset > file.GetSize() || length > file.GetSize() - offset)
+			return false;
+
+		const unsigned char* compressed = file.GetData() + offset;
+		pixels.resize(pixelCount * GetPixelFormatSize(format));
+
+		if (directory.compression == 7) {
+			// Each tile leaves out the tables, put them back in front of it to make a JPEG stb_image can read
+			std::vector<unsigned char> stream;
+
+			if (!directory.jpegTables.empty() && length >= 2) {
+				stream.assign(directory.jpegTables.begin(), directory.jpegTables.end() - 2); // Without the end of image marker
+				stream.insert(stream.end(), compressed + 2, compressed + length); // Without the start of image marker
+
+				compressed = stream.data();
+				length = stream.size();
+			}
+
+			int w;
+			int h;
+			int components;
+			unsigned char* decodedJPEG = stbi_load_from_memory(compressed, (int)length, &w, &h, &components, 0);
+
+			if (decodedJPEG == nullptr)
+				return false;
+
+			if (w != directory.chunkWidth || h < rows) {
+				stbi_image_free(decodedJPEG);
+				return false;
+			}
+
+			// stb_image hands JPEGs back as gray or RGB whatever the TIFF says, CMYK and YCbCr included
+			ConvertPixels(decodedJPEG, components == 1 ? PixelLayout::Gray : PixelLayout::RGB, pixels.data(), format, pixelCount);
+			stbi_image_free(decodedJPEG);
+
+			return true;
+		}
+
+		size_t sampleBytes = directory.bitsPerSample / 8;
+		size_t samplesPerRow = (size_t)directory.chunkWidth * directory.samplesPerPixel;
+		size_t rowBytes = samplesPerRow * sampleBytes;
+		std::vector<unsigned char> raw(rowBytes * rows);
+
+		switch (directory.compression) {
+		case 1:
+			memcpy(raw.data(), compressed, std::min((size_t)length, raw.size())); // Short strips are left black
+			break;
+		case 5:
+			if (!DecodeTiffLZW(compressed, length, raw.data(), raw.size()))
+				return false;
+
+			break;
+		case 8:
+		case 32946:
+			if (stbi_zlib_decode_buffer((char*)raw.data(), (int)raw.size(), (const char*)compressed, (int)length) < 0)
+				return false;
+
+			break;
+		case 32773:
+			if (!DecodePackBits(compressed, length, raw.data(), raw.size()))
+				return false;
+
+			break;
+		}
+
+		// Undo the predictor and get the samples into the byte order of the CPU, which is assumed to be little endian
+		if (directory.predictor == 3) {
+			// Floating point predictor, the bytes of each row are split up by significance (most first) and then differenced
+			std::vector<unsigned char> shuffled(rowBytes);
+
+			for (int row = 0; row < rows; row++) {
+				unsigned char* p = &raw[row * rowBytes];
+
+				for (size_t i = directory.samplesPerPixel; i < rowBytes; i++) {
+					p[i] += p[i - directory.samplesPerPixel];
+				}
+
+				memcpy(shuffled.data(), p, rowBytes);
+
+				for (size_t i = 0; i < samplesPerRow; i++) {
+					for (size_t b = 0; b < sampleBytes; b++) {
+						p[i * sampleBytes + b] = shuffled[(sampleBytes - b - 1) * samplesPerRow + i];
+					}
+				}
+			}
+		} else {
+			if (!tiff.IsLittleEndian() && sampleBytes > 1) {
+				for (size_t i = 0; i < raw.size(); i += sampleBytes) {
+					std::reverse(&raw[i], &raw[i] + sampleBytes);
+				}
+			}
+
+			if (directory.predictor == 2) {
+				for (int row = 0; row < rows; row++) {
+					if (sampleBytes == 1) {
+						unsigned char* p = &raw[row * rowBytes];
+
+						for (size_t i = directory.samplesPerPixel; i < samplesPerRow; i++) {
+							p[i] += p[i - directory.samplesPerPixel];
+						}
+					} else if (sampleBytes == 2) {
+						uint16_t* p = (uint16_t*)&raw[row * rowBytes];
+
+						for (size_t i = directory.samplesPerPixel; i < samplesPerRow; i++) {
+							p[i] += p[i - directory.samplesPerPixel];
+						}
+					}
+				}
+			}
+		}
+
+		if (directory.photometric == 0) { // White is zero, only the gray sample of each pixel and not the alpha after it
+			size_t sampleCount = raw.size() / sampleBytes;
+
+			if (sampleBytes == 1) {
+				for (size_t i = 0; i < sampleCount; i += directory.samplesPerPixel) {
+					raw[i] = 255 - raw[i];
+				}
+			} else if (sampleBytes == 2) {
+				uint16_t* p = (uint16_t*)raw.data();
+
+				for (size_t i = 0; i < sampleCount; i += directory.samplesPerPixel) {
+					p[i] = 65535 - p[i];
+				}
+			} else {
+				float* p = (float*)raw.data();
+
+				for (size_t i = 0; i < sampleCount; i += directory.samplesPerPixel) {
+					p[i] = 1.0f - p[i]; // Floats are read as 0 to 1 below
+				}
+			}
+		}
+
+		PixelLayout layout = GetLayout(directory, directory.samplesPerPixel);
+
+		if (sampleBytes == 1) {
+			ConvertPixels(raw.data(), layout, pixels.data(), format, pixelCount);
+		} else if (sampleBytes == 2) {
+			ConvertPixels((const unsigned short*)raw.data(), layout, pixels.data(), format, pixelCount);
+		} else {
+			ConvertPixels((const float*)raw.data(), layout, 1.0f, pixels.data(), format, pixelCount);
+		}
+
+		return true;
+	}
+
+	std::shared_ptr<const std::vector<unsigned char>> TiffTileSource::GetChunk(int directory, int index) {
+		auto FindCached = [&]() -> std::shared_ptr<const std::vector<unsigned char>> {
+			for (auto it = cachedChunks.begin(); it != cachedChunks.end(); it++) {
+				if (it->directory == directory && it->index == index) {
+					cachedChunks.splice(cachedChunks.begin(), cachedChunks, it);
+					return it->pixels;
+				}
+			}
+
+			return nullptr;
+		};
+
+		{
+			std::lock_guard<std::mutex> lock(cacheMutex);
+			auto cached = FindCached();
+
+			if (cached != nullptr)
+				return cached;
+		}
+
+		// Decoded without holding the lock so chunks that are already cached can still be read in the meantime
+		std::shared_ptr<std::vector<unsigned char>> pixels = std::make_shared<std::vector<unsigned char>>();
+
+		if (!DecodeChunk(directories[directory], index, *pixels))
+			return nullptr;
+
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		auto cached = FindCached();
+
+		if (cached != nullptr)
+			return cached;
+
+		cachedChunks.push_front({ directory, index, pixels });
+		cachedBytes += pixels->size();
+
+		while (cachedBytes > TIFF_CHUNK_CACHE_BYTES && cachedChunks.size() > 1) {
+			cachedBytes -= cachedChunks.back().pixels->size();
+			cachedChunks.pop_back();
+		}
+
+		return pixels;
+	}
+
+	bool TiffTileSource::ReadDirectoryRegion(int directory, int x, int y, int w, int h, unsigned char* pixels) {
+		const Directory& d = directories[directory];
+		size_t pixelSize = GetPixelFormatSize(format);
+
+		// The part that is actually inside of the directory, at least one pixel of the nearest edge if none of it is
+		int insideX0 = std::clamp(x, 0, d.width - 1);
+		int insideY0 = std::clamp(y, 0, d.height - 1);
+		int insideX1 = std::clamp(x + w, insideX0 + 1, d.width);
+		int insideY1 = std::clamp(y + h, insideY0 + 1, d.height);
+		int insideWidth = insideX1 - insideX0;
+		int insideHeight = insideY1 - insideY0;
+
+		std::vector<unsigned char> inside((size_t)insideWidth * insideHeight * pixelSize);
+
+		// Every chunk it overlaps gets decoded (or fetched from the cache) on its own core
+		int firstChunkX = insideX0 / d.chunkWidth;
+		int firstChunkY = insideY0 / d.chunkHeight;
+		int chunksAcross = (insideX1 - 1) / d.chunkWidth - firstChunkX + 1;
+		int chunksDown = (insideY1 - 1) / d.chunkHeight - firstChunkY + 1;
+		std::atomic<bool> failed = false;
+
+		GetSharedThreadPool().ParallelFor((size_t)chunksAcross * chunksDown, 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end && !failed; i++) {
+				int chunkX = firstChunkX + i % chunksAcross;
+				int chunkY = firstChunkY + i / chunksAcross;
+				std::shared_ptr<const std::vector<unsigned char>> chunk = GetChunk(directory, chunkY * d.chunksAcross + chunkX);
+
+				if (chunk == nullptr) {
+					failed = true;
+					return;
+				}
+
+				int chunkX0 = chunkX * d.chunkWidth;
+				int chunkY0 = chunkY * d.chunkHeight;
+				int x0 = std::max(insideX0, chunkX0);
+				int x1 = std::min(insideX1, chunkX0 + d.chunkWidth);
+				int y0 = std::max(insideY0, chunkY0);
+				int y1 = std::min(insideY1, chunkY0 + d.chunkHeight);
+
+				for (int row = y0; row < y1; row++) {
+					const unsigned char* source = chunk->data() + ((size_t)(row - chunkY0) * d.chunkWidth + (x0 - chunkX0)) * pixelSize;
+					memcpy(&inside[((size_t)(row - insideY0) * insideWidth + (x0 - insideX0)) * pixelSize], source, (x1 - x0) * pixelSize);
+				}
+			}
+		});
+
+		if (failed)
+			return false;
+
+		// Spread it out over the region asked for, repeating the edges where it goes outside
+		int middleBegin = std::clamp(insideX0 - x, 0, w);
+		int middleEnd = std::clamp(insideX1 - x, middleBegin, w);
+
+		for (int row = 0; row < h; row++) {
+			const unsigned char* source = &inside[(size_t)std::clamp(y + row - insideY0, 0, insideHeight - 1) * insideWidth * pixelSize];
+			unsigned char* destination = pixels + (size_t)row * w * pixelSize;
+
+			for (int column = 0; column < middleBegin; column++) {
+				memcpy(destination + column * pixelSize, source, pixelSize);
+			}
+
+			memcpy(destination + middleBegin * pixelSize, source + (x + middleBegin - insideX0) * pixelSize, (middleEnd - middleBegin) * pixelSize);
+
+			for (int column = middleEnd; column < w; column++) {
+				memcpy(destination + column * pixelSize, source + (insideWidth - 1) * pixelSize, pixelSize);
+			}
+		}
+
+		return true;
+	}
+
+	bool TiffTileSource::BuildOverviewLevel(int level, const std::atomic<bool>* cancelled) {
+		std::lock_guard<std::mutex> lock(overviewMutex);
+
+		int directoryIndex = levelDirectories[level];
+		const Directory& d = directories[directoryIndex];
+
+		// Only the first overview level below a directory has to go through all of it, the ones after just shrink the one before
+		int first = level;
+
+		while (first - 1 > d.level + TIFF_REGION_MAX_SHIFT && levelDirectories[first - 1] == directoryIndex) {
+			first--;
+		}
+
+		for (int i = first; i <= level; i++) {
+			if (!overviewLevels[i].empty())
+				continue;
+
+			glm::ivec2 levelSize = GetLevelSize(i);
+			size_t pixelSize = GetPixelFormatSize(format);
+			std::vector<unsigned char> pixels((size_t)levelSize.x * levelSize.y * pixelSize);
+
+			if (i > first) {
+				glm::ivec2 previousSize = GetLevelSize(i - 1);
+				DownsamplePixels(overviewLevels[i - 1].data(), previousSize.x, previousSize.y, format, pixels.data());
+
+				overviewLevels[i] = std::move(pixels);
+				continue;
+			}
+
+			// Box filter the whole directory down a row of chunks at a time, only the overview rows they touch are kept as sums
+			struct OverviewRow {
+				int row;
+				std::vector<double> sums;
+				std::vector<int> counts;
+			};
+
+			int shift = i - d.level;
+			int channels = GetPixelFormatChannels(format);
+			int finishedRows = 0;
+			std::deque<OverviewRow> rows;
+
+			// Chunks are decoded a batch at a time on every core, then added up in order
+			size_t chunkCount = (size_t)d.chunksAcross * d.chunksDown;
+			size_t batchSize = GetSharedThreadPool().GetThreadCount() + 1;
+			std::vector<std::vector<unsigned char>> batch(batchSize);
+
+			for (size_t batchBegin = 0; batchBegin < chunkCount; batchBegin += batchSize) {
+				if (cancelled != nullptr && cancelled->load())
+					return false;
+
+				size_t batchEnd = std::min(batchBegin + batchSize, chunkCount);
+				std::atomic<bool> failed = false;
+
+				GetSharedThreadPool().ParallelFor(batchEnd - batchBegin, 1, [&](size_t begin, size_t end) {
+					for (size_t j = begin; j < end; j++) {
+						if (!DecodeChunk(d, batchBegin + j, batch[j]))
+							failed = true;
+					}
+				});
+
+				if (failed)
+					return false;
+
+				for (size_t index = batchBegin; index < batchEnd; index++) {
+					const std::vector<unsigned char>& chunk = batch[index - batchBegin];
+					int chunkX = index % d.chunksAcross;
+					int chunkY = index / d.chunksAcross;
+					int x0 = chunkX * d.chunkWidth;
+					int y0 = chunkY * d.chunkHeight;
+					int y1 = std::min(y0 + d.chunkHeight, d.height);
+					int count = std::min(d.chunkWidth, d.width - x0);
+
+					if (chunkX == 0) {
+						for (int row = finishedRows + (int)rows.size(); row <= std::min((y1 - 1) >> shift, levelSize.y - 1); row++) {
+							rows.push_back({ row, std::vector<double>((size_t)levelSize.x * channels, 0.0), std::vector<int>(levelSize.x, 0) });
+						}
+					}
+
+					for (int y = y0; y < y1; y++) {
+						int row = (y >> shift) - finishedRows;
+
+						if (row < 0 || row >= (int)rows.size())
+							continue;
+
+						const unsigned char* source = &chunk[(size_t)(y - y0) * d.chunkWidth * pixelSize];
+						double* sums = rows[row].sums.data();
+						int* counts = rows[row].counts.data();
+
+						switch (format) {
+						case PixelFormat::R8: case PixelFormat::RG8: case PixelFormat::RGBA8:
+							AccumulateOverviewRow(source, count, channels, x0, shift, levelSize.x, sums, counts, [](unsigned char v) { return (double)v; });
+							break;
+						case PixelFormat::R16: case PixelFormat::RG16: case PixelFormat::RGBA16:
+							AccumulateOverviewRow((const uint16_t*)source, count, channels, x0, shift, levelSize.x, sums, counts, [](uint16_t v) { return (double)v; });
+							break;
+						case PixelFormat::RGBA16F:
+							AccumulateOverviewRow((const uint16_t*)source, count, channels, x0, shift, levelSize.x, sums, counts, [](uint16_t v) { return (double)HalfToFloat(v); });
+							break;
+						case PixelFormat::RGBA32F:
+							AccumulateOverviewRow((const float*)source, count, channels, x0, shift, levelSize.x, sums, counts, [](float v) { return (double)v; });
+							break;
+						}
+					}
+
+					if (chunkX < d.chunksAcross - 1)
+						continue;
+
+					// Rows that no chunk further down can add to any more
+					while (!rows.empty() && (y1 == d.height || ((rows.front().row + 1) << shift) <= y1)) {
+						unsigned char* destination = &pixels[(size_t)rows.front().row * levelSize.x * pixelSize];
+						const double* sums = rows.front().sums.data();
+						const int* counts = rows.front().counts.data();
+
+						switch (format) {
+						case PixelFormat::R8: case PixelFormat::RG8: case PixelFormat::RGBA8:
+							FinishOverviewRow(sums, counts, levelSize.x, channels, destination, [](double v) { return (unsigned char)(v + 0.5); });
+							break;
+						case PixelFormat::R16: case PixelFormat::RG16: case PixelFormat::RGBA16:
+							FinishOverviewRow(sums, counts, levelSize.x, channels, (uint16_t*)destination, [](double v) { return (uint16_t)(v + 0.5); });
+							break;
+						case PixelFormat::RGBA16F:
+							FinishOverviewRow(sums, counts, levelSize.x, channels, (uint16_t*)destination, [](double v) { return FloatToHalf((float)v); });
+							break;
+						case PixelFormat::RGBA32F:
+							FinishOverviewRow(sums, counts, levelSize.x, channels, (float*)destination, [](double v) { return (float)v; });
+							break;
+						}
+
+						rows.pop_front();
+						finishedRows++;
+					}
+				}
+			}
+
+			// A directory a pixel shorter than the level leaves the last row without anything in it
+			for (int row = std::max(finishedRows, 1); row < levelSize.y; row++) {
+				memcpy(&pixels[(size_t)row * levelSize.x * pixelSize], &pixels[(size_t)(row - 1) * levelSize.x * pixelSize], levelSize.x * pixelSize);
+			}
+
+			overviewLevels[i] = std::move(pixels);
+		}
+
+		return true;
+	}
+
+	////////////////////////////////////////
+	///// PUBLIC
+	////////////////////////////////////////
+
+	bool TiffTileSource::Open(const std::filesystem::path& path) {
+		if (!file.Open(path) || !tiff.Open(file.GetData(), file.GetSize()))
+			return false;
+
+		TiffDirectory firstEntries;
+		Directory first;
+
+		if (!tiff.ReadDirectory(tiff.GetFirstDirectoryOffset(), firstEntries) || !ReadTiffDirectory(tiff.GetFirstDirectoryOffset(), first))
+			return false;
+
+		directories.push_back(first);
+
+		width = first.width;
+		height = first.height;
+
+		switch (GetLayout(first, first.samplesPerPixel)) {
+		case PixelLayout::Gray: format = first.bitsPerSample == 16 ? PixelFormat::R16 : PixelFormat::R8; break;
+		case PixelLayout::GrayAlpha: format = first.bitsPerSample == 16 ? PixelFormat::RG16 : PixelFormat::RG8; break;
+		default: format = first.bitsPerSample == 16 ? PixelFormat::RGBA16 : PixelFormat::RGBA8; break;
+		}
+
+		if (first.bitsPerSample == 32)
+			format = PixelFormat::RGBA16F;
+
+		CountLevels();
+
+		// Reduced resolution copies are either SubIFDs of the first directory or the directories after it, anything that isn't close enough
+		// to half, a quarter and so on of the full resolution (e.g a label or a thumbnail) is something else and gets ignored
+		std::vector<uint64_t> candidates;
+		tiff.GetValues(firstEntries, TIFF_TAG_SUB_IFDS, candidates);
+
+		std::unordered_set<uint64_t> visited = { tiff.GetFirstDirectoryOffset() };
+		uint64_t next = firstEntries.nextOffset;
+
+		while (next != 0 && visited.size() < TIFF_MAX_DIRECTORIES && visited.insert(next).second) {
+			TiffDirectory entries;
+
+			if (!tiff.ReadDirectory(next, entries))
+				break;
+
+			candidates.push_back(next);
+			next = entries.nextOffset;
+		}
+
+		for (uint64_t offset : candidates) {
+			Directory directory;
+
+			if (!ReadTiffDirectory(offset, directory) || !IsCompatible(directory) || directory.width >= width)
+				continue;
+
+			directory.level = (int)roundf(log2f((float)width / directory.width));
+
+			if (directory.level <= 0 || directory.level >= levelCount)
+				continue;
+
+			glm::ivec2 levelSize = GetLevelSize(directory.level);
+
+			if (abs(levelSize.x - directory.width) > 2 || abs(levelSize.y - directory.height) > 2)
+				continue;
+
+			bool alreadyHaveLevel = std::any_of(directories.begin(), directories.end(), [&](const Directory& other) { return other.level == directory.level; });
+
+			if (!alreadyHaveLevel)
+				directories.push_back(std::move(directory));
+		}
+
+		std::sort(directories.begin(), directories.end(), [](const Directory& a, const Directory& b) { return a.level < b.level; });
+
+		levelDirectories.resize(levelCount);
+		overviewLevels.resize(levelCount);
+
+		for (int level = 0; level < levelCount; level++) {
+			for (size_t i = 0; i < directories.size(); i++) {
+				if (directories[i].level <= level)
+					levelDirectories[level] = i;
+			}
+		}
+
+		return true;
+	}
+
+	bool TiffTileSource::ReadImage(std::vector<unsigned char>& pixels, const std::atomic<bool>* cancelled, bool multithreaded) {
+		const Directory& d = directories.front();
+		size_t pixelSize = GetPixelFormatSize(format);
+		size_t chunkCount = (size_t)d.chunksAcross * d.chunksDown;
+		std::atomic<bool> failed = false;
+
+		pixels.resize((size_t)width * height * pixelSize);
+
+		// Tiles and strips don't depend on each other, so each core decodes its share straight into the image
+		GetSharedThreadPool().ParallelFor(chunkCount, multithreaded ? 1 : chunkCount, [&](size_t begin, size_t end) {
+			std::vector<unsigned char> chunk;
+
+			for (size_t i = begin; i < end; i++) {
+				if (failed || (cancelled != nullptr && cancelled->load()))
+					return;
+
+				if (!DecodeChunk(d, i, chunk)) {
+					failed = true;
+					return;
+				}
+
+				int x0 = (i % d.chunksAcross) * d.chunkWidth;
+				int y0 = (i / d.chunksAcross) * d.chunkHeight;
+				int x1 = std::min(x0 + d.chunkWidth, width);
+				int y1 = std::min(y0 + d.chunkHeight, height);
+
+				for (int row = y0; row < y1; row++) {
+					memcpy(&pixels[((size_t)row * width + x0) * pixelSize], &chunk[(size_t)(row - y0) * d.chunkWidth * pixelSize], (x1 - x0) * pixelSize);
+				}
+			}
+		});
+
+		return !failed && !(cancelled != nullptr && cancelled->load());
+	}
+
+	bool TiffTileSource::ReadRegion(int level, int x, int y, int w, int h, std::vector<unsigned char>& pixels, const std::atomic<bool>* cancelled) {
+		if (level < 0 || level >= levelCount)
+			return false;
+
+		glm::ivec2 levelSize = GetLevelSize(level);
+		size_t pixelSize = GetPixelFormatSize(format);
+
+		if (x < 0 || y < 0 || w <= 0 || h <= 0 || x + w > levelSize.x || y + h > levelSize.y)
+			return false;
+
+		int directory = levelDirectories[level];
+		int shift = level - directories[directory].level;
+
+		pixels.resize((size_t)w * h * pixelSize);
+
+		if (shift == 0)
+			return ReadDirectoryRegion(directory, x, y, w, h, pixels.data());
+
+		if (shift > TIFF_REGION_MAX_SHIFT) {
+			if (!BuildOverviewLevel(level, cancelled))
+				return false;
+
+			const unsigned char* overview = overviewLevels[level].data();
+
+			for (int row = 0; row < h; row++) {
+				memcpy(&pixels[(size_t)row * w * pixelSize], overview + ((size_t)(y + row) * levelSize.x + x) * pixelSize, w * pixelSize);
+			}
+
+			return true;
+		}
+
+		// Close enough to the directory to read the same region of it at a higher resolution and shrink that
+		int regionWidth = w << shift;
+		int regionHeight = h << shift;
+		std::vector<unsigned char> region((size_t)regionWidth * regionHeight * pixelSize);
+		std::vector<unsigned char> smaller;
+
+		if (!ReadDirectoryRegion(directory, x << shift, y << shift, regionWidth, regionHeight, region.data()))
+			return false;
+
+		for (int i = 0; i < shift; i++) {
+			smaller.resize((size_t)((regionWidth + 1) / 2) * ((regionHeight + 1) / 2) * pixelSize);
+			DownsamplePixels(region.data(), regionWidth, regionHeight, format, smaller.data());
+
+			region.swap(smaller);
+			regionWidth = (regionWidth + 1) / 2;
+			regionHeight = (regionHeight + 1) / 2;
+		}
+
+		pixels = std::move(region);
+
+		return true;
+	}
+
+	int TiffTileSource::GetCompression() {
+		return directories.front().compression;
+	}
+
+	int TiffTileSource::GetChunkCount() {
+		return directories.front().chunksAcross * directories.front().chunksDown;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+#ifndef TIFFTILESOURCE_H
+#define TIFFTILESOURCE_H
+
+#include <list>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <filesystem>
+
+#include "TiledImage.h"
+#include "TiffParser.h"
+#include "MappedFile.h"
+
+namespace Dooky {
+	// Reads tiled and striped TIFFs (BigTIFF too) straight out of the file a few tiles or strips at a time, so only the parts being looked at
+	// ever get decompressed. Reduced resolution directories (pyramids) are used for the smaller levels when the file has them
+	class TiffTileSource : public TileSource {
+	private:
+		// One resolution stored in the file
+		struct Directory {
+			int width;
+			int height;
+			int chunkWidth; // Tile size, or the full width and rows per strip for strips
+			int chunkHeight;
+			int chunksAcross;
+			int chunksDown;
+			bool tiled;
+			int level; // The level of the pyramid it stands in for
+
+			uint16_t compression;
+			uint16_t predictor;
+			uint16_t photometric;
+			int samplesPerPixel;
+			int bitsPerSample;
+			int sampleFormat;
+
+			std::vector<uint64_t> offsets;
+			std::vector<uint64_t> byteCounts;
+			std::vector<unsigned char> jpegTables; // Shared by every tile of a JPEG compressed TIFF
+		};
+
+		struct CachedChunk {
+			int directory;
+			int index;
+			std::shared_ptr<const std::vector<unsigned char>> pixels;
+		};
+
+		MappedFile file;
+		TiffParser tiff;
+		std::vector<Directory> directories; // Full resolution first
+		std::vector<int> levelDirectories; // Nearest directory at or above the resolution of each level
+		std::vector<std::vector<unsigned char>> overviewLevels; // Levels too far from any directory to read a region at a time, built once by going through the whole directory
+
+		std::list<CachedChunk> cachedChunks; // Most recently used first
+		size_t cachedBytes;
+		std::mutex cacheMutex;
+		std::mutex overviewMutex;
+
+		bool ReadTiffDirectory(uint64_t offset, Directory& directory);
+		bool IsCompatible(const Directory& directory);
+		PixelLayout GetLayout(const Directory& directory, int samples);
+		bool DecodeChunk(const Directory& directory, int index, std::vector<unsigned char>& pixels); // Decoded chunks are chunkWidth wide in GetFormat()
+		std::shared_ptr<const std::vector<unsigned char>> GetChunk(int directory, int index);
+		bool ReadDirectoryRegion(int directory, int x, int y, int w, int h, unsigned char* pixels); // Pixels outside of the directory repeat the edge
+		bool BuildOverviewLevel(int level, const std::atomic<bool>* cancelled);
+	public:
+		TiffTileSource();
+
+		bool Open(const std::filesystem::path& path); // Returns false if it isn't a TIFF this can read a region at a time
+
+		// Decodes the whole full resolution image at once, spread over every core unless told not to
+		bool ReadImage(std::vector<unsigned char>& pixels, const std::atomic<bool>* cancelled = nullptr, bool multithreaded = true);
+		bool ReadRegion(int level, int x, int y, int w, int h, std::vector<unsigned char>& pixels, const std::atomic<bool>* cancelled = nullptr) override;
+
+		int GetCompression(); // TIFF compression tag of the full resolution, e.g 5 for LZW
+		int GetChunkCount(); // Tiles or strips the full resolution is split into
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,497 @@
+#include "TiledImage.h"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+#include "Image.h"
+
+int TILE_SOURCE_SMALLEST_LEVEL = 256; // Levels keep getting halved until they fit in this
+int TILED_IMAGE_TILE_SIZE = 512; // Pixels of the image in each tile, the textures are a bit bigger because of the border
+int TILED_IMAGE_SPARE_TILES = 32; // Tiles that went off screen kept around in case they come back, e.g when panning back and forth
+int TILED_IMAGE_UPLOADS_PER_FRAME = 16; // So a burst of finished tiles doesn't stall one frame
+
+namespace Dooky {
+	////////////////////////////////////////
+	///// CLASS: TILE SOURCE
+	////////////////////////////////////////
+
+	int TileSource::GetWidth() {
+		return width;
+	}
+
+	int TileSource::GetHeight() {
+		return height;
+	}
+
+	int TileSource::GetLevelCount() {
+		return levelCount;
+	}
+
+	glm::ivec2 TileSource::GetLevelSize(int level) {
+		glm::ivec2 levelSize = { width, height };
+
+		for (int i = 0; i < level; i++) {
+			levelSize = (levelSize + 1) / 2;
+		}
+
+		return levelSize;
+	}
+
+	PixelFormat TileSource::GetFormat() {
+		return format;
+	}
+
+	void TileSource::CountLevels() {
+		levelCount = 1;
+
+		while (std::max(GetLevelSize(levelCount - 1).x, GetLevelSize(levelCount - 1).y) > TILE_SOURCE_SMALLEST_LEVEL) {
+			levelCount++;
+		}
+	}
+
+	////////////////////////////////////////
+	///// CLASS: DECODED TILE SOURCE
+	////////////////////////////////////////
+
+	DecodedTileSource::DecodedTileSource(std::shared_ptr<const DecodedImage> image) {
+		this->image = image;
+
+		width = image->width;
+		height = image->height;
+		format = image->format;
+
+		CountLevels();
+		levels.resize(levelCount);
+	}
+
+	const unsigned char* DecodedTileSource::GetLevelPixels(int level) {
+		if (level == 0)
+			return image->data.data();
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// Each level is built from the one before it, so only the first one ever has to go through the whole image
+		for (int i = 1; i <= level; i++) {
+			if (!levels[i].empty())
+				continue;
+
+			glm::ivec2 previousSize = GetLevelSize(i - 1);
+			glm::ivec2 levelSize = GetLevelSize(i);
+			const unsigned char* previous = i == 1 ? image->data.data() : levels[i - 1].data();
+
+			levels[i].resize((size_t)levelSize.x * levelSize.y * GetPixelFormatSize(format));
+			DownsamplePixels(previous, previousSize.x, previousSize.y, format, levels[i].data());
+		}
+
+		return levels[level].data();
+	}
+
+	bool DecodedTileSource::ReadRegion(int level, int x, int y, int w, int h, std::vector<unsigned char>& pixels, const std::atomic<bool>* cancelled) {
+		glm::ivec2 levelSize = GetLevelSize(level);
+		size_t pixelSize = GetPixelFormatSize(format);
+
+		if (level < 0 || level >= levelCount || x < 0 || y < 0 || w <= 0 || h <= 0 || x + w > levelSize.x || y + h > levelSize.y)
+			return false;
+
+		if (image->data.size() < (size_t)width * height * pixelSize)
+			return false;
+
+		const unsigned char* levelPixels = GetLevelPixels(level);
+		pixels.resize((size_t)w * h * pixelSize);
+
+		for (int row = 0; row < h; row++) {
+			memcpy(&pixels[(size_t)row * w * pixelSize], levelPixels + ((size_t)(y + row) * levelSize.x + x) * pixelSize, w * pixelSize);
+		}
+
+		return true;
+	}
+
+	////////////////////////////////////////
+	///// CLASS: TILED IMAGE
+	////////////////////////////////////////
+
+	bool TiledImage::TileKey::operator<(const TileKey& other) const {
+		if (level != other.level)
+			return level < other.level;
+
+		if (y != other.y)
+			return y < other.y;
+
+		return x < other.x;
+	}
+
+	bool TiledImage::TileKey::operator==(const TileKey& other) const {
+		return level == other.level && x == other.x && y == other.y;
+	}
+
+	TiledImage::TiledImage(std::shared_ptr<TileSource> source) {
+		this->source = source;
+
+		frame = 0;
+		level = source->GetLevelCount() - 1;
+		useLinearInterpolation = true;
+
+		loadingKey = { 0, 0, 0 };
+		loading = false;
+		shouldStop = false;
+		cancelled = false;
+
+		wantedPixel = { -1, -1 };
+		pixelWanted = false;
+
+		worker = std::thread(&TiledImage::WorkerLoop, this);
+	}
+
+	TiledImage::~TiledImage() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			shouldStop = true;
+		}
+
+		cancelled = true;
+		condition.notify_all();
+		worker.join();
+
+		for (auto& [key, tile] : tiles) {
+			glDeleteTextures(1, &tile.texture);
+		}
+	}
+
+	////////////////////////////////////////
+	///// PRIVATE
+	////////////////////////////////////////
+
+	void TiledImage::WorkerLoop() {
+		while (true) {
+			LoadedTile loaded;
+			glm::ivec2 pixelPosition;
+			bool readPixel = false;
+
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this] { return shouldStop || !requests.empty() || pixelWanted; });
+
+				if (shouldStop)
+					return;
+
+				// The pixel under the mouse goes before tiles, it's shown every frame and only the latest one is kept
+				if (pixelWanted) {
+					pixelPosition = wantedPixel;
+					pixelWanted = false;
+					readPixel = true;
+				} else {
+					loaded.key = requests.front();
+					requests.pop_front();
+
+					loadingKey = loaded.key;
+					loading = true;
+				}
+			}
+
+			if (readPixel) {
+				std::vector<unsigned char> pixel;
+
+				if (!source->ReadRegion(0, pixelPosition.x, pixelPosition.y, 1, 1, pixel, &cancelled)) {
+					if (cancelled)
+						return;
+
+					pixel.clear();
+				}
+
+				std::lock_guard<std::mutex> lock(mutex);
+
+				if (!pixel.empty())
+					pixelValue = std::move(pixel);
+
+				continue;
+			}
+
+			glm::ivec4 content;
+			GetTileRegion(loaded.key, content, loaded.region);
+
+			// Failed tiles still get handed back with no pixels so they aren't asked for again every frame
+			if (!source->ReadRegion(loaded.key.level, loaded.region.x, loaded.region.y, loaded.region.z, loaded.region.w, loaded.pixels, &cancelled)) {
+				if (cancelled)
+					return;
+
+				std::cout << "FAILED TO READ TILE " << loaded.key.x << ", " << loaded.key.y << " OF LEVEL " << loaded.key.level << std::endl;
+				loaded.pixels.clear();
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			loadedTiles.push_back(std::move(loaded));
+			loading = false;
+		}
+	}
+
+	// Both are x, y, width and height in pixels of the tile's level, region has a pixel of border around the content where there's room
+	void TiledImage::GetTileRegion(const TileKey& key, glm::ivec4& content, glm::ivec4& region) {
+		glm::ivec2 levelSize = source->GetLevelSize(key.level);
+
+		int x0 = key.x * TILED_IMAGE_TILE_SIZE;
+		int y0 = key.y * TILED_IMAGE_TILE_SIZE;
+		int x1 = std::min(x0 + TILED_IMAGE_TILE_SIZE, levelSize.x);
+		int y1 = std::min(y0 + TILED_IMAGE_TILE_SIZE, levelSize.y);
+
+		content = { x0, y0, x1 - x0, y1 - y0 };
+
+		int rx0 = std::max(x0 - 1, 0);
+		int ry0 = std::max(y0 - 1, 0);
+		int rx1 = std::min(x1 + 1, levelSize.x);
+		int ry1 = std::min(y1 + 1, levelSize.y);
+
+		region = { rx0, ry0, rx1 - rx0, ry1 - ry0 };
+	}
+
+	void TiledImage::UploadTile(LoadedTile& loaded) {
+		Tile tile;
+		tile.texture = 0;
+		tile.lastUsedFrame = frame;
+
+		glm::ivec4 content;
+		glm::ivec4 region;
+		GetTileRegion(loaded.key, content, region);
+
+		glm::vec2 levelSize = source->GetLevelSize(loaded.key.level);
+		tile.rect = glm::vec4(content.x / levelSize.x, content.y / levelSize.y, content.z / levelSize.x, content.w / levelSize.y);
+		tile.textureRect = glm::vec4((float)(content.x - region.x) / region.z, (float)(content.y - region.y) / region.w, (float)content.z / region.z, (float)content.w / region.w);
+
+		if (!loaded.pixels.empty()) {
+			GLint internalFormat;
+			GLenum pixelDataFormat;
+			GLenum pixelDataType;
+			GLint swizzle[4];
+			GetPixelFormatGL(source->GetFormat(), internalFormat, pixelDataFormat, pixelDataType, swizzle);
+
+			glGenTextures(1, &tile.texture);
+			glBindTexture(GL_TEXTURE_2D, tile.texture);
+			SetTextureFilter(tile.texture);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, region.z, region.w, 0, pixelDataFormat, pixelDataType, loaded.pixels.data());
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+
+		tiles[loaded.key] = tile;
+	}
+
+	// No mipmaps, the level is picked so a tile is never shrunk by more than half
+	void TiledImage::SetTextureFilter(unsigned int texture) {
+		glBindTexture(GL_TEXTURE_2D, texture);
+
+		if (useLinearInterpolation) {
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		} else {
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		}
+	}
+
+	////////////////////////////////////////
+	///// PUBLIC
+	////////////////////////////////////////
+
+	void TiledImage::Update(glm::vec2 visibleMin, glm::vec2 visibleMax, float scale) {
+		frame++;
+
+		// Upload whatever the worker has finished reading
+		std::vector<LoadedTile> loaded;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			size_t count = std::min(loadedTiles.size(), (size_t)TILED_IMAGE_UPLOADS_PER_FRAME);
+			loaded.insert(loaded.end(), std::make_move_iterator(loadedTiles.begin()), std::make_move_iterator(loadedTiles.begin() + count));
+			loadedTiles.erase(loadedTiles.begin(), loadedTiles.begin() + count);
+		}
+
+		for (LoadedTile& tile : loaded) {
+			if (tiles.find(tile.key) == tiles.end())
+				UploadTile(tile);
+		}
+
+		// Smallest level that is still at least as big as it will be on screen
+		int coarsest = source->GetLevelCount() - 1;
+		level = scale > 0.0f ? (int)floorf(log2f(1.0f / scale)) : coarsest;
+		level = std::clamp(level, 0, coarsest);
+
+		visibleMin = glm::clamp(visibleMin, 0.0f, 1.0f);
+		visibleMax = glm::clamp(visibleMax, 0.0f, 1.0f);
+		glm::vec2 visibleCenter = (visibleMin + visibleMax) * 0.5f;
+
+		// Tiles at a level that overlap the visible part, middle of the window first as that's where people look
+		auto getVisibleTiles = [&](int tileLevel) {
+			std::vector<TileKey> keys;
+
+			if (visibleMin.x >= visibleMax.x || visibleMin.y >= visibleMax.y)
+				return keys;
+
+			glm::vec2 levelSize = source->GetLevelSize(tileLevel);
+			glm::ivec2 tileCount = (glm::ivec2(levelSize) + TILED_IMAGE_TILE_SIZE - 1) / TILED_IMAGE_TILE_SIZE;
+			glm::ivec2 first = glm::clamp(glm::ivec2(glm::floor(visibleMin * levelSize / (float)TILED_IMAGE_TILE_SIZE)), glm::ivec2(0), tileCount - 1);
+			glm::ivec2 last = glm::clamp(glm::ivec2(glm::ceil(visibleMax * levelSize / (float)TILED_IMAGE_TILE_SIZE)) - 1, glm::ivec2(0), tileCount - 1);
+
+			for (int y = first.y; y <= last.y; y++) {
+				for (int x = first.x; x <= last.x; x++) {
+					keys.push_back({ tileLevel, x, y });
+				}
+			}
+
+			glm::vec2 center = visibleCenter * levelSize / (float)TILED_IMAGE_TILE_SIZE - 0.5f;
+
+			std::sort(keys.begin(), keys.end(), [&](const TileKey& a, const TileKey& b) {
+				glm::vec2 da = glm::vec2(a.x, a.y) - center;
+				glm::vec2 db = glm::vec2(b.x, b.y) - center;
+
+				return glm::dot(da, da) < glm::dot(db, db);
+			});
+
+			return keys;
+		};
+
+		std::vector<TileKey> wanted;
+		drawnTiles.clear();
+
+		// The coarsest level is loaded first and kept, so there is always something to draw while the detail streams in
+		for (const TileKey& key : getVisibleTiles(coarsest)) {
+			auto found = tiles.find(key);
+
+			if (found == tiles.end()) {
+				wanted.push_back(key);
+			} else {
+				found->second.lastUsedFrame = frame;
+			}
+		}
+
+		for (const TileKey& key : getVisibleTiles(level)) {
+			auto found = tiles.find(key);
+
+			if (found != tiles.end()) {
+				found->second.lastUsedFrame = frame;
+
+				if (found->second.texture != 0)
+					drawnTiles.push_back({ found->second.texture, found->second.rect, found->second.textureRect });
+
+				continue;
+			}
+
+			wanted.push_back(key);
+
+			// Draw the part of the nearest coarser tile that covers it until it's ready
+			glm::ivec4 content;
+			glm::ivec4 region;
+			GetTileRegion(key, content, region);
+
+			glm::vec2 levelSize = source->GetLevelSize(key.level);
+			glm::vec4 rect = glm::vec4(content.x / levelSize.x, content.y / levelSize.y, content.z / levelSize.x, content.w / levelSize.y);
+
+			for (int parentLevel = level + 1; parentLevel <= coarsest; parentLevel++) {
+				int shift = parentLevel - level;
+				auto parent = tiles.find({ parentLevel, key.x >> shift, key.y >> shift });
+
+				if (parent == tiles.end() || parent->second.texture == 0)
+					continue;
+
+				const Tile& tile = parent->second;
+				parent->second.lastUsedFrame = frame;
+
+				glm::vec2 offset = (glm::vec2(rect.x, rect.y) - glm::vec2(tile.rect.x, tile.rect.y)) / glm::vec2(tile.rect.z, tile.rect.w);
+				glm::vec2 extent = glm::vec2(rect.z, rect.w) / glm::vec2(tile.rect.z, tile.rect.w);
+				glm::vec4 textureRect = glm::vec4(
+					tile.textureRect.x + offset.x * tile.textureRect.z, tile.textureRect.y + offset.y * tile.textureRect.w,
+					extent.x * tile.textureRect.z, extent.y * tile.textureRect.w
+				);
+
+				drawnTiles.push_back({ tile.texture, rect, textureRect });
+				break;
+			}
+		}
+
+		// Hand the worker the new list, anything it already has in hand doesn't need asking for again
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			requests.clear();
+
+			for (const TileKey& key : wanted) {
+				bool alreadyLoaded = std::any_of(loadedTiles.begin(), loadedTiles.end(), [&](const LoadedTile& tile) { return tile.key == key; });
+
+				if (!(loading && loadingKey == key) && !alreadyLoaded)
+					requests.push_back(key);
+			}
+		}
+
+		condition.notify_all();
+
+		// Drop the tiles that haven't been used for the longest, only a few that aren't on screen are kept
+		std::vector<std::map<TileKey, Tile>::iterator> unused;
+
+		for (auto it = tiles.begin(); it != tiles.end(); it++) {
+			if (it->second.lastUsedFrame != frame)
+				unused.push_back(it);
+		}
+
+		if (unused.size() > (size_t)TILED_IMAGE_SPARE_TILES) {
+			std::sort(unused.begin(), unused.end(), [](const auto& a, const auto& b) {
+				return a->second.lastUsedFrame < b->second.lastUsedFrame;
+			});
+
+			for (size_t i = 0; i < unused.size() - TILED_IMAGE_SPARE_TILES; i++) {
+				glDeleteTextures(1, &unused[i]->second.texture);
+				tiles.erase(unused[i]);
+			}
+		}
+	}
+
+	const std::vector<TiledImage::DrawnTile>& TiledImage::GetDrawnTiles() {
+		return drawnTiles;
+	}
+
+	void TiledImage::EnableLinearInterpolation(bool enabled) {
+		useLinearInterpolation = enabled;
+
+		for (auto& [key, tile] : tiles) {
+			if (tile.texture != 0)
+				SetTextureFilter(tile.texture);
+		}
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	bool TiledImage::GetPixel(int x, int y, std::vector<unsigned char>& pixel) {
+		bool wanted = false;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (x >= 0 && y >= 0 && x < source->GetWidth() && y < source->GetHeight() && glm::ivec2(x, y) != wantedPixel) {
+				wantedPixel = { x, y };
+				pixelWanted = true;
+				wanted = true;
+			}
+
+			pixel = pixelValue;
+		}
+
+		if (wanted)
+			condition.notify_all();
+
+		return !pixel.empty();
+	}
+
+	int TiledImage::GetLevel() {
+		return level;
+	}
+
+	int TiledImage::GetResidentTileCount() {
+		return tiles.size();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,133 @@
+#ifndef TILEDIMAGE_H
+#define TILEDIMAGE_H
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <glm/glm.hpp>
+
+#include "ImageDecoder.h"
+#include "PixelConversion.h"
+
+namespace Dooky {
+	// Where a tiled image gets its pixels from, level 0 is the full resolution and every level after it is half the size of the one before
+	// Has to be safe to read from while the main thread is drawing, TiledImage reads it on its own thread
+	class TileSource {
+	protected:
+		int width;
+		int height;
+		int levelCount;
+		PixelFormat format;
+
+		void CountLevels(); // Adds levels until the smallest one is small enough to always be kept around
+	public:
+		virtual ~TileSource() {}
+
+		// Copies a rectangle of one level into pixels as tightly packed rows of GetFormat(), the rectangle has to be inside the level
+		// If cancelled gets set while reading then it gives up as soon as it can and returns false
+		virtual bool ReadRegion(int level, int x, int y, int w, int h, std::vector<unsigned char>& pixels, const std::atomic<bool>* cancelled = nullptr) = 0;
+
+		int GetWidth();
+		int GetHeight();
+		int GetLevelCount();
+		glm::ivec2 GetLevelSize(int level); // Odd sizes round up, see DownsamplePixels
+		PixelFormat GetFormat();
+	};
+
+	// Tiles straight out of an already decoded image, the smaller levels get built from it the first time they're needed
+	class DecodedTileSource : public TileSource {
+	private:
+		std::shared_ptr<const DecodedImage> image;
+		std::vector<std::vector<unsigned char>> levels; // Empty until built, level 0 is never stored as it's image->data
+		std::mutex mutex;
+
+		const unsigned char* GetLevelPixels(int level);
+	public:
+		DecodedTileSource(std::shared_ptr<const DecodedImage> image);
+
+		bool ReadRegion(int level, int x, int y, int w, int h, std::vector<unsigned char>& pixels, const std::atomic<bool>* cancelled = nullptr) override;
+	};
+
+	// Draws an image as a pyramid of tiles so it never has to be one texture, only the tiles covering the window at the level matching
+	// the zoom are kept on the GPU. Missing tiles get read on a worker thread, coarser tiles are drawn in their place until they're ready
+	class TiledImage {
+	public:
+		struct DrawnTile {
+			unsigned int texture;
+			glm::vec4 rect; // Normalised x, y, width and height of the image it covers, rows go the same way as the pixel data
+			glm::vec4 textureRect; // Part of the texture to draw there, tiles have a border for filtering across the edges
+		};
+	private:
+		struct TileKey {
+			int level;
+			int x;
+			int y;
+
+			bool operator<(const TileKey& other) const;
+			bool operator==(const TileKey& other) const;
+		};
+
+		struct Tile {
+			unsigned int texture;
+			glm::vec4 rect;
+			glm::vec4 textureRect;
+			int lastUsedFrame;
+		};
+
+		struct LoadedTile {
+			TileKey key;
+			glm::ivec4 region; // In pixels of the tile's level, including the border
+			std::vector<unsigned char> pixels;
+		};
+
+		std::shared_ptr<TileSource> source;
+		std::map<TileKey, Tile> tiles; // Resident on the GPU
+		std::vector<DrawnTile> drawnTiles;
+		int frame;
+		int level;
+		bool useLinearInterpolation;
+
+		std::thread worker;
+		std::deque<TileKey> requests; // Tiles that are wanted but not resident, most important first, replaced every frame
+		std::vector<LoadedTile> loadedTiles; // Read but not uploaded yet
+		TileKey loadingKey;
+		bool loading;
+
+		glm::ivec2 wantedPixel; // Full resolution pixel GetPixel was last asked for, read on the worker so the render thread never decodes
+		bool pixelWanted; // The worker hasn't picked wantedPixel up yet
+		std::vector<unsigned char> pixelValue; // One pixel of the source's format, empty until the first read finishes
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool shouldStop;
+		std::atomic<bool> cancelled; // So the worker doesn't hold up destroying this, e.g when it's in the middle of a slow read
+
+		void WorkerLoop();
+		void GetTileRegion(const TileKey& key, glm::ivec4& content, glm::ivec4& region);
+		void UploadTile(LoadedTile& loaded);
+		void SetTextureFilter(unsigned int texture);
+	public:
+		TiledImage(std::shared_ptr<TileSource> source);
+		~TiledImage();
+
+		// The visible part of the image is normalised the same way as DrawnTile::rect, scale is window pixels per full resolution pixel
+		// Must be called on the thread that owns the OpenGL context, once a frame before drawing
+		void Update(glm::vec2 visibleMin, glm::vec2 visibleMax, float scale);
+		const std::vector<DrawnTile>& GetDrawnTiles();
+		void EnableLinearInterpolation(bool enabled);
+
+		// Last pixel read for GetPixel, if it's not the one asked for then that one gets read in the background and this is
+		// the old value until it's ready. False if nothing has been read yet
+		bool GetPixel(int x, int y, std::vector<unsigned char>& pixel);
+
+		int GetLevel(); // Level of detail currently being drawn, 0 is full resolution
+		int GetResidentTileCount();
+	};
+}
+
+#endif
\ No newline at end of file
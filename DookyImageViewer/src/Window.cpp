@@ -62,7 +62,8 @@ namespace Dooky {
 		glfwSetCursorPosCallback(windowPointer, cursorPositionCallback);
 		glfwSetDropCallback(windowPointer, droppedCallback);
 
-		// Initialize GLEW
+		// Initialize GLEW, experimental makes it look up extensions the core profile way or they'd all come back missing
+		glewExperimental = GL_TRUE;
 		glewInit();
 
 		// Enable transparency/blending